@@ -1,15 +1,18 @@
 #include <stdio.h>
 #include "SDL.h"
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 #include <time.h>
+#include "chip8_core.h"
+#include "chip8_fade.h"
 
-typedef struct {
-    SDL_Window* window;
-    SDL_Renderer* renderer;
-    SDL_AudioSpec want, have;
-    SDL_AudioDeviceID devID;
-} sdl_t;
+// How update_screen draws the CHIP8 display
+typedef enum {
+    RENDERER_TEXTURE,           // Upload pixel colors to a streaming texture, 1 copy per frame
+    RENDERER_RECTS,             // One filled (and outlined) rectangle per pixel
+} renderer_t;
 
 typedef struct {
     uint32_t window_width;      // SDL Window Width
@@ -19,87 +22,351 @@ typedef struct {
     uint32_t scale_factor;
     bool pixel_outlines;        // Draw pixel "outlines" yes/no
     uint32_t insts_per_second;  // CHIP8 CPU "clock rate" or hz
+    double speed;               // Emulated seconds per real second (1.0 = real time)
+    bool turbo;                 // Run unthrottled, no display wait
     uint32_t square_wave_freq;  // Frequency of square wave sound e.g. 440hz for middle A
     uint32_t audio_sample_rate;
+    uint32_t audio_buffer;      // Samples per audio callback (256-1024), sets the latency
     int16_t volume;             // How loud or not
     float color_lerp_rate;      // Amount to lerp colors by, between [0.1, 1.0]
+    chip8_backend_t backend;    // CHIP8 CPU execution engine
+    chip8_quirks_t quirks;      // Quirk profile the ROM was written for
+    renderer_t renderer;        // Screen drawing path
+    uint32_t rewind_mb;         // Rewind buffer size, 0 = no rewind
+    const char *record;         // Write an input log of the run to this file (NULL: don't)
+    const char *profile;        // Profile the guest (CHIP8_PROFILE builds), CSV to this file
+    const char *trace;          // Trace every instruction to this file (DEBUG builds)
+    const char *map;            // ROM map from chip8-analyze to start with (NULL: none)
 } config_t;
 
+#define AUDIO_RING_SIZE 16384  // Samples, power of 2
+#define AUDIO_QUEUED_BUFFERS 2  // Device buffers allowed in the ring: one to spare for callback jitter
+#define AUDIO_SPARE_MS 2        // Samples kept in the ring past what callbacks take, for scheduling jitter
+#define AUDIO_TRIM_SPANS 30     // Spans between looks at how much the ring keeps to spare
+#define AUDIO_RAMP_SAMPLES 64   // The tone fades in and out over this many samples, so edges don't click
+
+// Sound path: the emulation thread renders the tone for each emulated frame into a
+//   lock-free single producer, single consumer ring, and the SDL audio callback only
+//   copies samples out of it. Nothing else is shared with the audio thread. The tone
+//   starts and stops on the sample of the FX18 or timer tick that does it.
+typedef struct {
+    int16_t samples[AUDIO_RING_SIZE];
+    _Atomic uint32_t head;              // Next sample to play, written by the callback
+    _Atomic uint32_t tail;              // Next free slot, written by the emulation thread
+    _Atomic uint32_t underruns;         // Callbacks that ran out of samples
+    _Atomic uint32_t missing_samples;   // Silence played because of underruns
+    _Atomic uint32_t dropped_samples;   // Samples skipped to keep the latency down
+    _Atomic int32_t min_spare;          // Fewest samples a callback left in the ring since the last trim
+    _Atomic int32_t volume;             // Set by the SDL thread (hotkeys)
+    _Atomic bool idle;                  // Emulation thread asleep (paused): silence isn't an underrun
+
+    // Emulation thread only
+    uint32_t sample_rate;
+    uint32_t max_queued;        // Samples allowed in the ring before a new frame's are added
+    uint32_t spare;             // Samples the ring should keep to spare after each callback
+    uint32_t spans;             // Spans queued since the last trim
+    double phase;               // Square wave phase [0, 1)
+    double phase_step;          // square_wave_freq / sample_rate
+    double gain;                // Tone envelope [0, 1], ramping toward on or off
+    double sample_credit;       // Fraction of a sample carried to the next frame
+} audio_t;
+
+typedef struct {
+    SDL_Window* window;
+    SDL_Renderer* renderer;
+    SDL_AudioSpec want, have;
+    SDL_AudioDeviceID devID;
+    audio_t *audio;
+    SDL_Texture *screen;        // CHIP8 sized streaming texture of pixel_color (RENDERER_TEXTURE)
+    SDL_Texture *outlines;      // Window sized pixel outline overlay (RENDERER_TEXTURE)
+    uint32_t pixel_color[CHIP8_DISPLAY_WIDTH * CHIP8_DISPLAY_HEIGHT];  // CHIP8 pixel colors to draw
+    uint32_t fading_rows;       // Rows with pixel colors still lerping toward fg/bg (bit per row)
+    chip8_fade_fn *fade;        // Color fade kernel for this CPU
+    uint64_t render_ticks;      // Performance counter ticks spent in update_screen
+    uint32_t frames_rendered;
+} sdl_t;
+
+// ROM image kept in memory, so a reset doesn't have to go back to disk
+typedef struct {
+    const char *name;           //Currently running ROM
+    uint8_t data[CHIP8_MAX_ROM_SIZE];
+    size_t size;
+    chip8_map_t map;            // config.map, applied again on every reset
+    bool mapped;
+} rom_t;
+
+// A finished 60hz frame, handed from the emulation thread to the SDL thread
+typedef struct {
+    uint64_t display[CHIP8_DISPLAY_HEIGHT];
+    uint32_t dirty_rows;        // Rows changed since the last frame the SDL thread took
+} frame_t;
+
+#define FRAME_INDEX 3u          // Slot index part of triple_buffer_t.middle
+#define FRAME_FRESH 4u          // The middle slot holds a frame the reader hasn't taken yet
+
+// Lock-free triple buffer: the writer fills back, the reader shows front, and they
+//   swap their slot with middle atomically, so neither ever waits for the other and
+//   the reader always gets the newest finished frame
+typedef struct {
+    frame_t frames[3];
+    _Atomic uint32_t middle;    // Shared slot index | FRAME_FRESH
+    uint32_t back;              // Writer (emulation thread) only
+    uint32_t carry_rows;        // Writer only: dirty rows of a frame the reader skipped
+    uint32_t front;             // Reader (SDL thread) only
+} triple_buffer_t;
+
 typedef enum {
-    QUIT,
-    RUNNING,
-    PAUSED,
-} emulator_state_t;
+    INPUT_KEY_DOWN,
+    INPUT_KEY_UP,
+    INPUT_PAUSE,                // Toggle pause
+    INPUT_RESET,
+    INPUT_SAVE_STATE,           // Snapshot into a slot (and its file)
+    INPUT_LOAD_STATE,           // Restore a slot (from its file if not saved this run)
+    INPUT_REWIND,               // key: 1 while the rewind key is held, 0 when released
+    INPUT_PROFILE,              // Dump the profile so far
+} input_type_t;
+
+typedef struct {
+    uint8_t type;               // input_type_t
+    uint8_t key;                // CHIP8 key for INPUT_KEY_DOWN/UP, slot for INPUT_SAVE/LOAD_STATE
+} input_event_t;
+
+#define INPUT_QUEUE_SIZE 64     // Power of 2
 
-//CHIP8 Instructions
+// Lock-free single producer (SDL thread), single consumer (emulation thread) queue
 typedef struct {
-    uint16_t opcode;     
-    uint16_t NNN;          //12 bit address/constants
-    uint8_t NN;            //8 bit constant
-    uint8_t N;             //4 bit constant
-    uint8_t X;             //4 bit register identifier
-    uint8_t Y;             //4 bit register identifier
-} instruction_t;
-
-//CHIP8 Machine Project
+    input_event_t events[INPUT_QUEUE_SIZE];
+    _Atomic uint32_t head;      // Next event to pop, written by the consumer
+    _Atomic uint32_t tail;      // Next free slot, written by the producer
+    SDL_sem *ready;             // Posted for every event pushed, so a paused consumer can sleep
+} input_queue_t;
+
+#define STATE_SLOTS 4           // F1-F4 save, F5-F8 load
+#define REWIND_KEYFRAME_INTERVAL 60     // Frames; bounds the work of one step back
+#define TRACE_RING_RECORDS (1u << 20)   // 8 MB of trace records in flight
+
+// Everything the SDL thread and the emulation thread share. Once the emulation
+//   thread runs, chip8 is only touched by it.
 typedef struct {
-    emulator_state_t state;
-    uint8_t ram[4096];        
-    bool display[64 * 32];     //Emulate the original Chip8 resolution
-    uint32_t pixel_color[64 * 32];     // CHIP8 pixel colors to draw 
-    uint16_t stack[12];        //Subroutine stack
-    uint16_t *stack_ptr;       //Stack pointer
-    uint8_t V[16];             //Data registers V0-VF
-    uint16_t I;                //Index registers
-    uint16_t PC;               //Program Counter
-    uint8_t delay_timer;       //Decrements at 60hz when > 0
-    uint8_t sound_timer;       //Decrements at 60hz and plays tone when > 0
-    bool keypad[16];           //Hexadecimal keypad 0x0 - 0xF
-    const char *rom_name;      //Currently running ROM
-    instruction_t inst;        //Currently executing instructions
-    bool draw;                 // Update the screen yes/no
-} chip8_t;
-
-// Color "lerp" helper function
-uint32_t color_lerp(const uint32_t start_color, const uint32_t end_color, const float t) {
-    const uint8_t s_r = (start_color >> 24) & 0xFF;
-    const uint8_t s_g = (start_color >> 16) & 0xFF;
-    const uint8_t s_b = (start_color >>  8) & 0xFF;
-    const uint8_t s_a = (start_color >>  0) & 0xFF;
-
-    const uint8_t e_r = (end_color >> 24) & 0xFF;
-    const uint8_t e_g = (end_color >> 16) & 0xFF;
-    const uint8_t e_b = (end_color >>  8) & 0xFF;
-    const uint8_t e_a = (end_color >>  0) & 0xFF;
-
-    const uint8_t ret_r = ((1-t)*s_r) + (t*e_r);
-    const uint8_t ret_g = ((1-t)*s_g) + (t*e_g);
-    const uint8_t ret_b = ((1-t)*s_b) + (t*e_b);
-    const uint8_t ret_a = ((1-t)*s_a) + (t*e_a);
-
-    return (ret_r << 24) | (ret_g << 16) | (ret_b << 8) | ret_a;
+    chip8_t chip8;
+    chip8_jit_t *jit;
+    const config_t *config;     // Only insts_per_second, speed, turbo, backend and quirks are read
+    const rom_t *rom;
+    triple_buffer_t frames;     // Emulation -> SDL thread
+    input_queue_t input;        // SDL -> emulation thread
+    audio_t *audio;             // Emulation thread -> audio callback
+    chip8_state_t slots[STATE_SLOTS];   // Emulation thread only: hotkey save states
+    bool slot_saved[STATE_SLOTS];
+    chip8_rewind_t *rewind;     // Emulation thread only, NULL if rewind is off
+    bool rewinding;             // Rewind key held: step back a frame instead of running one
+    chip8_input_log_t log;      // Emulation thread only: the run's keys (config->record)
+    chip8_profile_t *profile;   // Emulation thread only, NULL if not profiling
+    chip8_trace_t *trace;       // NULL if not tracing
+    uint32_t frame_event;       // SDL user event: a frame was published while the SDL thread had none
+    _Atomic bool quit;
+} emulator_t;
+
+// Emulation thread: hand the finished frame over, then reuse whichever slot was in
+//   the middle. If the reader never took that frame, its dirty rows move to the next one.
+//   Returns true if the reader had taken the last frame, i.e. it may be waiting for this one.
+bool publish_frame(triple_buffer_t *frames, chip8_t *chip8) {
+    frame_t *frame = &frames->frames[frames->back];
+    memcpy(frame->display, chip8->display, sizeof frame->display);
+    frame->dirty_rows = chip8->dirty_rows | frames->carry_rows;
+    chip8->dirty_rows = 0;
+
+    const uint32_t old = atomic_exchange(&frames->middle, frames->back | FRAME_FRESH);
+    frames->back = old & FRAME_INDEX;
+    frames->carry_rows = (old & FRAME_FRESH) ? frames->frames[frames->back].dirty_rows : 0;
+    return !(old & FRAME_FRESH);
 }
 
+// SDL thread: the newest frame if one was published since the last call, else NULL.
+//   The reader owns the frame until the next call.
+frame_t *take_frame(triple_buffer_t *frames) {
+    if (!(atomic_load(&frames->middle) & FRAME_FRESH)) return NULL;
 
-//SDL Audio Callback
-void audio_callback(void* userdata, uint8_t* stream, int len) {
-    config_t* config = (config_t*) userdata;
+    frames->front = atomic_exchange(&frames->middle, frames->front) & FRAME_INDEX;
+    return &frames->frames[frames->front];
+}
+
+bool push_input(input_queue_t *queue, input_event_t event) {
+    const uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&queue->head, memory_order_acquire) == INPUT_QUEUE_SIZE) {
+        SDL_Log("Input queue full, dropping an event\n");
+        return false;
+    }
+    queue->events[tail % INPUT_QUEUE_SIZE] = event;
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    SDL_SemPost(queue->ready);
+    return true;
+}
+
+bool pop_input(input_queue_t *queue, input_event_t *event) {
+    const uint32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&queue->tail, memory_order_acquire)) return false;
+
+    *event = queue->events[head % INPUT_QUEUE_SIZE];
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return true;
+}
+
+// PolyBLEP residual: smooths the square wave's steps over a sample on each side so it
+//   doesn't alias (t: phase since the step, dt: phase step per sample)
+double poly_blep(double t, const double dt) {
+    if (t < dt) {
+        t /= dt;
+        return t + t - t * t - 1.0;
+    }
+    if (t > 1.0 - dt) {
+        t = (t - 1.0) / dt;
+        return t * t + t + t + 1.0;
+    }
+    return 0.0;
+}
+
+// Emulation thread: add samples samples for one emulated span to the ring, the tone on
+//   (or off) as in before up to edge (a fraction of the span) and as in after from there.
+//   It fades over AUDIO_RAMP_SAMPLES at each change. Every AUDIO_TRIM_SPANS spans, one
+//   is rendered shorter or longer by what the callbacks left to spare at the least,
+//   beyond or short of spare: the ring keeps just what the scheduling jitter needs,
+//   whether the audio device drains faster or slower than the emulation fills. A span
+//   is also rendered shorter by what the ring holds beyond max_queued. Either way the
+//   wave carries on from where it was, so nothing jumps.
+void queue_audio(audio_t *audio, const bool before, const bool after, const double edge, uint32_t samples) {
+    const uint32_t tail = atomic_load_explicit(&audio->tail, memory_order_relaxed);
+    const uint32_t queued = tail - atomic_load_explicit(&audio->head, memory_order_acquire);
+    const double volume = atomic_load_explicit(&audio->volume, memory_order_relaxed);
+
+    if (++audio->spans == AUDIO_TRIM_SPANS) {
+        const int32_t min_spare = atomic_exchange_explicit(&audio->min_spare, INT32_MAX, memory_order_relaxed);
+        if (min_spare != INT32_MAX) {
+            // At most a quarter of the span either way, so the pitch hardly bends
+            int32_t trim = min_spare - (int32_t)audio->spare;
+            if (trim > (int32_t)samples / 4) trim = (int32_t)samples / 4;
+            if (trim < -(int32_t)samples / 4) trim = -(int32_t)samples / 4;
+            samples = (uint32_t)((int32_t)samples - trim);
+        }
+        audio->spans = 0;
+    }
+    uint32_t skip = queued > audio->max_queued ? queued - audio->max_queued : 0;
+    if (samples > AUDIO_RING_SIZE - queued + skip) skip = samples - (AUDIO_RING_SIZE - queued);
+    if (skip > samples) skip = samples;
+    if (skip) atomic_fetch_add_explicit(&audio->dropped_samples, skip, memory_order_relaxed);
+    samples -= skip;
+
+    const uint32_t edge_sample = (uint32_t)(edge * samples);
+    for (uint32_t i = 0; i < samples; i++) {
+        const bool on = i < edge_sample ? before : after;
+        if (on && audio->gain < 1.0) {
+            audio->gain += 1.0 / AUDIO_RAMP_SAMPLES;
+            if (audio->gain > 1.0) audio->gain = 1.0;
+        } else if (!on && audio->gain > 0.0) {
+            audio->gain -= 1.0 / AUDIO_RAMP_SAMPLES;
+            if (audio->gain < 0.0) audio->gain = 0.0;
+        }
+
+        double value = 0.0;
+        if (audio->gain > 0.0) {
+            double half_phase = audio->phase + 0.5;
+            if (half_phase >= 1.0) half_phase -= 1.0;
+
+            value = audio->phase < 0.5 ? 1.0 : -1.0;
+            value += poly_blep(audio->phase, audio->phase_step);    // Rising step
+            value -= poly_blep(half_phase, audio->phase_step);      // Falling step
+            value *= audio->gain;
+        }
+        audio->phase += audio->phase_step;
+        if (audio->phase >= 1.0) audio->phase -= 1.0;
 
+        audio->samples[(tail + i) % AUDIO_RING_SIZE] = (int16_t)(value * volume);
+    }
+    atomic_store_explicit(&audio->tail, tail + samples, memory_order_release);
+}
+
+// Samples for one emulated frame at this speed, carrying the fraction over
+uint32_t frame_samples(audio_t *audio, const double frames_per_second) {
+    audio->sample_credit += audio->sample_rate / frames_per_second;
+    const uint32_t samples = (uint32_t)audio->sample_credit;
+    audio->sample_credit -= samples;
+    return samples;
+}
+
+//SDL Audio Callback: play what the emulation thread queued, silence if it fell behind
+void audio_callback(void* userdata, uint8_t* stream, int len) {
+    audio_t* audio = (audio_t*) userdata;
     int16_t* audio_data = (int16_t*) stream;
-    static uint32_t running_sample_index = 0;
-    const int32_t square_wave_period = config->audio_sample_rate / config->square_wave_freq;   // hz / freq = period
-    const int32_t half_square_wave_period = square_wave_period / 2;
-
-    // We are filling out 2 bytes at a time (int16_t), len is in bytes,
-    //   so divide by 2
-    // If the current chunk of audio for the square wave is the crest of the wave, 
-    //   this will add the volume, otherwise it is the trough of the wave, and will add
-    //   "negative" volume
-    for (int i = 0; i < len / 2; i ++) {
-        audio_data[i] = ((running_sample_index++ / half_square_wave_period) % 2) ? 
-                        config->volume : 
-                        -config->volume;
+
+    // We are filling out 2 bytes at a time (int16_t), len is in bytes, so divide by 2
+    const uint32_t wanted = len / 2;
+    const uint32_t head = atomic_load_explicit(&audio->head, memory_order_relaxed);
+    const uint32_t queued = atomic_load_explicit(&audio->tail, memory_order_acquire) - head;
+    const uint32_t samples = queued < wanted ? queued : wanted;
+
+    // Fewest left over, for queue_audio's trim (negative: this many short)
+    const int32_t spare = (int32_t)queued - (int32_t)wanted;
+    if (spare < atomic_load_explicit(&audio->min_spare, memory_order_relaxed)) {
+        atomic_store_explicit(&audio->min_spare, spare, memory_order_relaxed);
+    }
+
+    for (uint32_t i = 0; i < samples; i++) {
+        audio_data[i] = audio->samples[(head + i) % AUDIO_RING_SIZE];
+    }
+    atomic_store_explicit(&audio->head, head + samples, memory_order_release);
+
+    if (samples < wanted) {
+        memset(&audio_data[samples], 0, (wanted - samples) * sizeof audio_data[0]);
+        if (!atomic_load_explicit(&audio->idle, memory_order_relaxed)) {
+            atomic_fetch_add_explicit(&audio->underruns, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&audio->missing_samples, wanted - samples, memory_order_relaxed);
+        }
+    }
+}
+
+// Create the textures for RENDERER_TEXTURE: the display itself, scaled up with nearest
+//   neighbour filtering, and an overlay with the pixel outlines drawn in the background color
+bool init_textures(sdl_t *sdl, const config_t *config) {
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
+
+    sdl->screen = SDL_CreateTexture(sdl->renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
+                                    CHIP8_DISPLAY_WIDTH, CHIP8_DISPLAY_HEIGHT);
+    if (sdl->screen == NULL) {
+        SDL_Log("Could not create SDL Texture! %s\n", SDL_GetError());
+        return false;
+    }
+    SDL_SetTextureBlendMode(sdl->screen, SDL_BLENDMODE_NONE);  // Background pixels may have 0 alpha
+
+    if (!config->pixel_outlines) return true;
+
+    const uint32_t width = config->window_width * config->scale_factor;
+    const uint32_t height = config->window_height * config->scale_factor;
+    uint32_t *overlay = calloc((size_t)width * height, sizeof *overlay);  // Transparent everywhere else
+    if (overlay == NULL) {
+        SDL_Log("Could not allocate the pixel outline overlay\n");
+        return false;
+    }
+
+    // Same 1 pixel border SDL_RenderDrawRect gives each scaled pixel; always opaque, like
+    //   the rectangle renderer which draws without blending
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            const uint32_t cell_x = x % config->scale_factor;
+            const uint32_t cell_y = y % config->scale_factor;
+            if (cell_x == 0 || cell_y == 0 || cell_x == config->scale_factor - 1 || cell_y == config->scale_factor - 1)
+                overlay[y * width + x] = config->bg_color | 0xFF;
+        }
+    }
+
+    sdl->outlines = SDL_CreateTexture(sdl->renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STATIC, width, height);
+    if (sdl->outlines == NULL) {
+        SDL_Log("Could not create SDL Texture! %s\n", SDL_GetError());
+        free(overlay);
+        return false;
     }
+    SDL_UpdateTexture(sdl->outlines, NULL, overlay, width * sizeof *overlay);
+    SDL_SetTextureBlendMode(sdl->outlines, SDL_BLENDMODE_BLEND);
+    free(overlay);
+    return true;
 }
 
 bool init_SDL(sdl_t* sdl, config_t *config) {
@@ -122,13 +389,22 @@ bool init_SDL(sdl_t* sdl, config_t *config) {
         return false;
     }
 
+    if (config->renderer == RENDERER_TEXTURE && !init_textures(sdl, config)) return false;
+    sdl->fade = chip8_fade_kernel("best");
+
+    sdl->audio = calloc(1, sizeof *sdl->audio);
+    if (sdl->audio == NULL) {
+        SDL_Log("Could not allocate the audio ring\n");
+        return false;
+    }
+
     sdl->want = (SDL_AudioSpec){
-        .freq = 44100,              //44100hz "CD" quality
+        .freq = config->audio_sample_rate,
         .format = AUDIO_S16LSB,     //Signed 16 bit little endian 
         .channels = 1,               //Mono 1 channel
-        .samples = 4096,            
+        .samples = config->audio_buffer,    // Small buffers: the tone starts within a few ms
         .callback = audio_callback,
-        .userdata = config,        //Userdata passed to audio callback
+        .userdata = sdl->audio,     //Userdata passed to audio callback
     };
 
     sdl->devID = SDL_OpenAudioDevice(NULL, 0, &sdl->want, &sdl->have, 0);
@@ -144,7 +420,13 @@ bool init_SDL(sdl_t* sdl, config_t *config) {
         return false;
     }
 
-
+    sdl->audio->sample_rate = sdl->have.freq;
+    sdl->audio->max_queued = AUDIO_QUEUED_BUFFERS * sdl->have.samples;
+    sdl->audio->spare = sdl->have.freq * AUDIO_SPARE_MS / 1000;
+    atomic_store(&sdl->audio->min_spare, INT32_MAX);
+    sdl->audio->phase_step = (double)config->square_wave_freq / sdl->have.freq;
+    atomic_store(&sdl->audio->volume, config->volume);
+    SDL_PauseAudioDevice(sdl->devID, 0);    // Always playing, silence while the tone is off
 
     return true;
 }
@@ -160,77 +442,111 @@ bool init_config_from_args(config_t* config, const int argc, char** argv) {
         .scale_factor = 20,
         .pixel_outlines = true,
         .insts_per_second = 600,    // Number of instructions to emulate in 1 second (clock rate of CPU)
+        .speed = 1.0,
+        .turbo = false,
         .square_wave_freq = 440,    // 440hz for middle A
         .audio_sample_rate = 44100, // CD quality, 44100hz
+        .audio_buffer = 256,        // ~6ms at 44100hz
         .volume = 3000,             // INT16_MAX would be max volume
         .color_lerp_rate = 0.7,
+        .backend = CHIP8_BACKEND_CACHED,
+        .quirks = CHIP8_QUIRKS_VIP,
+        .renderer = RENDERER_TEXTURE,
+        .rewind_mb = 8,             // Several minutes of play for most ROMs
     };
     for (int i = 1; i < argc; i++) {
         (void)argv[i];
         if (strncmp(argv[i], "--scale-factor", strlen("--scale-factor")) == 0) {
             i = i + 1;
             config->scale_factor = (uint32_t)strtol(argv[i], NULL, 10);
+        } else if (strncmp(argv[i], "--backend", strlen("--backend")) == 0 && i + 1 < argc) {
+            i = i + 1;
+            if (!chip8_backend_from_name(argv[i], &config->backend)) {
+                SDL_Log("Unknown backend %s\n", argv[i]);
+                return false;
+            }
+        } else if (strncmp(argv[i], "--quirks", strlen("--quirks")) == 0 && i + 1 < argc) {
+            i = i + 1;
+            if (!chip8_quirks_from_name(argv[i], &config->quirks)) {
+                SDL_Log("Unknown quirk profile %s (vip, schip or modern)\n", argv[i]);
+                return false;
+            }
+        } else if (strncmp(argv[i], "--insts-per-second", strlen("--insts-per-second")) == 0 && i + 1 < argc) {
+            i = i + 1;
+            config->insts_per_second = (uint32_t)strtoul(argv[i], NULL, 10);
+        } else if (strncmp(argv[i], "--speed", strlen("--speed")) == 0 && i + 1 < argc) {
+            i = i + 1;
+            config->speed = strtod(argv[i], NULL);
+            if (!(config->speed > 0.0)) {
+                SDL_Log("Speed must be above 0\n");
+                return false;
+            }
+        } else if (strncmp(argv[i], "--audio-buffer", strlen("--audio-buffer")) == 0 && i + 1 < argc) {
+            i = i + 1;
+            config->audio_buffer = (uint32_t)strtoul(argv[i], NULL, 10);
+            if (config->audio_buffer < 256 || config->audio_buffer > 1024) {
+                SDL_Log("Audio buffer must be 256-1024 samples\n");
+                return false;
+            }
+        } else if (strncmp(argv[i], "--rewind-mb", strlen("--rewind-mb")) == 0 && i + 1 < argc) {
+            i = i + 1;
+            config->rewind_mb = (uint32_t)strtoul(argv[i], NULL, 10);
+        } else if (strncmp(argv[i], "--record", strlen("--record")) == 0 && i + 1 < argc) {
+            i = i + 1;
+            config->record = argv[i];
+        } else if (strncmp(argv[i], "--profile", strlen("--profile")) == 0 && i + 1 < argc) {
+            i = i + 1;
+            config->profile = argv[i];
+        } else if (strncmp(argv[i], "--trace", strlen("--trace")) == 0 && i + 1 < argc) {
+            i = i + 1;
+            config->trace = argv[i];
+        } else if (strncmp(argv[i], "--map", strlen("--map")) == 0 && i + 1 < argc) {
+            i = i + 1;
+            config->map = argv[i];
+        } else if (strncmp(argv[i], "--turbo", strlen("--turbo")) == 0) {
+            config->turbo = true;
+        } else if (strncmp(argv[i], "--renderer", strlen("--renderer")) == 0 && i + 1 < argc) {
+            i = i + 1;
+            if (strcmp(argv[i], "texture") == 0) {
+                config->renderer = RENDERER_TEXTURE;
+            } else if (strcmp(argv[i], "rects") == 0) {
+                config->renderer = RENDERER_RECTS;
+            } else {
+                SDL_Log("Unknown renderer %s (texture or rects)\n", argv[i]);
+                return false;
+            }
         }
     }
+    if (config->record && config->turbo) {
+        SDL_Log("--record needs the display wait, it can't be used with --turbo\n");
+        return false;
+    }
     return true;
 }
 
-bool init_chip8(chip8_t* chip8,config_t* config, const char rom_name[]) {
-    const uint16_t entry_point = 0x200;   //Chip8 ROM will be loaded to 0x200
-    const uint8_t font[] = {
-        0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-        0x20, 0x60, 0x20, 0x20, 0x70, // 1
-        0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-        0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-        0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-        0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-        0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-        0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-        0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-        0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-        0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-        0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-        0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-        0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-        0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-        0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-    };
-
-    memset(chip8, 0, sizeof(chip8_t));
-
-    //load Font
-    memcpy(&chip8->ram, font, sizeof(font));
-
-    //load ROM
-    FILE* rom = fopen(rom_name, "rb");
-    if (rom == NULL) {
-        SDL_Log("Rom file %s is invalid or does not exist %s\n", rom_name, SDL_GetError());
+// Load the ROM into memory and start the CHIP8 machine with it
+bool init_chip8(chip8_t* chip8, sdl_t *sdl, const config_t config, rom_t *rom, chip8_jit_t *jit) {
+    if (!chip8_load_rom_file(rom->name, rom->data, sizeof rom->data, &rom->size)) {
+        SDL_Log("Rom file %s could not be loaded\n", rom->name);
         return false;
     }
-    fseek(rom, 0, SEEK_END);
-    const size_t rom_size = ftell(rom);
-    const size_t max_size = sizeof chip8->ram - entry_point;
-    rewind(rom);
-
-    if (max_size < rom_size) {
-        SDL_Log("Rom file %s is too big! Rom size: %zu, Max size allowed: %zu %s\n", 
-            rom_name, rom_size, max_size, SDL_GetError());
-        return false;
+    if (!chip8_init(chip8, rom->data, rom->size)) return false;
+    if (!chip8_set_backend(chip8, config.backend, jit)) {
+        SDL_Log("No recompiler for this host, using the cached interpreter\n");
     }
+    chip8_set_quirks(chip8, config.quirks);
 
-    if (fread(&chip8->ram[entry_point], rom_size, 1, rom) != 1) {
-        SDL_Log("Could not read Rom file %s into CHIP8 Memory %s\n", 
-            rom_name, SDL_GetError());
-        return false;
+    if (config.map) {
+        if (!chip8_map_load(&rom->map, config.map)) return false;
+        if (!chip8_apply_map(chip8, &rom->map)) {
+            SDL_Log("ROM map %s is for another ROM or quirk profile\n", config.map);
+            return false;
+        }
+        rom->mapped = true;
     }
 
-    fclose(rom);
-    
-    chip8->state = RUNNING;
-    chip8->PC = entry_point;
-    chip8->rom_name = rom_name;
-    chip8->stack_ptr = &chip8->stack[0]; //or &chip8->stack[0]
-    memset(chip8->pixel_color, config->bg_color, sizeof chip8->pixel_color);
+    for (uint32_t i = 0; i < sizeof sdl->pixel_color / sizeof sdl->pixel_color[0]; i++)
+        sdl->pixel_color[i] = config.bg_color;
     return true;
 }
 
@@ -249,7 +565,8 @@ void clear_screen(const sdl_t sdl, const config_t config) {
 
 
 
-void update_screen(const sdl_t sdl, const config_t config, chip8_t* chip8) {
+// RENDERER_RECTS: draw a rectangle per pixel to the SDL window
+void draw_pixel_rects(sdl_t *sdl, const config_t config, const frame_t *frame) {
     SDL_Rect rect = {.x = 0, .y = 0, .w = config.scale_factor, .h = config.scale_factor};
 
     //Grab color value to draw
@@ -258,772 +575,490 @@ void update_screen(const sdl_t sdl, const config_t config, chip8_t* chip8) {
     const uint8_t bg_b = (config.bg_color >> 8) & 0xFF;
     const uint8_t bg_a = (config.bg_color & 0xFF);
 
-    //loop through display pixels, draw a rectangle per pixel to the SDL window.
-    for (uint32_t i = 0; i < sizeof chip8->display; i++) {
+    for (uint32_t i = 0; i < CHIP8_DISPLAY_WIDTH * CHIP8_DISPLAY_HEIGHT; i++) {
         //Translate 1D index value i to 2D X/Y coordinates
         //X = i % window width
         //Y = i / window width
         rect.x = (i % config.window_width) * config.scale_factor;
         rect.y = (i / config.window_width) * config.scale_factor;
 
-        if (chip8->display[i]) {
-            if (chip8->pixel_color[i] != config.fg_color) {
-                chip8->pixel_color[i] = color_lerp(chip8->pixel_color[i], config.fg_color, config.color_lerp_rate);
-            }
+        const uint8_t r = (sdl->pixel_color[i] >> 24) & 0xFF;
+        const uint8_t g = (sdl->pixel_color[i] >> 16) & 0xFF;
+        const uint8_t b = (sdl->pixel_color[i] >>  8) & 0xFF;
+        const uint8_t a = (sdl->pixel_color[i] >>  0) & 0xFF;
 
-            const uint8_t r = (chip8->pixel_color[i] >> 24) & 0xFF;
-            const uint8_t g = (chip8->pixel_color[i] >> 16) & 0xFF;
-            const uint8_t b = (chip8->pixel_color[i] >>  8) & 0xFF;
-            const uint8_t a = (chip8->pixel_color[i] >>  0) & 0xFF;
+        SDL_SetRenderDrawColor(sdl->renderer, r, g, b, a);
+        SDL_RenderFillRect(sdl->renderer, &rect);
 
-            //Pixel is on, draw foreground color
-            SDL_SetRenderDrawColor(sdl.renderer, r, g, b, a);
-            SDL_RenderFillRect(sdl.renderer, &rect);
+        // If user requested drawing pixel outlines, draw those here (pixels that are on only)
+        const uint32_t x = i % CHIP8_DISPLAY_WIDTH;
+        if (config.pixel_outlines && (frame->display[i / CHIP8_DISPLAY_WIDTH] >> (CHIP8_DISPLAY_WIDTH - 1 - x)) & 1) {
+            SDL_SetRenderDrawColor(sdl->renderer, bg_r, bg_g, bg_b, bg_a);
+            SDL_RenderDrawRect(sdl->renderer, &rect);
+        }
+    }
+}
 
-            // If user requested drawing pixel outlines, draw those here
-            if (config.pixel_outlines) {
-                SDL_SetRenderDrawColor(sdl.renderer, bg_r, bg_g, bg_b, bg_a);
-                SDL_RenderDrawRect(sdl.renderer, &rect);
-            }
-        } else {
-            //Pixel is off, draw background color
-            if (chip8->pixel_color[i] != config.bg_color) {
-                chip8->pixel_color[i] = color_lerp(chip8->pixel_color[i], config.bg_color, config.color_lerp_rate);
-            }
+// RENDERER_TEXTURE: upload the pixel colors of the changed rows (one update per run of
+//   adjacent rows) and let the renderer scale the whole texture in a single copy.
+//   The outline overlay covers every pixel; on pixels that are off it is drawn in the
+//   background color anyway, so it only shows while they fade out.
+void draw_pixel_texture(sdl_t *sdl, const config_t config, uint32_t rows) {
+    for (uint32_t y = 0; y < CHIP8_DISPLAY_HEIGHT; y++) {
+        if (!(rows & (1u << y))) continue;
+
+        uint32_t end = y + 1;
+        while (end < CHIP8_DISPLAY_HEIGHT && (rows & (1u << end))) end++;
+
+        const SDL_Rect run = {.x = 0, .y = y, .w = CHIP8_DISPLAY_WIDTH, .h = end - y};
+        SDL_UpdateTexture(sdl->screen, &run, &sdl->pixel_color[y * CHIP8_DISPLAY_WIDTH],
+                          CHIP8_DISPLAY_WIDTH * sizeof sdl->pixel_color[0]);
+        y = end;
+    }
+    SDL_RenderCopy(sdl->renderer, sdl->screen, NULL, NULL);
 
-            const uint8_t r = (chip8->pixel_color[i] >> 24) & 0xFF;
-            const uint8_t g = (chip8->pixel_color[i] >> 16) & 0xFF;
-            const uint8_t b = (chip8->pixel_color[i] >>  8) & 0xFF;
-            const uint8_t a = (chip8->pixel_color[i] >>  0) & 0xFF;
+    if (config.pixel_outlines) {
+        SDL_RenderCopy(sdl->renderer, sdl->outlines, NULL, NULL);
+    }
+}
 
-            //Pixel is on, draw foreground color
-            SDL_SetRenderDrawColor(sdl.renderer, r, g, b, a);
-            SDL_RenderFillRect(sdl.renderer, &rect);
-        }
+// Redraw the window if any display row changed or is still fading; an idle screen costs
+//   nothing, not even a present
+void update_screen(sdl_t *sdl, const config_t config, const frame_t *frame) {
+    const uint32_t rows = frame->dirty_rows | sdl->fading_rows;
+    if (rows == 0) return;
+
+    const uint64_t start = SDL_GetPerformanceCounter();
+
+    // Fade each pixel's color toward the foreground (pixel on) or background (pixel off) color
+    sdl->fading_rows = sdl->fade(sdl->pixel_color, frame->display, rows, config.fg_color,
+                                 config.bg_color, chip8_fade_weight(config.color_lerp_rate));
+    if (config.renderer == RENDERER_TEXTURE) {
+        draw_pixel_texture(sdl, config, rows);
+    } else {
+        // The back buffer isn't kept between presents, so every rectangle is drawn again
+        draw_pixel_rects(sdl, config, frame);
     }
-    SDL_RenderPresent(sdl.renderer);
+    SDL_RenderPresent(sdl->renderer);
+
+    sdl->render_ticks += SDL_GetPerformanceCounter() - start;
+    sdl->frames_rendered++;
 }
 
-// Handle user input
+// Keyboard layout of the CHIP8 keypad
 // CHIP8 Keypad  QWERTY 
 // 123C          1234
 // 456D          qwer
 // 789E          asdf
 // A0BF          zxcv
-void process_events(config_t *config, chip8_t *chip8) {
-    SDL_Event event;
-    while (SDL_PollEvent(&event)) { //any event (operation) is automatically added at the backend the SDL pulls it out
-        switch (event.type) {
-            case SDL_QUIT:
-                chip8->state = QUIT;
-                break;
-            case SDL_KEYUP:
-                switch (event.key.keysym.sym) { //The sym member of SDL_Keysym is an SDL_Keycode value that represents the specific key that was pressed or released.
-                    // Map qwerty keys to CHIP8 keypad
-                    case SDLK_1: chip8->keypad[0x1] = false; break;
-                    case SDLK_2: chip8->keypad[0x2] = false; break;
-                    case SDLK_3: chip8->keypad[0x3] = false; break;
-                    case SDLK_4: chip8->keypad[0xC] = false; break;
-
-                    case SDLK_q: chip8->keypad[0x4] = false; break;
-                    case SDLK_w: chip8->keypad[0x5] = false; break;
-                    case SDLK_e: chip8->keypad[0x6] = false; break;
-                    case SDLK_r: chip8->keypad[0xD] = false; break;
-
-                    case SDLK_a: chip8->keypad[0x7] = false; break;
-                    case SDLK_s: chip8->keypad[0x8] = false; break;
-                    case SDLK_d: chip8->keypad[0x9] = false; break;
-                    case SDLK_f: chip8->keypad[0xE] = false; break;
-
-                    case SDLK_z: chip8->keypad[0xA] = false; break;
-                    case SDLK_x: chip8->keypad[0x0] = false; break;
-                    case SDLK_c: chip8->keypad[0xB] = false; break;
-                    case SDLK_v: chip8->keypad[0xF] = false; break;
-
-                    default: break;
-                }
-                break;
-            case SDL_KEYDOWN:
-                switch(event.key.keysym.sym) {
-                    case SDLK_ESCAPE:
-                        //escape key, Exit window & End program
-                        chip8->state = QUIT; 
-                        break;
-                    case SDLK_SPACE: 
-                        if (chip8->state == RUNNING) {
-                            chip8->state = PAUSED;   // Pause
-                            puts("=====PAUSED=====");
-                        }
-                        else {
-                            chip8->state = RUNNING; // Resume
-                            
-                        }
-                        break;
-
-                    case SDLK_EQUALS:
-                        // '=': Reset CHIP8 machine for the current ROM
-                        init_chip8(chip8, config, chip8->rom_name);
-                        break;
-
-                    case SDLK_j:
-                        // 'j': Decrease color lerp rate
-                        if (config->color_lerp_rate > 0.1)
-                            config->color_lerp_rate -= 0.1;
-                        break;
-
-                    case SDLK_k:
-                        // 'k': Increase color lerp rate
-                        if (config->color_lerp_rate < 1.0)
-                            config->color_lerp_rate += 0.1;
-                        break;
-
-                    case SDLK_o:
-                        // 'o': Decrease Volume
-                        if (config->volume > 0)
-                            config->volume -= 500;
-                        break;
-
-                    case SDLK_p:
-                        // 'p': Increase Volume
-                        if (config->volume < INT16_MAX)
-                            config->volume += 500;
-                        break;
-
-                    //Map QWERTY keys to CHIP8 keypad
-                    case SDLK_1: chip8->keypad[0x1] = true; break;
-                    case SDLK_2: chip8->keypad[0x2] = true; break;
-                    case SDLK_3: chip8->keypad[0x3] = true; break;
-                    case SDLK_4: chip8->keypad[0xC] = true; break;
-
-                    case SDLK_q: chip8->keypad[0x4] = true; break;
-                    case SDLK_w: chip8->keypad[0x5] = true; break;
-                    case SDLK_e: chip8->keypad[0x6] = true; break;
-                    case SDLK_r: chip8->keypad[0xD] = true; break;
-
-                    case SDLK_a: chip8->keypad[0x7] = true; break;
-                    case SDLK_s: chip8->keypad[0x8] = true; break;
-                    case SDLK_d: chip8->keypad[0x9] = true; break;
-                    case SDLK_f: chip8->keypad[0xE] = true; break;
-
-                    case SDLK_z: chip8->keypad[0xA] = true; break;
-                    case SDLK_x: chip8->keypad[0x0] = true; break;
-                    case SDLK_c: chip8->keypad[0xB] = true; break;
-                    case SDLK_v: chip8->keypad[0xF] = true; break;
-                    
-                    default: break;
-                }
-                break;
-            default:
-                break;
-        }
+static const SDL_Keycode keymap[16] = {
+    [0x1] = SDLK_1, [0x2] = SDLK_2, [0x3] = SDLK_3, [0xC] = SDLK_4,
+    [0x4] = SDLK_q, [0x5] = SDLK_w, [0x6] = SDLK_e, [0xD] = SDLK_r,
+    [0x7] = SDLK_a, [0x8] = SDLK_s, [0x9] = SDLK_d, [0xE] = SDLK_f,
+    [0xA] = SDLK_z, [0x0] = SDLK_x, [0xB] = SDLK_c, [0xF] = SDLK_v,
+};
+
+// CHIP8 key of a keyboard key, -1 if it isn't on the keypad
+int keypad_key(SDL_Keycode sym) {
+    for (int key = 0; key < 16; key++) {
+        if (keymap[key] == sym) return key;
     }
+    return -1;
 }
 
-
-
-#ifdef DEBUG
-void print_debug_info(chip8_t* chip8) {
-    printf("Address: 0x%04X, Opcode: 0x%04X Description: ", chip8->PC - 2, chip8->inst.opcode);
-
-    switch ((chip8->inst.opcode >> 12) & 0x0F) {
-        case 0x00:
-            if (chip8->inst.NN == 0xE0) {
-                //0x00E0: Clear the screen 
-                printf("Clear screen\n");
-            } else if (chip8->inst.NN == 0xEE) {
-                //0x00EE: Return from subroutine 
-                //Set program counter to last address on subroutine stack ("pop" it off the stack)
-                printf("Return from subroutine to address 0x%04X\n", *(chip8->stack_ptr - 1));
-            } else {
-                printf("Umimplemented Opcode.\n");
-            }
-            break;
-
-        case 0x01:
-            //0x1NNN: Jumps to address NNN
-            printf("Jumps to address NNN (0x%04X)\n", chip8->inst.NNN);
+// Handle one user input event
+void process_event(config_t *config, sdl_t *sdl, emulator_t *emulator, const SDL_Event *event) {
+    switch (event->type) {
+        case SDL_QUIT:
+            atomic_store(&emulator->quit, true);
             break;
-        
-        case 0x02:
-            //0x2NNN: Call subroutine at NNN   (like jump register in MIPS: jumps to next instructions)
-            //Store current address to return to on subroutine stack 
-            //  and set program counter to subroutine address so that 
-            //  the next opcode is gotten from there
-            printf("Call subroutine at NNN (0x%04X)\n",
-                   chip8->inst.NNN);
+        case SDL_WINDOWEVENT:
+            // Window shown, exposed, resized...: present the whole screen again
+            sdl->fading_rows = CHIP8_ALL_ROWS;
             break;
-
-        case 0x03:
-            // 0x3XNN: Check if VX == NN, if so, skip the next instruction
-            printf("Check if V%X (0x%02X) == NN (0x%02X), skip next instruction if true\n",
-                   chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.NN);
-            break;
-
-        case 0x04:
-            // 0x4XNN: Check if VX != NN, if so, skip the next instruction
-            printf("Check if V%X (0x%02X) != NN (0x%02X), skip next instruction if true\n",
-                   chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.NN);
-            break;
-
-        case 0x05:
-            // 0x5XY0: Check if VX == VY, if so, skip the next instruction
-            printf("Check if V%X (0x%02X) == V%X (0x%02X), skip next instruction if true\n",
-                   chip8->inst.X, chip8->V[chip8->inst.X], 
-                   chip8->inst.Y, chip8->V[chip8->inst.Y]);
-            break;
-
-        case 0x06:
-            //0x6XNN: Set register VX to NN.
-            printf("Set register V%X to NN (0x%02X)\n", 
-            chip8->inst.X, chip8->inst.NN);
-            break;
-
-        case 0x07:
-            // 0x7XNN: Set register VX += NN
-            printf("Set register V%X (0x%02X) += NN (0x%02X). Result: 0x%02X\n",
-                   chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.NN,
-                   chip8->V[chip8->inst.X] + chip8->inst.NN);
+        case SDL_KEYUP: {
+            const int key = keypad_key(event->key.keysym.sym);
+            if (key >= 0) {
+                push_input(&emulator->input, (input_event_t){INPUT_KEY_UP, key});
+            } else if (event->key.keysym.sym == SDLK_BACKSPACE) {
+                push_input(&emulator->input, (input_event_t){INPUT_REWIND, 0});
+            }
             break;
-
-        case 0x08:
-            switch(chip8->inst.N) {
-                case 0:
-                    // 0x8XY0: Set register VX = VY
-                    printf("Set register V%X = V%X (0x%02X)\n",
-                           chip8->inst.X, chip8->inst.Y, chip8->V[chip8->inst.Y]);
-                    break;
-
-                case 1:
-                    // 0x8XY1: Set register VX |= VY
-                    printf("Set register V%X (0x%02X) |= V%X (0x%02X); Result: 0x%02X\n",
-                           chip8->inst.X, chip8->V[chip8->inst.X],
-                           chip8->inst.Y, chip8->V[chip8->inst.Y],
-                           chip8->V[chip8->inst.X] | chip8->V[chip8->inst.Y]);
-                    break;
-
-                case 2:
-                    // 0x8XY2: Set register VX &= VY
-                    printf("Set register V%X (0x%02X) &= V%X (0x%02X); Result: 0x%02X\n",
-                           chip8->inst.X, chip8->V[chip8->inst.X],
-                           chip8->inst.Y, chip8->V[chip8->inst.Y],
-                           chip8->V[chip8->inst.X] & chip8->V[chip8->inst.Y]);
-                    break;
-
-                case 3:
-                    // 0x8XY3: Set register VX ^= VY
-                    printf("Set register V%X (0x%02X) ^= V%X (0x%02X); Result: 0x%02X\n",
-                           chip8->inst.X, chip8->V[chip8->inst.X],
-                           chip8->inst.Y, chip8->V[chip8->inst.Y],
-                           chip8->V[chip8->inst.X] ^ chip8->V[chip8->inst.Y]);
-                    break;
-
-                case 4:
-                    // 0x8XY4: Set register VX += VY, set VF to 1 if carry
-                    printf("Set register V%X (0x%02X) += V%X (0x%02X), VF = 1 if carry; Result: 0x%02X, VF = %X\n",
-                           chip8->inst.X, chip8->V[chip8->inst.X],
-                           chip8->inst.Y, chip8->V[chip8->inst.Y],
-                           chip8->V[chip8->inst.X] + chip8->V[chip8->inst.Y],
-                           ((uint16_t)(chip8->V[chip8->inst.X] + chip8->V[chip8->inst.Y]) > 255));
-                    break;
-
-                case 5:
-                    // 0x8XY5: Set register VX -= VY, set VF to 1 if there is not a borrow (result is positive/0)
-                    printf("Set register V%X (0x%02X) -= V%X (0x%02X), VF = 1 if no borrow; Result: 0x%02X, VF = %X\n",
-                           chip8->inst.X, chip8->V[chip8->inst.X],
-                           chip8->inst.Y, chip8->V[chip8->inst.Y],
-                           chip8->V[chip8->inst.X] - chip8->V[chip8->inst.Y],
-                           (chip8->V[chip8->inst.Y] <= chip8->V[chip8->inst.X]));
-                    break;
-
-                case 6:
-                    // 0x8XY6: Set register VX >>= 1, store shifted off bit in VF
-                    printf("Set register V%X (0x%02X) >>= 1, VF = shifted off bit (%X); Result: 0x%02X\n",
-                           chip8->inst.X, chip8->V[chip8->inst.X],
-                           chip8->V[chip8->inst.X] & 1,
-                           chip8->V[chip8->inst.X] >> 1);
-                    break;
-
-                case 7:
-                    // 0x8XY7: Set register VX = VY - VX, set VF to 1 if there is not a borrow (result is positive/0)
-                    printf("Set register V%X = V%X (0x%02X) - V%X (0x%02X), VF = 1 if no borrow; Result: 0x%02X, VF = %X\n",
-                           chip8->inst.X, chip8->inst.Y, chip8->V[chip8->inst.Y],
-                           chip8->inst.X, chip8->V[chip8->inst.X],
-                           chip8->V[chip8->inst.Y] - chip8->V[chip8->inst.X],
-                           (chip8->V[chip8->inst.X] <= chip8->V[chip8->inst.Y]));
-                    break;
-
-                case 0xE:
-                    // 0x8XYE: Set register VX <<= 1, store shifted off bit in VF
-                    printf("Set register V%X (0x%02X) <<= 1, VF = shifted off bit (%X); Result: 0x%02X\n",
-                           chip8->inst.X, chip8->V[chip8->inst.X],
-                           (chip8->V[chip8->inst.X] & 0x80) >> 7,
-                           chip8->V[chip8->inst.X] << 1);
+        }
+        case SDL_KEYDOWN:
+            switch (event->key.keysym.sym) {
+                case SDLK_ESCAPE:
+                    //escape key, Exit window & End program
+                    atomic_store(&emulator->quit, true);
                     break;
-
-                default:
-                    // Wrong/unimplemented opcode
+                case SDLK_SPACE: 
+                    // Pause/resume
+                    push_input(&emulator->input, (input_event_t){.type = INPUT_PAUSE});
                     break;
-            }
-            break;
-
-        case 0x09:
-            // 0x9XY0: Check if VX != VY; Skip next instruction if so
-            printf("Check if V%X (0x%02X) != V%X (0x%02X), skip next instruction if true\n",
-                   chip8->inst.X, chip8->V[chip8->inst.X], 
-                   chip8->inst.Y, chip8->V[chip8->inst.Y]);
-            break;
 
-        case 0x0A:
-            // 0xANNN: Set index register I to NNN
-            printf("Set I to NNN (0x%04X)\n",
-                   chip8->inst.NNN);
-            break;
-
-        case 0x0B:
-            // 0xBNNN: Jump to V0 + NNN
-            printf("Set PC to V0 (0x%02X) + NNN (0x%04X); Result PC = 0x%04X\n",
-                   chip8->V[0], chip8->inst.NNN, chip8->V[0] + chip8->inst.NNN);
-            break;
-
-        case 0x0C:
-            // 0xCXNN: Sets register VX = rand() % 256 & NN (bitwise AND)
-            printf("Set V%X = rand() %% 256 & NN (0x%02X)\n",
-                   chip8->inst.X, chip8->inst.NN);
-            break;
-
-
-        case 0x0D:
-            // 0xDXYN: Draw N-height sprite at coords X,Y; Read from memory location I;
-            //   Screen pixels are XOR'd with sprite bits, 
-            //   VF (Carry flag) is set if any screen pixels are set off; This is useful
-            //   for collision detection or other reasons.
-            printf("Draw N (%u) height sprite at coords V%X (0x%02X), V%X (0x%02X) "
-                   "from memory location I (0x%04X). Set VF = 1 if any pixels are turned off.\n",
-                   chip8->inst.N, chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.Y,
-                   chip8->V[chip8->inst.Y], chip8->I);
-            break;
-
-        case 0x0E:
-            if (chip8->inst.NN == 0x9E) {
-                // 0xEX9E: Skip next instruction if key in VX is pressed
-                printf("Skip next instruction if key in V%X (0x%02X) is pressed; Keypad value: %d\n",
-                       chip8->inst.X, chip8->V[chip8->inst.X], chip8->keypad[chip8->V[chip8->inst.X]]);
-
-            } else if (chip8->inst.NN == 0xA1) {
-                // 0xEX9E: Skip next instruction if key in VX is not pressed
-                printf("Skip next instruction if key in V%X (0x%02X) is not pressed; Keypad value: %d\n",
-                       chip8->inst.X, chip8->V[chip8->inst.X], chip8->keypad[chip8->V[chip8->inst.X]]);
-            }
-            break;
-
-        case 0x0F:
-            switch (chip8->inst.NN) {
-                case 0x0A:
-                    // 0xFX0A: VX = get_key(); Await until a keypress, and store in VX
-                    printf("Await until a key is pressed; Store key in V%X\n",
-                           chip8->inst.X);
+                case SDLK_EQUALS:
+                    // '=': Reset CHIP8 machine for the current ROM (already in memory)
+                    push_input(&emulator->input, (input_event_t){.type = INPUT_RESET});
                     break;
 
-                case 0x1E:
-                    // 0xFX1E: I += VX; Add VX to register I. For non-Amiga CHIP8, does not affect VF
-                    printf("I (0x%04X) += V%X (0x%02X); Result (I): 0x%04X\n",
-                           chip8->I, chip8->inst.X, chip8->V[chip8->inst.X],
-                           chip8->I + chip8->V[chip8->inst.X]);
+                case SDLK_BACKSPACE:
+                    // Backspace (held): Rewind
+                    push_input(&emulator->input, (input_event_t){INPUT_REWIND, 1});
                     break;
 
-                case 0x07:
-                    // 0xFX07: VX = delay timer
-                    printf("Set V%X = delay timer value (0x%02X)\n",
-                           chip8->inst.X, chip8->delay_timer);
+                // F1-F4: Save state to slot 1-4, F5-F8: Load state from slot 1-4
+                case SDLK_F1: case SDLK_F2: case SDLK_F3: case SDLK_F4:
+                    push_input(&emulator->input, (input_event_t){INPUT_SAVE_STATE, event->key.keysym.sym - SDLK_F1});
                     break;
-
-                case 0x15:
-                    // 0xFX15: delay timer = VX 
-                    printf("Set delay timer value = V%X (0x%02X)\n",
-                           chip8->inst.X, chip8->V[chip8->inst.X]);
+                case SDLK_F5: case SDLK_F6: case SDLK_F7: case SDLK_F8:
+                    push_input(&emulator->input, (input_event_t){INPUT_LOAD_STATE, event->key.keysym.sym - SDLK_F5});
                     break;
 
-                case 0x18:
-                    // 0xFX18: sound timer = VX 
-                    printf("Set sound timer value = V%X (0x%02X)\n",
-                           chip8->inst.X, chip8->V[chip8->inst.X]);
+                case SDLK_F9:
+                    // F9: Print the guest profile so far and write its CSV (--profile)
+                    push_input(&emulator->input, (input_event_t){.type = INPUT_PROFILE});
                     break;
 
-                case 0x29:
-                    // 0xFX29: Set register I to sprite location in memory for character in VX (0x0-0xF)
-                    printf("Set I to sprite location in memory for character in V%X (0x%02X). Result(VX*5) = (0x%02X)\n",
-                           chip8->inst.X, chip8->V[chip8->inst.X], chip8->V[chip8->inst.X] * 5);
+                case SDLK_j:
+                    // 'j': Decrease color lerp rate
+                    if (config->color_lerp_rate > 0.1)
+                        config->color_lerp_rate -= 0.1;
                     break;
 
-                case 0x33:
-                    // 0xFX33: Store BCD representation of VX at memory offset from I;
-                    //   I = hundred's place, I+1 = ten's place, I+2 = one's place
-                    printf("Store BCD representation of V%X (0x%02X) at memory from I (0x%04X)\n",
-                           chip8->inst.X, chip8->V[chip8->inst.X], chip8->I);
+                case SDLK_k:
+                    // 'k': Increase color lerp rate
+                    if (config->color_lerp_rate < 1.0)
+                        config->color_lerp_rate += 0.1;
                     break;
 
-                case 0x55:
-                    // 0xFX55: Register dump V0-VX inclusive to memory offset from I;
-                    //   SCHIP does not inrement I, CHIP8 does increment I
-                    printf("Register dump V0-V%X (0x%02X) inclusive at memory from I (0x%04X)\n",
-                           chip8->inst.X, chip8->V[chip8->inst.X], chip8->I);
+                case SDLK_o:
+                    // 'o': Decrease Volume
+                    if (config->volume > 0)
+                        config->volume -= 500;
+                    atomic_store(&sdl->audio->volume, config->volume);
                     break;
 
-                case 0x65:
-                    // 0xFX65: Register load V0-VX inclusive from memory offset from I;
-                    //   SCHIP does not inrement I, CHIP8 does increment I
-                    printf("Register load V0-V%X (0x%02X) inclusive at memory from I (0x%04X)\n",
-                           chip8->inst.X, chip8->V[chip8->inst.X], chip8->I);
+                case SDLK_p:
+                    // 'p': Increase Volume
+                    if (config->volume < INT16_MAX - 500)
+                        config->volume += 500;
+                    atomic_store(&sdl->audio->volume, config->volume);
                     break;
 
-                default:
+                default: {
+                    // Map QWERTY keys to CHIP8 keypad
+                    const int key = keypad_key(event->key.keysym.sym);
+                    if (key >= 0) push_input(&emulator->input, (input_event_t){INPUT_KEY_DOWN, key});
                     break;
+                }
             }
             break;
-
         default:
-            printf("Umimplemented Opcode.\n");
             break;
     }
 }
-#endif
-
-void emulate_instruction(chip8_t* chip8, config_t config) {
-    //Get next opcode from RAM
-    bool carry;
-    chip8->inst.opcode = (chip8->ram[chip8->PC] << 8) | (chip8->ram[chip8->PC + 1]);
-    chip8->PC += 2;
-
-    //Fill out current instruction format
-    chip8->inst.NNN = chip8->inst.opcode & 0x0FFF;
-    chip8->inst.NN = chip8->inst.opcode & 0x0FF;
-    chip8->inst.N = chip8->inst.opcode & 0x0F;
-    chip8->inst.X = (chip8->inst.opcode >> 8) & 0x0F;
-    chip8->inst.Y = (chip8->inst.opcode >> 4) & 0x0F;
-
-#ifdef DEBUG
-    print_debug_info(chip8);
-#endif
-
-    switch ((chip8->inst.opcode >> 12) & 0x0F) {
-        case 0x00:
-            if (chip8->inst.NN == 0xE0) {
-                //0x00E0: Clear the screen 
-                memset(&chip8->display[0], false, sizeof chip8->display);
-                chip8->draw = true;         // Will update screen on next 60hz tick
-            } else if (chip8->inst.NN == 0xEE) {
-                //0x00EE: Return from subroutine 
-                //Set program counter to last address on subroutine stack ("pop" it off the stack)
-                chip8->PC = *--chip8->stack_ptr;  //pre-decrement to the previous instruction (jumps back to the previous instruction)
-            } else {
-                printf("Umimplemented/Invalid Opcode, may be 0xNNN for calling machine code routine for RCA1802.\n");
-            }
-            break;
 
-        case 0x01:
-            //0x1NNN: Jumps to address NNN
-            chip8->PC = chip8->inst.NNN; // Set the program counter so that the next opcode is from NNN
-            break;
-
-        case 0x02:
-            //0x2NNN: Call subroutine at NNN   (like jump register in MIPS: jumps to next instructions)
-            //Store current address to return to on subroutine stack 
-            //  and set program counter to subroutine address so that 
-            //  the next opcode is gotten from there
-            *chip8->stack_ptr++ = chip8->PC;   //post increment, the current stack_ptr will store the current instruction and then move on to the next slot on the stack
-            chip8->PC = chip8->inst.NNN;   //jumps to the next instruction
-            break;
-
-        case 0x03:
-            // 0x3XNN: Check if VX == NN, if so, skip the next instruction
-            if (chip8->V[chip8->inst.X] == chip8->inst.NN) {
-                chip8->PC += 2;
-            }
-            break;
 
-        case 0x04:
-            // 0x4XNN: Check if VX != NN, if so, skip the next instruction
-            if (chip8->V[chip8->inst.X] != chip8->inst.NN) {
-                chip8->PC += 2;
-            }
-            break;
-            
-        case 0x05:
-            // 0x5XNN: Check if VX != NN, if so, skip the next instruction
-            if (chip8->inst.N != 0) break; // Wrong opcode
 
-            if (chip8->V[chip8->inst.X] == chip8->V[chip8->inst.Y]) {
-                chip8->PC += 2;
-            }
-            break;
+// Save state file of a hotkey slot: <rom>.<slot 1-4>.state
+void state_path(char *path, size_t size, const emulator_t *emulator, uint8_t slot) {
+    snprintf(path, size, "%s.%u.state", emulator->rom->name, slot + 1);
+}
 
-        case 0x06:
-            //0x6XNN: Set register VX to NN.
-            chip8->V[chip8->inst.X] = chip8->inst.NN;
-            break;
+// Print the profile report and write its CSV
+void dump_profile(const emulator_t *emulator) {
+    chip8_profile_report(emulator->profile, &emulator->chip8, 16);
+    if (chip8_profile_write_csv(emulator->profile, emulator->config->profile)) {
+        printf("Profile written to %s\n", emulator->config->profile);
+    }
+}
 
-        case 0x07:
-            //0x7XNN: Set register VX += NN.
-            chip8->V[chip8->inst.X] += chip8->inst.NN;
-            break;
+// Apply the events the SDL thread queued up before frame number frame
+void handle_input(emulator_t *emulator, uint64_t frame) {
+    chip8_t *chip8 = &emulator->chip8;
+    input_event_t event;
+
+    while (pop_input(&emulator->input, &event)) {
+        // A recording only replays from a fresh start with no jumps in between
+        if (emulator->config->record && (event.type == INPUT_RESET || event.type == INPUT_LOAD_STATE ||
+                                         (event.type == INPUT_REWIND && event.key))) {
+            puts("Reset, state loads and rewind are off while recording");
+            continue;
+        }
 
-        case 0x08:
-            //0x8XNN: 
-            if (chip8->inst.N == 0) {
-                // 0x8XY0 Sets VX to the value of VY.
-                chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y];
-            } else if (chip8->inst.N == 1) {
-                // 0x8XY1 Sets VX to VX or VY. (bitwise OR operation)
-                chip8->V[chip8->inst.X] |= chip8->V[chip8->inst.Y];
-                chip8->V[0xF] = 0;
-            } else if (chip8->inst.N == 2) {
-                // 0x8XY2 Sets VX to VX and VY. (bitwise AND operation)
-                chip8->V[chip8->inst.X] &= chip8->V[chip8->inst.Y];
-                chip8->V[0xF] = 0;
-            } else if (chip8->inst.N == 3) {
-                // 0x8XY3 Sets VX to VX xor VY
-                chip8->V[chip8->inst.X] ^= chip8->V[chip8->inst.Y];
-                chip8->V[0xF] = 0;
-            } else if (chip8->inst.N == 4) {
-                // 0x8XY4 Adds VY to VX. VF is set to 1 when there's an overflow, and to 0 when there is not
-                //printf("Chip8 VX value is %u, ");
-                uint8_t orig_X = chip8->V[chip8->inst.X];
-                chip8->V[chip8->inst.X] += chip8->V[chip8->inst.Y];
-                if (orig_X > chip8->V[chip8->inst.X]) { //overflow
-                    chip8->V[0xF] = 1;
-                } else {
-                    chip8->V[0xF] = 0;
-                }
-                printf("VX: 0x%X \n", chip8->inst.X);
-            } else if (chip8->inst.N == 5) {
-                // 0x8XY5 VY is subtracted from VX. VF is set to 0 when there's an underflow, and 1 when there is not. (i.e. VF set to 1 if VX >= VY and 0 if not)
-                if (chip8->V[chip8->inst.X] >= chip8->V[chip8->inst.Y]) {
-                    chip8->V[chip8->inst.X] -= chip8->V[chip8->inst.Y];
-                    chip8->V[0xF] = 1;
-                } else {
-                    chip8->V[chip8->inst.X] -= chip8->V[chip8->inst.Y];  //the order has to be before the chip8->V[0xF] = 0;
-                    chip8->V[0xF] = 0;
+        switch (event.type) {
+            case INPUT_KEY_DOWN:
+            case INPUT_KEY_UP: {
+                const bool down = event.type == INPUT_KEY_DOWN;
+                if (emulator->config->record && chip8->keypad[event.key] != down) {
+                    chip8_input_log_key(&emulator->log, frame, event.key, down);
                 }
-            } else if (chip8->inst.N == 6) {
-                // 0x8XY6 Stores the least significant bit of VX in VF and then shifts VX to the right by 1
-                carry = chip8->V[chip8->inst.Y] & 0x01;
-                chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y] >> 1;
-                chip8->V[0xF] = carry;
-            } else if (chip8->inst.N == 7) {
-                // 0x8XY7 Sets VX to VY minus VX. VF is set to 0 when there's an underflow, and 1 when there is not. (i.e. VF set to 1 if VY >= VX)
-                if (chip8->V[chip8->inst.Y] >= chip8->V[chip8->inst.X]) {
-                    chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y] - chip8->V[chip8->inst.X];
-                    chip8->V[0xF] = 1;
+                chip8->keypad[event.key] = down;
+                break;
+            }
+
+            case INPUT_PAUSE:
+                if (chip8->state == RUNNING) {
+                    chip8->state = PAUSED;   // Pause
+                    puts("=====PAUSED=====");
                 } else {
-                    chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y] - chip8->V[chip8->inst.X];
-                    chip8->V[0xF] = 0;
+                    chip8->state = RUNNING; // Resume
                 }
-            } else if (chip8->inst.N == 0xE) {
-                // 0x8XYE Sets VX to VY minus VX. VF is set to 0 when there's an underflow, and 1 when there is not. (i.e. VF set to 1 if VY >= VX)
-                carry = chip8->V[chip8->inst.Y] >> 7; 
-                chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y] << 1;
-                chip8->V[0xF] = carry;
-            } else {
-                printf("Umimplemented/Invalid Opcode for 0x08.\n");
-            }
-            break;
+                break;
 
-        case 0x09:
-            //0x9XY0: Skips the next instruction if VX does not equal VY. (Usually the next instruction is a jump to skip a code block)
-            if (chip8->inst.N != 0) break; // Wrong opcode
+            case INPUT_RESET:
+                // Reset CHIP8 machine for the current ROM (already in memory)
+                chip8_init(chip8, emulator->rom->data, emulator->rom->size);
+                chip8_set_backend(chip8, emulator->config->backend, emulator->jit);  // Keep the recompiler's code arena
+                chip8_set_quirks(chip8, emulator->config->quirks);
+                if (emulator->rom->mapped) chip8_apply_map(chip8, &emulator->rom->map);
+                chip8_seed(chip8, time(NULL));
+                chip8_set_profile(chip8, emulator->profile);    // Counting goes on across resets
+                chip8_set_trace(chip8, emulator->trace);
+                break;
 
-            if (chip8->V[chip8->inst.X] != chip8->V[chip8->inst.Y]) {
-                chip8->PC += 2;
+            case INPUT_SAVE_STATE: {
+                char path[FILENAME_MAX];
+                state_path(path, sizeof path, emulator, event.key);
+                chip8_save_state(chip8, &emulator->slots[event.key]);
+                emulator->slot_saved[event.key] = true;
+                printf("Saved state %u\n", event.key + 1);
+                chip8_save_state_file(chip8, path);     // Keep it for the next run too
+                break;
             }
-            break;
-
-        case 0x0A:
-            //0xANNN: Set index register I to NNN
-            chip8->I = chip8->inst.NNN;
-            break;
-
-        case 0x0B:
-            //0xBNNN: Jumps to the address NNN plus V0
-            chip8->PC = chip8->inst.NNN + chip8->V[0];
-            break;
 
-        case 0x0C:
-            //0xBNNN: Sets VX to the result of a bitwise and operation on a random number (Typically: 0 to 255) and NN.[
-            chip8->V[chip8->inst.X] = (rand() % 256) & chip8->inst.NN;
-            break;
-        
-        case 0x0D: { //The reason we need a {} here because all cases share the same scope. It is valid to declare a variable at the start of the block before any executabel statement.   
-            //In C, variable declarations must appear before any executable statements within the same block. 
-            //  However, this rule applies to inner blocks, such as those within functions, if statements, loops, and switch cases, but not necessarily to the top-level block of a function. At the top level of a function, you can mix declarations and executable statements.
-            
-            //0xDXYN: Draw N-height sprite at coordinate X, Y. Read from memory location I;
-            //  The sprite has a width of 8 pixels and a height of N pixels;
-            //  Screen pixels are XOR'd with sprite bits 
-            //  VF(Carry Flag) is set if any screen pixels are set off; This is useful 
-            //  for collision detection
-            uint8_t X_coord = (chip8->V[chip8->inst.X] % config.window_width);
-            uint8_t Y_coord = (chip8->V[chip8->inst.Y] % config.window_height);
-            const uint8_t orig_X = X_coord;
-
-            chip8->V[0xF] = 0; //Initialize carry flag to 0
-            
-            //loop over all N rows of the sprite
-            for (uint8_t i = 0; i < chip8->inst.N; i++) {
-                //Get next Byte/row of sprite data(The combination of pixels to show the pattern on the screen)
-                const uint8_t sprite_data = chip8->ram[chip8->I + i];
-                X_coord = orig_X;
-
-                for (int8_t j = 7; j >= 0; j--) { //The reason we use reversed order is because for each bit in the byte of sprite_data, the most significant bit is the first bit we need to interpret based on the graphical terms
-                    //If sprite pixel/bit is on and display pixel is on, set carry flag 
-                    bool* pixel = &chip8->display[Y_coord * config.window_width + X_coord];
-                    const bool sprite_bit = (sprite_data & (1 << j)); //why bool does not work?
-
-                    if (sprite_bit && *pixel) {  //both are 1->collision based on XOR 
-                        chip8->V[0xF] = 1;
-                    }
-
-                    //XOR display pixel with sprite pixel/bit to set it on or off
-                    *pixel ^= sprite_bit;
-
-                    //stop drawing if hit the right edge of screen
-                    if (++X_coord >= config.window_width) break;
+            case INPUT_LOAD_STATE: {
+                // Keys held right now stay held, whatever was down when the state was saved
+                bool keypad[16];
+                memcpy(keypad, chip8->keypad, sizeof keypad);
+
+                char path[FILENAME_MAX];
+                state_path(path, sizeof path, emulator, event.key);
+                const bool loaded = emulator->slot_saved[event.key]
+                                  ? chip8_load_state(chip8, &emulator->slots[event.key])
+                                  : chip8_load_state_file(chip8, path, 0);
+                if (loaded) {
+                    memcpy(chip8->keypad, keypad, sizeof keypad);
+                    printf("Loaded state %u\n", event.key + 1);
                 }
-
-                //Stop drawing entire sprite if hit bottom edge of screen
-                if (++Y_coord >= config.window_height) break;
+                break;
             }
-            chip8->draw = true;         // Will update screen on next 60hz tick
-            break;
+
+            case INPUT_REWIND:
+                emulator->rewinding = event.key && emulator->rewind != NULL;
+                break;
+
+            case INPUT_PROFILE:
+                if (emulator->profile) dump_profile(emulator);
+                break;
         }
+    }
+}
 
-        case 0x0E:
-            if (chip8->inst.NN == 0x9E) {
-                //Skips the next instruction if the key stored in VX is pressed
-                if (chip8->keypad[chip8->V[chip8->inst.X]]) {
-                    chip8->PC += 2;
-                }
-            } else if (chip8->inst.NN == 0xA1) {
-                //Skips the next instruction if the key stored in VX is pressed
-                if (!chip8->keypad[chip8->V[chip8->inst.X]]) {
-                    chip8->PC += 2;
-                }
-            } else {
-                printf("error code for 0x0E\n");
-            }
-            break;
+// Step back one frame (rewind key held), keeping the keys held right now
+void rewind_frame(emulator_t *emulator) {
+    chip8_t *chip8 = &emulator->chip8;
+    bool keypad[16];
+    memcpy(keypad, chip8->keypad, sizeof keypad);
+    if (chip8_rewind_step_back(emulator->rewind, chip8)) memcpy(chip8->keypad, keypad, sizeof keypad);
+}
 
-        case 0x0F:
-            switch (chip8->inst.NN) {
-                case 0x0A: {
-                    static bool any_key_pressed = false;   
-                    static uint8_t pressed_key = 0xFF;
-                    for (uint8_t i = 0; i < sizeof chip8->keypad; i++) {
-                        if (chip8->keypad[i]) {
-                            pressed_key = i;
-                            any_key_pressed = true;
-                            break;
-                        }
-                    }
-
-                    // if (!any_key_pressed) {
-                    //     chip8->PC -= 2;
-                    // } else {
-                    //     if (chip8->keypad[pressed_key]) {
-                    //         chip8->PC -= 2;
-                    //     } else {
-                    //         chip8->V[chip8->inst.X] = pressed_key;
-                    //         pressed_key = 0xFF;
-                    //         any_key_pressed = false;
-                    //     }
-                    // }
-                    if (any_key_pressed && !chip8->keypad[pressed_key]) {
-                            chip8->V[chip8->inst.X] = pressed_key;
-                            pressed_key = 0xFF;
-                            any_key_pressed = false;
-                    } else {
-                        chip8->PC -= 2;
-                    }
-                    break;
-                }
-                case 0x1E:
-                    chip8->I += chip8->V[chip8->inst.X];
-                    break;
+#define MAX_CATCH_UP 5          // Late frames run back to back before the schedule is reset
+#define TURBO_PUBLISH_HZ 60     // Turbo: frames published (and input handled) per real second
+#define FADE_REDRAW_MS 20       // SDL thread: redraw of the last frame while it fades and no new one comes
+#define IDLE_WAIT_MS 500        // SDL thread: longest sleep waiting for events
 
-                case 0x07:
-                    // 0xFX07: VX = delay timer
-                    chip8->V[chip8->inst.X] = chip8->delay_timer;
-                    break;
+// Emulation pacing: every emulated 60hz frame has a fixed performance counter deadline,
+//   so time spent elsewhere (publishing, preemption, rounding) never accumulates as drift,
+//   and insts_per_second / 60 is kept with its fraction so the clock rate is exact.
+typedef struct {
+    double frames_per_second;   // Emulated frames per real second (speed applied)
+    uint64_t period;            // Performance counter ticks per emulated frame
+    uint64_t next_frame;        // Deadline of the next emulated frame
+    uint32_t insts_per_second;  // Frame budgets are chip8_frame_insts of this
+    uint64_t frames;            // Emulated frames & instructions run, for the exit report
+    uint64_t insts;
+} scheduler_t;
+
+void init_scheduler(scheduler_t *scheduler, const config_t *config) {
+    *scheduler = (scheduler_t){
+        .frames_per_second = 60.0 * config->speed,
+        .period = SDL_GetPerformanceFrequency() / (60.0 * config->speed),
+        .next_frame = SDL_GetPerformanceCounter(),
+        .insts_per_second = config->insts_per_second,
+    };
+}
 
-                case 0x15:
-                    // 0xFX15: delay timer = VX
-                    chip8->delay_timer = chip8->V[chip8->inst.X];
-                    break;
+// Instructions for the next frame
+uint32_t frame_insts(const scheduler_t *scheduler) {
+    return chip8_frame_insts(scheduler->insts_per_second, scheduler->frames);
+}
 
-                case 0x18:
-                    // 0xFX18: sound timer = VX
-                   chip8->sound_timer =  chip8->V[chip8->inst.X];
-                    break;
+// Sleep until the performance counter reaches deadline, in whole milliseconds rounded
+//   up, so the thread never spins. A frame may start a millisecond or so late; the
+//   scheduler keeps the frame rate, as next_frame advances by the period regardless.
+void wait_until(uint64_t deadline) {
+    const uint64_t frequency = SDL_GetPerformanceFrequency();
 
-                case 0x29:
-                    // 0xFX29: Set register I to sprite location in memory for character in VX (0x0-0xF)
-                    chip8->I = chip8->V[chip8->inst.X] * 5;
-                    break;
+    for (uint64_t now = SDL_GetPerformanceCounter(); now < deadline; now = SDL_GetPerformanceCounter()) {
+        SDL_Delay((uint32_t)(((deadline - now) * 1000 + frequency - 1) / frequency));
+    }
+}
 
-                case 0x33: {
-                    // 0xFX33: Store BCD representation of VX at memory offset from I;
-                    //   I = hundred's place, I+1 = ten's place, I+2 = one's place
-                    uint8_t bcd = chip8->V[chip8->inst.X];
-                    chip8->ram[chip8->I + 2] = bcd % 10;
-                    bcd /= 10;
-                    chip8->ram[chip8->I + 1] = bcd % 10;
-                    bcd /= 10;
-                    chip8->ram[chip8->I] = bcd;
-                    break;
-                }
+// Run the frames that are due by now (after wait_until), at most MAX_CATCH_UP; the original display wait
+//   applies (a DXYN ends the frame's instructions, like the VIP waiting for vblank).
+//   Each frame queues its span of the tone, 1/frames_per_second of real time, with
+//   the tone starting or stopping where in the frame's instructions an FX18 did it.
+void run_throttled(emulator_t *emulator, scheduler_t *scheduler) {
+    chip8_t *chip8 = &emulator->chip8;
+    const uint64_t now = SDL_GetPerformanceCounter();
+    for (uint32_t frames = 0; scheduler->next_frame <= now && frames < MAX_CATCH_UP; frames++) {
+        bool tone_before = false, tone_after = false;
+        double edge = 0.0;
+        if (emulator->rewinding) {
+            rewind_frame(emulator);
+        } else if (chip8->state == RUNNING) {
+            const uint32_t insts = frame_insts(scheduler);
+            tone_before = chip8->sound_timer != 0;
+            scheduler->insts += chip8_run_frame(chip8, insts);
+            tone_after = chip8->sound_on;       // The sound timer before this frame's tick
+            edge = insts ? (double)chip8->sound_edge / insts : 0.0;
+            scheduler->frames++;
+            if (emulator->rewind) chip8_rewind_push(emulator->rewind, chip8);
+        }
+        queue_audio(emulator->audio, tone_before, tone_after, edge,
+                    frame_samples(emulator->audio, scheduler->frames_per_second));
+        scheduler->next_frame += scheduler->period;
+    }
 
-                case 0x55:
-                    for (size_t i = 0; i <= chip8->inst.X; i++) {
-                        chip8->ram[chip8->I + i] = chip8->V[i];
-                    }
-                    chip8->I += chip8->inst.X + 1;
-                    break;
+    // Too far behind (the host stalled): give up on the backlog instead of racing through it
+    if (scheduler->next_frame <= now) scheduler->next_frame = now + scheduler->period;
+}
 
-                case 0x65:
-                    for (size_t i = 0; i <= chip8->inst.X; i++) {
-                        chip8->V[i] = chip8->ram[chip8->I + i];
-                    }
-                    chip8->I += chip8->inst.X + 1;
-                    break;
+// Turbo: run frames back to back for 1/TURBO_PUBLISH_HZ of real time. Instructions run
+//   without display wait; the timers tick once per insts_per_second / 60 instructions.
+//   The tone follows the sound timer as it is at the end of each round. Rewind records
+//   (and steps back) one frame per round.
+void run_turbo(emulator_t *emulator, scheduler_t *scheduler) {
+    chip8_t *chip8 = &emulator->chip8;
+
+    if (chip8->state != RUNNING || emulator->rewinding) {
+        if (emulator->rewinding) rewind_frame(emulator);
+        SDL_Delay(1000 / TURBO_PUBLISH_HZ);
+        queue_audio(emulator->audio, false, false, 0.0, frame_samples(emulator->audio, TURBO_PUBLISH_HZ));
+        return;
+    }
 
-                default: 
-                    break;
-            }
-            break;
+    const uint64_t until = SDL_GetPerformanceCounter() + SDL_GetPerformanceFrequency() / TURBO_PUBLISH_HZ;
+    do {
+        const uint32_t insts = frame_insts(scheduler);
+        for (uint32_t done = 0; done < insts; ) {
+            done += chip8_run(chip8, insts - done);
+        }
+        chip8_update_timers(chip8);
 
-        default:
-            printf("Umimplemented Opcode.\n");
-            break;
+        scheduler->insts += insts;
+        scheduler->frames++;
+    } while (SDL_GetPerformanceCounter() < until);
+    if (emulator->rewind) chip8_rewind_push(emulator->rewind, chip8);
+
+    queue_audio(emulator->audio, chip8->sound_on, chip8->sound_on, 0.0, frame_samples(emulator->audio, TURBO_PUBLISH_HZ));
+}
+
+// Paused: sleep until the SDL thread queues input or quits. Posts for input that was
+//   already handled are used up first, so they don't wake it straight away.
+void sleep_while_paused(emulator_t *emulator) {
+    input_queue_t *queue = &emulator->input;
+    while (SDL_SemTryWait(queue->ready) == 0) {}
+
+    atomic_store(&emulator->audio->idle, true);
+    if (!atomic_load(&emulator->quit) && atomic_load(&queue->head) == atomic_load(&queue->tail)) {
+        SDL_SemWait(queue->ready);
     }
+    atomic_store(&emulator->audio->idle, false);
 }
 
+// Emulation thread: runs the CHIP8 on the scheduler and publishes a frame after every
+//   round. While paused it only wakes up for input; the SDL thread finishes the fade.
+int emulation_thread(void *data) {
+    emulator_t *emulator = data;
+    chip8_t *chip8 = &emulator->chip8;
+    scheduler_t scheduler;
+    init_scheduler(&scheduler, emulator->config);
+    chip8_fault_t fault = CHIP8_FAULT_NONE;    // Last one logged (reset, rewind and loads clear it)
+
+    const uint64_t start = SDL_GetPerformanceCounter();
+    while (!atomic_load(&emulator->quit)) {
+        if (chip8->state == PAUSED && !emulator->rewinding) {
+            sleep_while_paused(emulator);
+            scheduler.next_frame = SDL_GetPerformanceCounter();     // No catching up on the pause
+        } else if (!emulator->config->turbo) {
+            wait_until(scheduler.next_frame);
+        }
+
+        // Input that came in while waiting counts for this frame already
+        handle_input(emulator, scheduler.frames);
 
-void update_timer(sdl_t sdl, chip8_t *chip8) {
-    if (chip8->delay_timer > 0) {
-        chip8->delay_timer--;
+        if (emulator->config->turbo) {
+            run_turbo(emulator, &scheduler);
+        } else {
+            run_throttled(emulator, &scheduler);
+        }
+        if (chip8->fault != fault) {
+            fault = chip8->fault;
+            if (fault) SDL_Log("ROM faulted: %s at 0x%03X, stopped there\n", chip8_fault_name(fault), chip8->PC);
+        }
+
+        if (publish_frame(&emulator->frames, chip8)) {
+            SDL_PushEvent(&(SDL_Event){.type = emulator->frame_event});     // Wake the SDL thread up
+        }
     }
 
-    if (chip8->sound_timer > 0) {
-        chip8->sound_timer--;
-        SDL_PauseAudioDevice(sdl.devID, 0);   //play the sound 
-    } else {
-        SDL_PauseAudioDevice(sdl.devID, 1);   //pause the sound
+    const double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+    SDL_Log("Emulated %llu frames, %llu instructions in %.2f s (%.1f frames/s, %.0f instructions/s)\n",
+            (unsigned long long)scheduler.frames, (unsigned long long)scheduler.insts, seconds,
+            scheduler.frames / seconds, scheduler.insts / seconds);
+    SDL_Log("Fast-forwarded %llu instructions of idle loops since the last reset\n",
+            (unsigned long long)chip8->idle_insts);
+    if (chip8->invalid_insts) {
+        SDL_Log("Ran %llu invalid opcodes as no-ops since the last reset, the last %04X\n",
+                (unsigned long long)chip8->invalid_insts, chip8->invalid_opcode);
+    }
+    for (uint32_t i = 0; i < CHIP8_FUSIONS; i++) {
+        SDL_Log("Fused %s: %llu times since the last reset\n", chip8_fusion_name(i),
+                (unsigned long long)chip8->fusions[i]);
+    }
+    if (emulator->rewind) {
+        SDL_Log("Rewind: %u frames held in %zu KB\n", chip8_rewind_frames(emulator->rewind),
+                chip8_rewind_bytes(emulator->rewind) / 1024);
     }
+    if (emulator->config->record) {
+        chip8_input_log_end(&emulator->log, scheduler.frames, chip8);
+        if (chip8_input_log_save(&emulator->log, emulator->config->record)) {
+            SDL_Log("Recorded %llu frames, %u bytes of input, state hash %016llX to %s\n",
+                    (unsigned long long)scheduler.frames, emulator->log.header.size,
+                    (unsigned long long)emulator->log.header.state_hash, emulator->config->record);
+        }
+        chip8_input_log_free(&emulator->log);
+    }
+    if (emulator->profile) dump_profile(emulator);
+    return 0;
 }
 
 void final_clean_up(sdl_t sdl) {
+    if (sdl.frames_rendered > 0) {
+        SDL_Log("Rendered %u frames, %.3f ms average\n", sdl.frames_rendered,
+                sdl.render_ticks * 1000.0 / SDL_GetPerformanceFrequency() / sdl.frames_rendered);
+    }
+    SDL_Log("Audio: %u underruns (%u samples of silence), %u samples dropped for latency\n",
+            atomic_load(&sdl.audio->underruns), atomic_load(&sdl.audio->missing_samples),
+            atomic_load(&sdl.audio->dropped_samples));
+    if (sdl.outlines) SDL_DestroyTexture(sdl.outlines);
+    if (sdl.screen) SDL_DestroyTexture(sdl.screen);
     SDL_DestroyRenderer(sdl.renderer);
     SDL_DestroyWindow(sdl.window);
     SDL_CloseAudioDevice(sdl.devID);
+    free(sdl.audio);            // The callback is done with it once the device is closed
     SDL_Quit();
 }
 
@@ -1043,53 +1078,96 @@ int main(int argc, char** argv) {
     if (!init_SDL(&sdl, &config)) exit(EXIT_FAILURE);
 
     //Initialized Chip 8 Machine
-    chip8_t chip8 = {0};
-    const char* rom_name = argv[1];
-    if (!init_chip8(&chip8, &config, rom_name)) exit(EXIT_FAILURE);
+    rom_t rom = {.name = argv[1]};
+    emulator_t emulator = {
+        .jit = config.backend == CHIP8_BACKEND_JIT ? chip8_jit_create() : NULL,
+        .audio = sdl.audio,
+        .config = &config,
+        .rom = &rom,
+        .rewind = config.rewind_mb ? chip8_rewind_create((size_t)config.rewind_mb << 20, REWIND_KEYFRAME_INTERVAL) : NULL,
+        .frames = {.back = 0, .middle = 1, .front = 2},
+        .input = {.ready = SDL_CreateSemaphore(0)},
+        .frame_event = SDL_RegisterEvents(1),
+    };
+    if (emulator.input.ready == NULL || emulator.frame_event == (uint32_t)-1) {
+        SDL_Log("Could not set up the emulation thread's wake ups! %s\n", SDL_GetError());
+        exit(EXIT_FAILURE);
+    }
+    if (!init_chip8(&emulator.chip8, &sdl, config, &rom, emulator.jit)) exit(EXIT_FAILURE);
+    if (config.rewind_mb && emulator.rewind == NULL) {
+        SDL_Log("Could not set up a %u MB rewind buffer, rewind is off\n", config.rewind_mb);
+    }
+    if (config.trace) {
+        emulator.trace = chip8_trace_open(config.trace, TRACE_RING_RECORDS, emulator.chip8.quirks);
+        if (emulator.trace == NULL) exit(EXIT_FAILURE);
+        if (!chip8_set_trace(&emulator.chip8, emulator.trace)) {
+            SDL_Log("Built without DEBUG (make debug), not tracing\n");
+        }
+    }
+    if (config.profile) {
+        emulator.profile = calloc(1, sizeof *emulator.profile);
+        if (emulator.profile && !chip8_set_profile(&emulator.chip8, emulator.profile)) {
+            SDL_Log("Built without CHIP8_PROFILE (make profile), not profiling\n");
+            free(emulator.profile);
+            emulator.profile = NULL;
+        }
+    }
 
     clear_screen(sdl, config); // Keep this here if the display should continually update
 
     // Seed random number generator
-    srand(time(NULL)); //different seeds give difference sequence by rand()
-
-    //main emulator loop
-    while (chip8.state != QUIT) {
-        process_events(&config, &chip8);
-        if (chip8.state == PAUSED) continue;
-        //Get_time();
-
-        const u_int64_t star_frame_time = SDL_GetPerformanceCounter();
+    const uint32_t seed = time(NULL);
+    chip8_seed(&emulator.chip8, seed); //different seeds give difference sequence of CXNN values
+    if (config.record) chip8_input_log_start(&emulator.log, rom.data, rom.size, seed, config.insts_per_second);
 
-        //Emulate CHIP8 Instruction
-        for (uint32_t i = 0; i < config.insts_per_second / 60; i++) {
-            emulate_instruction(&chip8, config);
+    SDL_Thread *thread = SDL_CreateThread(emulation_thread, "CHIP8 emulation", &emulator);
+    if (thread == NULL) {
+        SDL_Log("Could not create the emulation thread! %s\n", SDL_GetError());
+        exit(EXIT_FAILURE);
+    }
 
-            // If drawing on CHIP8, only draw 1 sprite this frame (display wait)
-            if (chip8.inst.opcode >> 12 == 0xD)
-                break; 
+    //main loop: sleep until events or a finished frame come in. With no new frames
+    //  (paused), the last one is drawn again every FADE_REDRAW_MS while it still fades.
+    uint32_t last_redraw = SDL_GetTicks();
+    while (!atomic_load(&emulator.quit)) {
+        const uint32_t since_redraw = SDL_GetTicks() - last_redraw;
+        const uint32_t timeout = !sdl.fading_rows ? IDLE_WAIT_MS
+                               : since_redraw < FADE_REDRAW_MS ? FADE_REDRAW_MS - since_redraw : 0;
+        SDL_Event event;
+        if (SDL_WaitEventTimeout(&event, timeout)) {
+            do {
+                process_event(&config, &sdl, &emulator, &event);
+            } while (SDL_PollEvent(&event));
         }
 
-        const u_int64_t end_frame_time = SDL_GetPerformanceCounter();
-
-        const double time_elapsed = (double) (((end_frame_time - star_frame_time) * 1000) / SDL_GetPerformanceFrequency());
-        
-        SDL_Delay(16.67f > time_elapsed ? 16.67f - time_elapsed : 0); // Control frame rate
-
-        
-        // Update window with changes every 60hz
-        if (chip8.draw) {
-            update_screen(sdl, config, &chip8);
+        frame_t *frame = take_frame(&emulator.frames);
+        if (frame == NULL && sdl.fading_rows && SDL_GetTicks() - last_redraw >= FADE_REDRAW_MS) {
+            frame = &emulator.frames.frames[emulator.frames.front];
         }
+        if (frame == NULL) continue;
 
-        // Update delay & sound timers every 60hz
-        update_timer(sdl, &chip8);
+        // Update window with changes every 60hz
+        update_screen(&sdl, config, frame);
+        frame->dirty_rows = 0;      // Drawn; a fade redraw only needs the fading rows
+        last_redraw = SDL_GetTicks();
+    }
+    SDL_SemPost(emulator.input.ready);     // Wake the emulation thread up if it's paused
+    SDL_WaitThread(thread, NULL);
+    SDL_DestroySemaphore(emulator.input.ready);
+    if (emulator.trace) {
+        chip8_set_trace(&emulator.chip8, NULL);
+        SDL_Log("Traced %llu instructions to %s (ring full %llu times)\n",
+                (unsigned long long)chip8_trace_records(emulator.trace), config.trace,
+                (unsigned long long)chip8_trace_stalls(emulator.trace));
+        chip8_trace_close(emulator.trace);
     }
-
 
     //Final clean-up
     final_clean_up(sdl);
+    chip8_jit_destroy(emulator.jit);
+    chip8_rewind_destroy(emulator.rewind);
+    free(emulator.profile);
 
    
     exit(EXIT_SUCCESS);
 }
-
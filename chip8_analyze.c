@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chip8_core.h"
+
+// Offline ROM analyzer: builds a ROM map (chip8_map_build) and prints what it found,
+//   the reachable code as basic blocks with their successors (the control flow graph),
+//   the data the code reads and writes, and whatever stopped the analysis from proving
+//   pages data-only. --map writes the map for the emulator's --map option.
+
+typedef struct {
+    const char *rom_name;
+    const char *map_name;       // Write the map to this file (NULL: don't)
+    chip8_quirks_t quirks;      // Quirk profile the ROM was written for
+    bool quiet;                 // Summary only, no listing
+} analyze_config_t;
+
+bool init_config_from_args(analyze_config_t *config, const int argc, char **argv) {
+    *config = (analyze_config_t){ .quirks = CHIP8_QUIRKS_VIP };
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--map") == 0 && i + 1 < argc) {
+            config->map_name = argv[++i];
+        } else if (strcmp(argv[i], "--quirks") == 0 && i + 1 < argc) {
+            if (!chip8_quirks_from_name(argv[++i], &config->quirks)) {
+                fprintf(stderr, "Unknown quirk profile %s (vip, schip or modern)\n", argv[i]);
+                return false;
+            }
+        } else if (strcmp(argv[i], "--quiet") == 0) {
+            config->quiet = true;
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return false;
+        } else {
+            config->rom_name = argv[i];
+        }
+    }
+    return config->rom_name != NULL;
+}
+
+static uint16_t fetch(const uint8_t *ram, uint32_t pc) {
+    return (ram[pc] << 8) | ram[pc + 1];
+}
+
+// Does the instruction end a basic block (control goes somewhere other than pc + 2)?
+static bool ends_block(uint16_t opcode) {
+    switch (opcode >> 12) {
+        case 0x0: return opcode == 0x00EE;
+        case 0x1: case 0x2: case 0x3: case 0x4: case 0x5: case 0x9: case 0xB: return true;
+        case 0xE: return (opcode & 0xFF) == 0x9E || (opcode & 0xFF) == 0xA1;
+        default: return false;
+    }
+}
+
+// Successors of the block ending with opcode at pc
+static void print_successors(uint16_t opcode, uint32_t pc) {
+    const uint16_t NNN = opcode & 0x0FFF;
+    switch (opcode >> 12) {
+        case 0x0:
+            if (opcode == 0x00EE) {
+                printf("return\n");
+                return;
+            }
+            break;
+        case 0x1: printf("0x%03X\n", NNN); return;
+        case 0x2: printf("0x%03X, returns to 0x%03X\n", NNN, pc + 2); return;
+        case 0xB: printf("indirect (0x%03X + V%X)\n", NNN, (opcode >> 8) & 0x0F); return;
+        default:
+            if (ends_block(opcode)) {
+                printf("0x%03X, 0x%03X\n", pc + 2, pc + 4);
+                return;
+            }
+            break;
+    }
+    printf("0x%03X\n", pc + 2);
+}
+
+// One line per byte class: count, and the address ranges holding it
+static void print_class(const chip8_map_t *map, const char *name, uint8_t kind) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < CHIP8_RAM_SIZE; i++) count += (map->bytes[i] & kind) != 0;
+    printf("%-8s %5u bytes:", name, count);
+    for (uint32_t i = 0; i < CHIP8_RAM_SIZE; ) {
+        if (!(map->bytes[i] & kind)) {
+            i++;
+            continue;
+        }
+        uint32_t end = i;
+        while (end + 1 < CHIP8_RAM_SIZE && (map->bytes[end + 1] & kind)) end++;
+        printf(" 0x%03X-0x%03X", i, end);
+        i = end + 1;
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv) {
+    analyze_config_t config;
+    if (!init_config_from_args(&config, argc, argv)) {
+        fprintf(stderr, "Usage: %s <rom_name> [--quirks vip|schip|modern] [--map FILE] [--quiet]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    static uint8_t rom[CHIP8_MAX_ROM_SIZE];
+    size_t rom_size = 0;
+    if (!chip8_load_rom_file(config.rom_name, rom, sizeof rom, &rom_size)) exit(EXIT_FAILURE);
+
+    static chip8_map_t map;
+    chip8_map_build(&map, rom, rom_size, config.quirks);
+
+    // The ROM as it sits in RAM, for the listing
+    static chip8_t chip8;
+    chip8_init(&chip8, rom, rom_size);
+
+    if (!config.quiet) {
+        // Basic blocks: from each leader to the next leader or block ending instruction
+        for (uint32_t pc = 0; pc + 1 < CHIP8_RAM_SIZE; pc++) {
+            if (!(map.bytes[pc] & CHIP8_MAP_LEADER)) continue;
+
+            printf("block 0x%03X:\n", pc);
+            uint32_t at = pc;
+            for (;;) {
+                const uint16_t opcode = fetch(chip8.ram, at);
+                const uint8_t marks = map.bytes[at] | map.bytes[at + 1];
+                printf("  0x%03X  %04X  %s%s%s\n", at, opcode,
+                       chip8_op_class_name(chip8_op_class(opcode)),
+                       (marks & CHIP8_MAP_STORED) ? "  ; stored into" : "",
+                       (marks & CHIP8_MAP_INDIRECT) ? "  ; indirect jump" : "");
+                if (ends_block(opcode) || at + 3 >= CHIP8_RAM_SIZE ||
+                    !(map.bytes[at + 2] & CHIP8_MAP_INST) || (map.bytes[at + 2] & CHIP8_MAP_LEADER)) {
+                    printf("  -> ");
+                    print_successors(opcode, at);
+                    break;
+                }
+                at += 2;
+            }
+        }
+        printf("\n");
+    }
+
+    printf("rom: %s, %zu bytes, %s quirks\n", config.rom_name, rom_size, chip8_quirks_name(config.quirks));
+    print_class(&map, "code", CHIP8_MAP_CODE);
+    print_class(&map, "sprites", CHIP8_MAP_SPRITE);
+    print_class(&map, "loaded", CHIP8_MAP_LOADED);
+    print_class(&map, "stored", CHIP8_MAP_STORED);
+
+    // ROM bytes nothing was found to use (or reached only through what wasn't followed)
+    uint32_t unknown = 0;
+    for (uint32_t i = CHIP8_ENTRY_POINT; i < CHIP8_ENTRY_POINT + rom_size; i++) unknown += map.bytes[i] == 0;
+    printf("unknown  %5u ROM bytes\n", unknown);
+
+    if (map.flags & CHIP8_MAP_HAS_INDIRECT) {
+        printf("indirect jumps (not followed):");
+        for (uint32_t i = 0; i < CHIP8_RAM_SIZE; i++) {
+            if (map.bytes[i] & CHIP8_MAP_INDIRECT) printf(" 0x%03X", i);
+        }
+        printf("\n");
+    }
+    if (map.flags & CHIP8_MAP_UNKNOWN_STORES) printf("FX33/FX55 with an unknown I: stores may hit code\n");
+    if (map.flags & CHIP8_MAP_STORES_CODE) printf("FX33/FX55 store into code: self-modifying\n");
+    printf("data-only pages:");
+    for (uint32_t page = 0; page < 16; page++) {
+        if (map.data_pages & (1u << page)) printf(" 0x%X00", page);
+    }
+    printf("%s\n", map.data_pages ? "" : " none proven");
+
+    if (config.map_name) {
+        if (!chip8_map_save(&map, config.map_name)) exit(EXIT_FAILURE);
+        printf("map written to %s\n", config.map_name);
+    }
+    exit(EXIT_SUCCESS);
+}
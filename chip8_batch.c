@@ -0,0 +1,460 @@
+#include <stdlib.h>
+#include <string.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "chip8_ops.h"
+
+// Lockstep batch engine: CHIP8_BATCH_LANES machines running the same ROM, with the
+//   registers, timers and keypads kept as structure-of-arrays lanes (GCC vector
+//   extensions: two SSE2 registers per lane vector, or one AVX2 register when
+//   built for such a host, e.g. with -march=native).
+//
+//   Every step picks the lowest PC among the lanes still running this frame and
+//   executes that instruction for every lane sitting on it (the "group") with
+//   masked vector operations. While the lanes agree this is every lane at once;
+//   after a data dependent branch they split, and lowest-PC-first lets the group
+//   that fell behind catch up so they meet again at the join point.
+//
+//   Every lane vector holds bytes, so nothing ever has to be widened or narrowed:
+//   16 bit values (PC, I, the instruction budget) are kept as a low and a high byte
+//   plane with the carries done by hand.
+//
+//   RAM, display and stack stay per lane in ordinary chip8_t machines. Instructions
+//   touching them (DXYN, 00E0, EXxx, FX0A, FX33, FX55, FX65) run per lane through
+//   emulate_instruction, so each lane ends up bit-identical to a scalar machine run
+//   with the same seed and keys.
+
+typedef uint8_t lane8_t __attribute__((vector_size(CHIP8_BATCH_LANES), aligned(32)));
+typedef int8_t  mask8_t __attribute__((vector_size(CHIP8_BATCH_LANES), aligned(32)));
+
+_Static_assert(CHIP8_BATCH_LANES == 32, "lane bitmasks are uint32_t");
+
+struct chip8_batch {
+    lane8_t V[16];              // Data registers V0-VF, one lane per machine
+    lane8_t I_lo, I_hi;         // Index registers
+    lane8_t PC_lo, PC_hi;       // Program Counters
+    lane8_t delay_timer;
+    lane8_t sound_timer;
+    lane8_t sound_on;           // 0xFF while the lane's tone should play
+    lane8_t keypad[16];         // 0xFF = key down
+    uint32_t rng[CHIP8_BATCH_LANES];  // CXNN xorshift32 states
+    uint32_t lanes;             // Lanes in use
+    uint16_t written_pages;     // 256 byte RAM pages some lane has stored to
+    uint64_t steps;             // Group steps executed (one opcode fetch each)
+    uint64_t insts;             // Lane instructions executed
+    chip8_t machine[CHIP8_BATCH_LANES];  // Per lane RAM, display & stack
+};
+
+// GCC lowers a comparison of vectors wider than the host's registers to one scalar
+//   compare per lane, so without AVX2 lanes are compared one 16 byte SSE2 register
+//   at a time (the two registers the lane vector lives in anyway)
+#ifdef __AVX2__
+#define LANE_COMPARE(name, op)                                            \
+    static inline mask8_t name(lane8_t a, lane8_t b) {                    \
+        return (mask8_t)(a op b);                                         \
+    }
+#else
+typedef uint8_t half8_t __attribute__((vector_size(CHIP8_BATCH_LANES / 2)));
+
+#define LANE_COMPARE(name, op)                                            \
+    static inline mask8_t name(lane8_t a, lane8_t b) {                    \
+        mask8_t mask;                                                     \
+        for (size_t i = 0; i < sizeof a; i += sizeof(half8_t)) {          \
+            half8_t x, y, m;                                              \
+            memcpy(&x, (const char *)&a + i, sizeof x);                   \
+            memcpy(&y, (const char *)&b + i, sizeof y);                   \
+            m = (half8_t)(x op y);                                        \
+            memcpy((char *)&mask + i, &m, sizeof m);                      \
+        }                                                                 \
+        return mask;                                                      \
+    }
+#endif
+
+LANE_COMPARE(eq8, ==)
+LANE_COMPARE(ge8, >=)
+
+static inline lane8_t splat8(uint8_t value) {
+    return (lane8_t){0} + value;
+}
+
+// Bit l set for every lane l whose mask is set
+static inline uint32_t lane_bits(mask8_t mask) {
+#if defined(__AVX2__)
+    __m256i all;
+    memcpy(&all, &mask, sizeof all);
+    return (uint32_t)_mm256_movemask_epi8(all);
+#elif defined(__SSE2__)
+    __m128i lo, hi;
+    memcpy(&lo, &mask, sizeof lo);
+    memcpy(&hi, (const char *)&mask + sizeof lo, sizeof hi);
+    return (uint32_t)_mm_movemask_epi8(lo) | (uint32_t)_mm_movemask_epi8(hi) << 16;
+#else
+    uint32_t bits = 0;
+    for (uint32_t l = 0; l < CHIP8_BATCH_LANES; l++) bits |= (uint32_t)(mask[l] & 1) << l;
+    return bits;
+#endif
+}
+
+// dst = mask ? value : dst, lane by lane
+static inline lane8_t select8(mask8_t mask, lane8_t value, lane8_t dst) {
+    return (value & (lane8_t)mask) | (dst & ~(lane8_t)mask);
+}
+
+// (hi:lo) += (add_hi:add_lo) for the lanes in mask
+static inline void add16(lane8_t *lo, lane8_t *hi, lane8_t add_lo, lane8_t add_hi, mask8_t mask) {
+    const lane8_t sum = *lo + add_lo;
+    const lane8_t carry = 1 & ~(lane8_t)ge8(sum, add_lo);
+    *hi = select8(mask, *hi + add_hi + carry, *hi);
+    *lo = select8(mask, sum, *lo);
+}
+
+// Copy a lane's vector state into its machine, and back again
+static void lane_to_machine(chip8_batch_t *batch, uint32_t l) {
+    chip8_t *chip8 = &batch->machine[l];
+    for (uint8_t i = 0; i < 16; i++) {
+        chip8->V[i] = batch->V[i][l];
+        chip8->keypad[i] = batch->keypad[i][l] != 0;
+    }
+    chip8->I = batch->I_lo[l] | batch->I_hi[l] << 8;
+    chip8->PC = batch->PC_lo[l] | batch->PC_hi[l] << 8;
+    chip8->delay_timer = batch->delay_timer[l];
+    chip8->sound_timer = batch->sound_timer[l];
+    chip8->sound_on = batch->sound_on[l] != 0;
+    chip8->rng = batch->rng[l];
+}
+
+static void machine_to_lane(chip8_batch_t *batch, uint32_t l) {
+    const chip8_t *chip8 = &batch->machine[l];
+    for (uint8_t i = 0; i < 16; i++) batch->V[i][l] = chip8->V[i];
+    batch->I_lo[l] = chip8->I & 0xFF;
+    batch->I_hi[l] = chip8->I >> 8;
+    batch->PC_lo[l] = chip8->PC & 0xFF;
+    batch->PC_hi[l] = chip8->PC >> 8;
+    batch->delay_timer[l] = chip8->delay_timer;
+    batch->sound_timer[l] = chip8->sound_timer;
+    batch->rng[l] = chip8->rng;
+}
+
+// Run the group's instruction through the reference interpreter, lane by lane
+static void run_per_lane(chip8_batch_t *batch, uint32_t group, uint16_t opcode) {
+    for (uint32_t bits = group; bits; bits &= bits - 1) {
+        const uint32_t l = __builtin_ctz(bits);
+        const uint16_t I = batch->I_lo[l] | batch->I_hi[l] << 8;
+        lane_to_machine(batch, l);
+        emulate_instruction(&batch->machine[l]);
+        machine_to_lane(batch, l);
+
+        // FX33/FX55 store at most 16 bytes from I; opcodes there may now differ per lane
+        if ((opcode & 0xF0FF) == 0xF033 || (opcode & 0xF0FF) == 0xF055) {
+            batch->written_pages |= 1u << ((I >> 8) & 0x0F) | 1u << (((I + 15) >> 8) & 0x0F);
+        }
+    }
+}
+
+chip8_batch_t *chip8_batch_create(const uint8_t *rom, size_t rom_size, uint32_t lanes) {
+    if (lanes == 0 || lanes > CHIP8_BATCH_LANES) return NULL;
+
+    chip8_batch_t *batch = aligned_alloc(_Alignof(chip8_batch_t), sizeof *batch);
+    if (!batch) return NULL;
+
+    memset(batch, 0, sizeof *batch);
+    batch->lanes = lanes;
+    for (uint32_t l = 0; l < CHIP8_BATCH_LANES; l++) {
+        if (!chip8_init(&batch->machine[l], rom, rom_size)) {
+            free(batch);
+            return NULL;
+        }
+        machine_to_lane(batch, l);
+    }
+    return batch;
+}
+
+void chip8_batch_destroy(chip8_batch_t *batch) {
+    free(batch);
+}
+
+void chip8_batch_seed(chip8_batch_t *batch, uint32_t lane, uint32_t seed) {
+    chip8_seed(&batch->machine[lane], seed);
+    batch->rng[lane] = batch->machine[lane].rng;
+}
+
+void chip8_batch_set_key(chip8_batch_t *batch, uint32_t lane, uint8_t key, bool down) {
+    batch->keypad[key & 0x0F][lane] = down ? 0xFF : 0x00;
+}
+
+const chip8_t *chip8_batch_machine(chip8_batch_t *batch, uint32_t lane) {
+    lane_to_machine(batch, lane);
+    return &batch->machine[lane];
+}
+
+double chip8_batch_lanes_per_step(const chip8_batch_t *batch) {
+    return batch->steps ? (double)batch->insts / batch->steps : 0.0;
+}
+
+// Hand the PCs (kept in locals by the step loop) to the per-lane interpreter and back
+#define RUN_PER_LANE()                                        \
+    do {                                                      \
+        batch->PC_lo = PC_lo, batch->PC_hi = PC_hi;           \
+        run_per_lane(batch, group, opcode);                   \
+        PC_lo = batch->PC_lo, PC_hi = batch->PC_hi;           \
+        advance = false;                                      \
+    } while (0)
+
+// Run up to budget instructions on the lanes in *active. Lanes that draw leave *active:
+// they wait for the next frame. Returns the number of instructions executed.
+static uint64_t run_chunk(chip8_batch_t *batch, uint16_t budget, mask8_t *active) {
+    const lane8_t zero = {0};
+    const mask8_t lanes = *active;
+
+    // Instructions each lane has left this chunk, counted down in two byte planes
+    lane8_t left_lo = splat8(budget & 0xFF) & (lane8_t)lanes;
+    lane8_t left_hi = splat8(budget >> 8) & (lane8_t)lanes;
+    mask8_t running = ~(eq8(left_lo, zero) & eq8(left_hi, zero));
+
+    lane8_t PC_lo = batch->PC_lo, PC_hi = batch->PC_hi;
+    for (uint32_t run_bits; (run_bits = lane_bits(running)); ) {
+        // Lowest PC among the running lanes; usually they all agree
+        const uint32_t first = __builtin_ctz(run_bits);
+        uint16_t pc = PC_lo[first] | PC_hi[first] << 8;
+        mask8_t group8 = running & eq8(PC_lo, splat8(pc & 0xFF)) & eq8(PC_hi, splat8(pc >> 8));
+        uint32_t group = lane_bits(group8);
+        if (group != run_bits) {
+            for (uint32_t bits = run_bits; bits; bits &= bits - 1) {
+                const uint32_t l = __builtin_ctz(bits);
+                const uint16_t lane_pc = PC_lo[l] | PC_hi[l] << 8;
+                if (lane_pc < pc) pc = lane_pc;
+            }
+            group8 = running & eq8(PC_lo, splat8(pc & 0xFF)) & eq8(PC_hi, splat8(pc >> 8));
+            group = lane_bits(group8);
+        }
+
+        // PC wraps around the end of RAM when an instruction is fetched (emulate_instruction)
+        if (pc > CHIP8_ADDR_MASK) {
+            pc &= CHIP8_ADDR_MASK;
+            PC_lo = select8(group8, splat8(pc & 0xFF), PC_lo);
+            PC_hi = select8(group8, splat8(pc >> 8), PC_hi);
+        }
+        const uint16_t next = (pc + 1) & CHIP8_ADDR_MASK;
+
+        //Get next opcode from the first lane's RAM; lanes whose stores changed it wait
+        const uint8_t *ram = batch->machine[__builtin_ctz(group)].ram;
+        const uint16_t opcode = (ram[pc] << 8) | ram[next];
+        if (batch->written_pages & (1u << (pc >> 8) | 1u << (next >> 8))) {
+            for (uint32_t bits = group; bits; bits &= bits - 1) {
+                const uint32_t l = __builtin_ctz(bits);
+                const uint8_t *lane_ram = batch->machine[l].ram;
+                if (((lane_ram[pc] << 8) | lane_ram[next]) != opcode) {
+                    group8[l] = 0;
+                    group &= ~(1u << l);
+                }
+            }
+        }
+
+        const uint8_t X = (opcode >> 8) & 0x0F;
+        const uint8_t Y = (opcode >> 4) & 0x0F;
+        const uint8_t N = opcode & 0x0F;
+        const uint8_t NN = opcode & 0xFF;
+        const uint16_t NNN = opcode & 0x0FFF;
+        const lane8_t VX = batch->V[X];
+        const lane8_t VY = batch->V[Y];
+        mask8_t skip = {0};     // Lanes (within the group) that skip the next instruction
+        bool advance = true;    // false: the case has set the group's PCs itself
+
+        switch (opcode >> 12) {
+            case 0x0:
+                if (opcode == 0x00EE) {
+                    //0x00EE: Return from subroutine (lanes with an empty stack fault and stay)
+                    for (uint32_t bits = group; bits; bits &= bits - 1) {
+                        const uint32_t l = __builtin_ctz(bits);
+                        uint16_t ret;
+                        if (!chip8_pop(&batch->machine[l], &ret)) continue;
+                        PC_lo[l] = ret & 0xFF;
+                        PC_hi[l] = ret >> 8;
+                    }
+                    advance = false;
+                } else {
+                    RUN_PER_LANE();
+                }
+                break;
+
+            case 0x1:
+                //0x1NNN: Jumps to address NNN
+                PC_lo = select8(group8, splat8(NNN & 0xFF), PC_lo);
+                PC_hi = select8(group8, splat8(NNN >> 8), PC_hi);
+                advance = false;
+                break;
+
+            case 0x2: {
+                //0x2NNN: Call subroutine at NNN (lanes with a full stack fault and stay)
+                mask8_t called = group8;
+                for (uint32_t bits = group; bits; bits &= bits - 1) {
+                    const uint32_t l = __builtin_ctz(bits);
+                    if (!chip8_push(&batch->machine[l], (uint16_t)((PC_lo[l] | PC_hi[l] << 8) + 2))) called[l] = 0;
+                }
+                PC_lo = select8(called, splat8(NNN & 0xFF), PC_lo);
+                PC_hi = select8(called, splat8(NNN >> 8), PC_hi);
+                advance = false;
+                break;
+            }
+
+            case 0x3:
+                // 0x3XNN: Check if VX == NN, if so, skip the next instruction
+                skip = eq8(VX, splat8(NN));
+                break;
+
+            case 0x4:
+                // 0x4XNN: Check if VX != NN, if so, skip the next instruction
+                skip = ~eq8(VX, splat8(NN));
+                break;
+
+            case 0x5:
+                // 0x5XY0: Check if VX == VY, if so, skip the next instruction
+                if (N == 0) skip = eq8(VX, VY);
+                break;
+
+            case 0x6:
+                //0x6XNN: Set register VX to NN.
+                batch->V[X] = select8(group8, splat8(NN), VX);
+                break;
+
+            case 0x7:
+                //0x7XNN: Set register VX += NN.
+                batch->V[X] = select8(group8, VX + NN, VX);
+                break;
+
+            case 0x8: {
+                // Invalid 8XYN: the per-lane interpreter counts it
+                if (N > 0x7 && N != 0xE) {
+                    RUN_PER_LANE();
+                    break;
+                }
+                // Result and flag are written in the scalar order: VX first, then VF
+                lane8_t result = VX, flag = {0};
+                bool sets_flag = true;
+                switch (N) {
+                    case 0x0: result = VY; sets_flag = false; break;
+                    case 0x1: result = VX | VY; break;
+                    case 0x2: result = VX & VY; break;
+                    case 0x3: result = VX ^ VY; break;
+                    case 0x4: result = VX + VY; flag = 1 & ~(lane8_t)ge8(result, VX); break;
+                    case 0x5: result = VX - VY; flag = 1 & (lane8_t)ge8(VX, VY); break;
+                    case 0x6: result = VY >> 1; flag = VY & 1; break;
+                    case 0x7: result = VY - VX; flag = 1 & (lane8_t)ge8(VY, VX); break;
+                    case 0xE: result = VY << 1; flag = VY >> 7; break;
+                }
+                batch->V[X] = select8(group8, result, VX);
+                if (sets_flag) batch->V[0xF] = select8(group8, flag, batch->V[0xF]);
+                break;
+            }
+
+            case 0x9:
+                //0x9XY0: Skips the next instruction if VX does not equal VY
+                if (N == 0) skip = ~eq8(VX, VY);
+                break;
+
+            case 0xA:
+                //0xANNN: Set index register I to NNN
+                batch->I_lo = select8(group8, splat8(NNN & 0xFF), batch->I_lo);
+                batch->I_hi = select8(group8, splat8(NNN >> 8), batch->I_hi);
+                break;
+
+            case 0xB: {
+                //0xBNNN: Jumps to the address NNN plus V0
+                lane8_t lo = splat8(NNN & 0xFF), hi = splat8(NNN >> 8);
+                add16(&lo, &hi, batch->V[0], zero, group8);
+                PC_lo = select8(group8, lo, PC_lo);
+                PC_hi = select8(group8, hi, PC_hi);
+                advance = false;
+                break;
+            }
+
+            case 0xC: {
+                //0xCXNN: VX = random byte & NN, one xorshift32 per lane
+                lane8_t random = VX;
+                for (uint32_t bits = group; bits; bits &= bits - 1) {
+                    const uint32_t l = __builtin_ctz(bits);
+                    uint32_t x = batch->rng[l];
+                    x ^= x << 13;
+                    x ^= x >> 17;
+                    x ^= x << 5;
+                    batch->rng[l] = x;
+                    random[l] = (x >> 24) & NN;
+                }
+                batch->V[X] = random;
+                break;
+            }
+
+            case 0xD:
+                //0xDXYN: Draw per lane; the lanes then wait for the next frame (display wait)
+                RUN_PER_LANE();
+                running &= ~group8;
+                *active &= ~group8;
+                break;
+
+            case 0xF:
+                switch (NN) {
+                    case 0x07: batch->V[X] = select8(group8, batch->delay_timer, VX); break;
+                    case 0x15: batch->delay_timer = select8(group8, VX, batch->delay_timer); break;
+                    case 0x18: batch->sound_timer = select8(group8, VX, batch->sound_timer); break;
+                    case 0x1E: add16(&batch->I_lo, &batch->I_hi, VX, zero, group8); break;
+                    case 0x29: {
+                        // I = VX * 5 = (VX << 2) + VX, 10 bits
+                        lane8_t lo = VX << 2, hi = VX >> 6;
+                        add16(&lo, &hi, VX, zero, group8);
+                        batch->I_lo = select8(group8, lo, batch->I_lo);
+                        batch->I_hi = select8(group8, hi, batch->I_hi);
+                        break;
+                    }
+                    default:    // FX0A, FX33, FX55, FX65 and invalid opcodes
+                        RUN_PER_LANE();
+                        break;
+                }
+                break;
+
+            default:  // 0xE: keypad lookups indexed by VX, per lane
+                RUN_PER_LANE();
+                break;
+        }
+        if (advance) add16(&PC_lo, &PC_hi, (2 & (lane8_t)group8) + (2 & (lane8_t)skip), zero, group8);
+
+        // One instruction less left for the group's lanes
+        const lane8_t borrow = 1 & (lane8_t)(eq8(left_lo, zero) & group8);
+        left_lo -= 1 & (lane8_t)group8;
+        left_hi -= borrow;
+        running &= ~(eq8(left_lo, zero) & eq8(left_hi, zero));
+
+        batch->steps++;
+        batch->insts += __builtin_popcount(group);
+    }
+    batch->PC_lo = PC_lo, batch->PC_hi = PC_hi;
+
+    uint64_t insts = 0;
+    for (uint32_t bits = lane_bits(lanes); bits; bits &= bits - 1) {
+        const uint32_t l = __builtin_ctz(bits);
+        insts += budget - (left_lo[l] | left_hi[l] << 8);
+    }
+    return insts;
+}
+
+uint64_t chip8_batch_run_frame(chip8_batch_t *batch, uint32_t insts_per_frame) {
+    const lane8_t zero = {0};
+    mask8_t active = {0};
+    for (uint32_t l = 0; l < batch->lanes; l++) active[l] = -1;
+
+    // The lane counters hold 16 bits, so larger frames run in chunks
+    uint64_t insts = 0;
+    for (uint32_t left = insts_per_frame; left > 0 && lane_bits(active); ) {
+        const uint16_t budget = left > 0xFFFF ? 0xFFFF : left;
+        insts += run_chunk(batch, budget, &active);
+        left -= budget;
+    }
+
+    // Update delay & sound timers every 60hz
+    batch->sound_on = ~(lane8_t)eq8(batch->sound_timer, zero);
+    batch->delay_timer -= 1 & ~(lane8_t)eq8(batch->delay_timer, zero);
+    batch->sound_timer -= 1 & batch->sound_on;
+    return insts;
+}
@@ -0,0 +1,396 @@
+#define _POSIX_C_SOURCE 200809L  // clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "chip8_core.h"
+#include "chip8_fade.h"
+
+// Benchmark suite: per-opcode cost of the reference interpreter, a DXYN blit loop and
+//   whole-ROM throughput on every backend, and the frontend's per-frame color fade.
+//   The ROMs are generated here, so every build measures the same code. Each
+//   benchmark repeats until it has run for --seconds; results go out as JSON
+//   (stdout or --json FILE) with a short summary on stderr.
+//
+//   The per-frame fade stands in for update_screen: without a window, the fade of
+//   the dirty rows is the CPU work update_screen does before handing pixels to SDL.
+//
+//   Usage: chip8-bench [--json FILE] [--seconds S]
+
+#define ROM_LOOP_INSTS 1024     // Per-opcode ROMs: this many copies, then a jump back
+#define FADE_RATE      0.7f
+
+typedef struct {
+    uint8_t data[CHIP8_MAX_ROM_SIZE];
+    size_t size;
+} bench_rom_t;
+
+typedef struct {
+    const char *name;
+    chip8_backend_t backend;
+} bench_backend_t;
+
+static const bench_backend_t backends[] = {
+    {"interpreter", CHIP8_BACKEND_INTERPRETER},
+    {"cached", CHIP8_BACKEND_CACHED},
+    {"jit", CHIP8_BACKEND_JIT},
+};
+
+static double min_seconds = 0.2;
+static FILE *json;
+static chip8_jit_t *jit;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Append opcode at the ROM's end; returns its address
+static uint16_t emit(bench_rom_t *rom, uint16_t opcode) {
+    const uint16_t address = CHIP8_ENTRY_POINT + rom->size;
+    rom->data[rom->size++] = opcode >> 8;
+    rom->data[rom->size++] = opcode & 0xFF;
+    return address;
+}
+
+static uint16_t next_address(const bench_rom_t *rom) {
+    return CHIP8_ENTRY_POINT + rom->size;
+}
+
+// Per-opcode ROMs: I = 0xF00 (FX33/FX55 write up there, DXYN draws the sprite data
+//   placed there), then ROM_LOOP_INSTS copies of one instruction, which may depend on
+//   its address (jumps to the next one)
+typedef uint16_t opcode_fn(uint16_t address, uint32_t i);
+
+static uint16_t op_00E0(uint16_t a, uint32_t i) { (void)a; (void)i; return 0x00E0; }
+static uint16_t op_1NNN(uint16_t a, uint32_t i) { (void)i; return 0x1000 | (a + 2); }
+static uint16_t op_3XNN(uint16_t a, uint32_t i) { (void)a; return 0x3012 | (i % 15) << 8; }   // No skip
+static uint16_t op_4XNN(uint16_t a, uint32_t i) { (void)a; return 0x4012 | (i % 15) << 8; }   // Skips
+static uint16_t op_5XY0(uint16_t a, uint32_t i) { (void)a; return 0x5010 | (i % 15) << 8; }
+static uint16_t op_6XNN(uint16_t a, uint32_t i) { (void)a; return 0x6000 | (i % 15) << 8 | (i & 0xFF); }
+static uint16_t op_7XNN(uint16_t a, uint32_t i) { (void)a; return 0x7003 | (i % 15) << 8; }
+static uint16_t op_8XY0(uint16_t a, uint32_t i) { (void)a; return 0x8010 | (i % 15) << 8; }
+static uint16_t op_8XY1(uint16_t a, uint32_t i) { (void)a; return 0x8011 | (i % 15) << 8; }
+static uint16_t op_8XY2(uint16_t a, uint32_t i) { (void)a; return 0x8012 | (i % 15) << 8; }
+static uint16_t op_8XY3(uint16_t a, uint32_t i) { (void)a; return 0x8013 | (i % 15) << 8; }
+static uint16_t op_8XY4(uint16_t a, uint32_t i) { (void)a; return 0x8014 | (i % 15) << 8; }
+static uint16_t op_8XY5(uint16_t a, uint32_t i) { (void)a; return 0x8015 | (i % 15) << 8; }
+static uint16_t op_8XY6(uint16_t a, uint32_t i) { (void)a; return 0x8016 | (i % 15) << 8; }
+static uint16_t op_8XY7(uint16_t a, uint32_t i) { (void)a; return 0x8017 | (i % 15) << 8; }
+static uint16_t op_8XYE(uint16_t a, uint32_t i) { (void)a; return 0x801E | (i % 15) << 8; }
+static uint16_t op_9XY0(uint16_t a, uint32_t i) { (void)a; return 0x9010 | (i % 15) << 8; }
+static uint16_t op_ANNN(uint16_t a, uint32_t i) { (void)a; return 0xAF00 | (i & 0xFF); }
+static uint16_t op_BNNN(uint16_t a, uint32_t i) { (void)i; return 0xB000 | (a + 2); }         // V0 is 0
+static uint16_t op_CXNN(uint16_t a, uint32_t i) { (void)a; return 0xC0FF | (i % 15) << 8; }
+static uint16_t op_DXYN(uint16_t a, uint32_t i) { (void)a; return 0xD015 | (i % 15) << 8; }
+static uint16_t op_EX9E(uint16_t a, uint32_t i) { (void)a; return 0xE09E | (i % 15) << 8; }   // Not pressed
+static uint16_t op_EXA1(uint16_t a, uint32_t i) { (void)a; return 0xE0A1 | (i % 15) << 8; }   // Skips
+static uint16_t op_FX07(uint16_t a, uint32_t i) { (void)a; return 0xF007 | (i % 15) << 8; }
+static uint16_t op_FX15(uint16_t a, uint32_t i) { (void)a; return 0xF015 | (i % 15) << 8; }
+static uint16_t op_FX18(uint16_t a, uint32_t i) { (void)a; return 0xF018 | (i % 15) << 8; }
+static uint16_t op_FX1E(uint16_t a, uint32_t i) { (void)a; (void)i; return 0xFF1E; }          // VF is 0
+static uint16_t op_FX29(uint16_t a, uint32_t i) { (void)a; return 0xF029 | (i % 15) << 8; }
+static uint16_t op_FX33(uint16_t a, uint32_t i) { (void)a; return 0xF033 | (i % 15) << 8; }
+// FX55/FX65 move I along, so every other instruction puts it back
+static uint16_t op_FX55(uint16_t a, uint32_t i) { (void)a; return i % 2 ? 0xF355 : 0xAF00; }
+static uint16_t op_FX65(uint16_t a, uint32_t i) { (void)a; return i % 2 ? 0xF365 : 0xAF00; }
+
+static const struct {
+    const char *name;
+    opcode_fn *opcode;
+} opcodes[] = {
+    {"00E0", op_00E0}, {"1NNN", op_1NNN}, {"3XNN", op_3XNN}, {"4XNN", op_4XNN},
+    {"5XY0", op_5XY0}, {"6XNN", op_6XNN}, {"7XNN", op_7XNN}, {"8XY0", op_8XY0},
+    {"8XY1", op_8XY1}, {"8XY2", op_8XY2}, {"8XY3", op_8XY3}, {"8XY4", op_8XY4},
+    {"8XY5", op_8XY5}, {"8XY6", op_8XY6}, {"8XY7", op_8XY7}, {"8XYE", op_8XYE},
+    {"9XY0", op_9XY0}, {"ANNN", op_ANNN}, {"BNNN", op_BNNN}, {"CXNN", op_CXNN},
+    {"DXYN", op_DXYN}, {"EX9E", op_EX9E}, {"EXA1", op_EXA1}, {"FX07", op_FX07},
+    {"FX15", op_FX15}, {"FX18", op_FX18}, {"FX1E", op_FX1E}, {"FX29", op_FX29},
+    {"FX33", op_FX33}, {"FX55+ANNN", op_FX55}, {"FX65+ANNN", op_FX65},
+};
+
+static void opcode_rom(bench_rom_t *rom, opcode_fn *opcode) {
+    rom->size = 0;
+    emit(rom, 0xAF00);
+    for (uint32_t i = 0; i < ROM_LOOP_INSTS; i++) emit(rom, opcode(next_address(rom), i));
+    emit(rom, 0x1000 | CHIP8_ENTRY_POINT);
+
+    while (next_address(rom) < 0xF00) emit(rom, 0x0000);
+    for (uint32_t i = 0; i < 8; i++) emit(rom, 0x5AC3);
+}
+
+// 2NNN and 00EE only make sense as a pair: call, return, jump back
+static void call_rom(bench_rom_t *rom) {
+    rom->size = 0;
+    emit(rom, 0x2206);
+    emit(rom, 0x1200);
+    emit(rom, 0x0000);          // Padding, never runs
+    emit(rom, 0x00EE);
+}
+
+// Whole-ROM workloads
+static void alu_rom(bench_rom_t *rom) {
+    rom->size = 0;
+    for (uint16_t x = 0; x < 8; x++) emit(rom, 0x6000 | x << 8 | (x * 37 + 11));
+    const uint16_t loop = emit(rom, 0x8014);
+    emit(rom, 0x8125); emit(rom, 0x8236); emit(rom, 0x8347); emit(rom, 0x8451);
+    emit(rom, 0x8562); emit(rom, 0x8673); emit(rom, 0x870E); emit(rom, 0x7001);
+    emit(rom, 0x7103); emit(rom, 0x8016); emit(rom, 0x8127);
+    emit(rom, 0x1000 | loop);
+}
+
+static void branch_rom(bench_rom_t *rom) {
+    rom->size = 0;
+    const uint16_t loop = emit(rom, 0x7001);
+    emit(rom, 0x3000);          // Skip the call every 256th time round
+    emit(rom, 0x2000 | (loop + 16));
+    emit(rom, 0x4105);
+    emit(rom, 0x6100);
+    emit(rom, 0x5120);
+    emit(rom, 0x7101);
+    emit(rom, 0x1000 | loop);
+    emit(rom, 0x7201);          // Subroutine
+    emit(rom, 0x9230);
+    emit(rom, 0x7301);
+    emit(rom, 0x00EE);
+}
+
+static void memory_rom(bench_rom_t *rom) {
+    rom->size = 0;
+    const uint16_t loop = emit(rom, 0xAE00);
+    emit(rom, 0x7701);
+    emit(rom, 0xF733);
+    emit(rom, 0xF265);
+    emit(rom, 0x8124);
+    emit(rom, 0xF555);
+    emit(rom, 0xF71E);
+    emit(rom, 0xF565);
+    emit(rom, 0x1000 | loop);
+}
+
+static void draw_rom(bench_rom_t *rom) {
+    rom->size = 0;
+    const uint16_t loop = emit(rom, 0xF029);
+    emit(rom, 0xD125);
+    emit(rom, 0x7103);
+    emit(rom, 0x7205);
+    emit(rom, 0x7001);
+    emit(rom, 0x300F);
+    emit(rom, 0x1000 | loop);
+    emit(rom, 0x6000);
+    emit(rom, 0x1000 | loop);
+}
+
+// Rewrites the immediate of an instruction it runs next, every time round
+static void selfmod_rom(bench_rom_t *rom) {
+    rom->size = 0;
+    const uint16_t loop = emit(rom, 0x6063);
+    emit(rom, 0x7101);
+    const uint16_t set_I = emit(rom, 0xA000);
+    emit(rom, 0xF155);
+    const uint16_t target = emit(rom, 0x6300);
+    emit(rom, 0x8434);
+    emit(rom, 0x1000 | loop);
+
+    const uint16_t annn = 0xA000 | target;
+    rom->data[set_I - CHIP8_ENTRY_POINT] = annn >> 8;
+    rom->data[set_I - CHIP8_ENTRY_POINT + 1] = annn & 0xFF;
+}
+
+// DXYN heavy: 15 row sprites all over the screen (the sprite is the code itself)
+static void blit_rom(bench_rom_t *rom) {
+    rom->size = 0;
+    emit(rom, 0xA200);
+    const uint16_t loop = emit(rom, 0xD12F);
+    emit(rom, 0x7103);
+    emit(rom, 0x7207);
+    emit(rom, 0x1000 | loop);
+}
+
+static const struct {
+    const char *name;
+    void (*build)(bench_rom_t *rom);
+} workloads[] = {
+    {"alu", alu_rom},
+    {"branch", branch_rom},
+    {"memory", memory_rom},
+    {"draw", draw_rom},
+    {"selfmod", selfmod_rom},
+};
+
+static bool start_machine(chip8_t *chip8, const bench_rom_t *rom, chip8_backend_t backend) {
+    if (!chip8_init(chip8, rom->data, rom->size)) return false;
+    chip8_seed(chip8, 1);
+    return chip8_set_backend(chip8, backend, jit);
+}
+
+// Reference interpreter ns per instruction for one ROM
+static double interpreter_ns(chip8_t *chip8, const bench_rom_t *rom) {
+    start_machine(chip8, rom, CHIP8_BACKEND_INTERPRETER);
+
+    uint64_t insts = 0;
+    const double start = now_seconds();
+    double elapsed;
+    do {
+        for (uint32_t i = 0; i < 4096; i++) emulate_instruction(chip8);
+        insts += 4096;
+    } while ((elapsed = now_seconds() - start) < min_seconds);
+    return elapsed * 1e9 / insts;
+}
+
+static void bench_opcodes(chip8_t *chip8) {
+    static bench_rom_t rom;
+
+    fprintf(json, "  \"opcodes\": [\n");
+    for (size_t i = 0; i <= sizeof opcodes / sizeof opcodes[0]; i++) {
+        const char *name = i < sizeof opcodes / sizeof opcodes[0] ? opcodes[i].name : "2NNN+00EE+1NNN";
+        if (i < sizeof opcodes / sizeof opcodes[0]) opcode_rom(&rom, opcodes[i].opcode);
+        else call_rom(&rom);
+
+        const double ns = interpreter_ns(chip8, &rom);
+        fprintf(json, "    {\"opcode\": \"%s\", \"ns_per_inst\": %.2f}%s\n", name, ns,
+                i < sizeof opcodes / sizeof opcodes[0] ? "," : "");
+        fprintf(stderr, "opcode %-15s %8.2f ns/inst\n", name, ns);
+    }
+    fprintf(json, "  ],\n");
+}
+
+// Run a ROM in 60hz frames (display wait on) on a backend until min_seconds is up
+static void run_rom(chip8_t *chip8, const char *name, const bench_rom_t *rom,
+                    const bench_backend_t *backend, uint32_t insts_per_frame, bool last) {
+    const bool native = start_machine(chip8, rom, backend->backend);
+
+    uint64_t insts = 0, frames = 0;
+    const double start = now_seconds();
+    double elapsed;
+    do {
+        for (uint32_t i = 0; i < 64; i++) insts += chip8_run_frame(chip8, insts_per_frame);
+        frames += 64;
+    } while ((elapsed = now_seconds() - start) < min_seconds);
+
+    const char *used = native ? backend->name : "cached";
+    fprintf(json, "    {\"rom\": \"%s\", \"backend\": \"%s\", \"ns_per_inst\": %.3f, \"mips\": %.2f, "
+                  "\"frames_per_second\": %.0f}%s\n",
+            name, used, elapsed * 1e9 / insts, insts / elapsed / 1e6, frames / elapsed, last ? "" : ",");
+    fprintf(stderr, "rom %-8s %-11s %8.3f ns/inst %9.2f MIPS %11.0f frames/s\n",
+            name, used, elapsed * 1e9 / insts, insts / elapsed / 1e6, frames / elapsed);
+}
+
+static void bench_roms(chip8_t *chip8) {
+    static bench_rom_t rom;
+    const size_t backend_count = sizeof backends / sizeof backends[0];
+
+    // Display wait on: the draw ROM ends its frames early, the others run the full budget
+    fprintf(json, "  \"roms\": [\n");
+    for (size_t w = 0; w < sizeof workloads / sizeof workloads[0]; w++) {
+        workloads[w].build(&rom);
+        for (size_t b = 0; b < backend_count; b++) {
+            run_rom(chip8, workloads[w].name, &rom, &backends[b], 10000,
+                    w + 1 == sizeof workloads / sizeof workloads[0] && b + 1 == backend_count);
+        }
+    }
+    fprintf(json, "  ],\n");
+}
+
+// ns per sprite: chip8_run stops after every DXYN, so each call draws one
+static void bench_blit(chip8_t *chip8) {
+    static bench_rom_t rom;
+    blit_rom(&rom);
+
+    fprintf(json, "  \"blit\": [\n");
+    for (size_t b = 0; b < sizeof backends / sizeof backends[0]; b++) {
+        const bool native = start_machine(chip8, &rom, backends[b].backend);
+
+        uint64_t sprites = 0;
+        const double start = now_seconds();
+        double elapsed;
+        do {
+            for (uint32_t i = 0; i < 1024; i++) chip8_run(chip8, 8);
+            sprites += 1024;
+        } while ((elapsed = now_seconds() - start) < min_seconds);
+
+        const char *used = native ? backends[b].name : "cached";
+        fprintf(json, "    {\"backend\": \"%s\", \"ns_per_sprite\": %.2f}%s\n", used, elapsed * 1e9 / sprites,
+                b + 1 < sizeof backends / sizeof backends[0] ? "," : "");
+        fprintf(stderr, "blit %-11s %8.2f ns/sprite (8x15, incl. 3 more instructions)\n", used,
+                elapsed * 1e9 / sprites);
+    }
+    fprintf(json, "  ],\n");
+}
+
+// Fade kernels on every row (worst case) and on the rows a blit frame dirties
+static void bench_fade(chip8_t *chip8) {
+    static const char *kernels[] = {"scalar", "sse2", "avx2", "neon"};
+    static uint32_t colors[CHIP8_DISPLAY_WIDTH * CHIP8_DISPLAY_HEIGHT];
+    static bench_rom_t rom;
+    const uint16_t weight = chip8_fade_weight(FADE_RATE);
+
+    blit_rom(&rom);
+    start_machine(chip8, &rom, CHIP8_BACKEND_CACHED);
+
+    fprintf(json, "  \"fade\": [\n");
+    bool first = true;
+    for (size_t k = 0; k < sizeof kernels / sizeof kernels[0]; k++) {
+        chip8_fade_fn *fade = chip8_fade_kernel(kernels[k]);
+        if (fade == NULL) continue;
+
+        for (int dirty_only = 0; dirty_only < 2; dirty_only++) {
+            memset(colors, 0, sizeof colors);
+            uint64_t frames = 0, rows = 0;
+            const double start = now_seconds();
+            double elapsed;
+            do {
+                for (uint32_t i = 0; i < 256; i++) {
+                    chip8->dirty_rows = 0;
+                    chip8_run_frame(chip8, 10);
+                    const uint32_t dirty = dirty_only ? chip8->dirty_rows : CHIP8_ALL_ROWS;
+                    fade(colors, chip8->display, dirty, 0xFFCC00FF, 0x202040FF, weight);
+                    rows += __builtin_popcount(dirty);
+                }
+                frames += 256;
+            } while ((elapsed = now_seconds() - start) < min_seconds);
+
+            // The blit frame itself is in the time; it's the same for every kernel
+            const char *rows_name = dirty_only ? "dirty" : "all";
+            fprintf(json, "%s    {\"kernel\": \"%s\", \"rows\": \"%s\", \"rows_per_frame\": %.1f, "
+                          "\"ns_per_frame\": %.1f}",
+                    first ? "" : ",\n", kernels[k], rows_name, (double)rows / frames, elapsed * 1e9 / frames);
+            fprintf(stderr, "fade %-6s %-5s rows %8.1f ns/frame\n", kernels[k], rows_name, elapsed * 1e9 / frames);
+            first = false;
+        }
+    }
+    fprintf(json, "\n  ]\n");
+}
+
+int main(int argc, char **argv) {
+    json = stdout;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json = fopen(argv[++i], "w");
+            if (json == NULL) {
+                fprintf(stderr, "Could not create %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            min_seconds = strtod(argv[++i], NULL);
+        } else {
+            fprintf(stderr, "Usage: %s [--json FILE] [--seconds S]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    static chip8_t chip8;
+    jit = chip8_jit_create();
+
+    fprintf(json, "{\n  \"version\": 1,\n  \"seconds_per_benchmark\": %.3f,\n", min_seconds);
+    bench_opcodes(&chip8);
+    bench_roms(&chip8);
+    bench_blit(&chip8);
+    bench_fade(&chip8);
+    fprintf(json, "}\n");
+
+    chip8_jit_destroy(jit);
+    if (json != stdout && fclose(json) != 0) exit(EXIT_FAILURE);
+    exit(EXIT_SUCCESS);
+}
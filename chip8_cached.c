@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chip8_core.h"
+#include "chip8_ops.h"
+
+// Pre-decoded interpreter: every even address is decoded once into a compact
+//   handler + operand record (chip8->icache), and instructions are dispatched
+//   through a table of label addresses (GCC/Clang "computed goto"), so each
+//   handler jumps straight to the next one without a central switch.
+//   RAM writes (FX33/FX55) clear the entries they cover, see chip8_write_ram.
+//
+//   A few short sequences that ROMs run over and over (sprite draws, counted loops,
+//   delay timer waits; chip8_fusion_t) get a fused handler on the entry of their first
+//   instruction, which runs the whole sequence in one dispatch. Its operands stay in
+//   the entries of the instructions after it, which are decoded along with it.
+//
+//   The handlers are compiled once per quirk profile (chip8_cached_run.h), so the
+//   decoded entries are the same for every profile and only the dispatch differs.
+
+enum {
+    OP_DECODE,      // Entry not decoded yet (or invalidated by a RAM write)
+    OP_FALLBACK,    // Invalid/unusual opcode: let the reference interpreter handle it
+    OP_SLOW,        // Odd or out of range PC, not cacheable
+    OP_CLS,         // 00E0
+    OP_RET,         // 00EE
+    OP_JP,          // 1NNN
+    OP_CALL,        // 2NNN
+    OP_SE_IMM,      // 3XNN
+    OP_SNE_IMM,     // 4XNN
+    OP_SE_REG,      // 5XY0
+    OP_LD_IMM,      // 6XNN
+    OP_ADD_IMM,     // 7XNN
+    OP_LD_REG,      // 8XY0
+    OP_OR,          // 8XY1
+    OP_AND,         // 8XY2
+    OP_XOR,         // 8XY3
+    OP_ADD_REG,     // 8XY4
+    OP_SUB,         // 8XY5
+    OP_SHR,         // 8XY6
+    OP_SUBN,        // 8XY7
+    OP_SHL,         // 8XYE
+    OP_SNE_REG,     // 9XY0
+    OP_LD_I,        // ANNN
+    OP_JP_V0,       // BNNN
+    OP_RND,         // CXNN
+    OP_DRW,         // DXYN
+    OP_SKP,         // EX9E
+    OP_SKNP,        // EXA1
+    OP_LD_VX_DT,    // FX07
+    OP_LD_KEY,      // FX0A
+    OP_LD_DT,       // FX15
+    OP_LD_ST,       // FX18
+    OP_ADD_I,       // FX1E
+    OP_LD_F,        // FX29
+    OP_BCD,         // FX33
+    OP_STORE,       // FX55
+    OP_LOAD,        // FX65
+    OP_FUSE_DRAW,       // ANNN, DXYN
+    OP_FUSE_COUNT_LOOP, // 7XNN, 3XNN, 1NNN
+    OP_FUSE_TIMER_WAIT, // FX07, 3XNN, 1NNN
+    OP_COUNT,
+};
+
+_Static_assert(OP_FUSE_DRAW == CHIP8_FUSED_HANDLERS, "chip8_invalidate_fused tells fused entries by their handler");
+
+static const char *const fusion_names[CHIP8_FUSIONS] = {
+    [CHIP8_FUSE_DRAW] = "ANNN+DXYN",
+    [CHIP8_FUSE_COUNT_LOOP] = "7XNN+3XNN+1NNN",
+    [CHIP8_FUSE_TIMER_WAIT] = "FX07+3XNN+1NNN",
+};
+
+const char *chip8_fusion_name(chip8_fusion_t fusion) {
+    return fusion < CHIP8_FUSIONS ? fusion_names[fusion] : "?";
+}
+
+// Map an opcode to its handler
+static uint8_t decode_handler(const uint16_t opcode) {
+    const uint8_t N = opcode & 0x0F;
+    const uint8_t NN = opcode & 0xFF;
+
+    switch (opcode >> 12) {
+        case 0x0:
+            if (opcode == 0x00E0) return OP_CLS;
+            if (opcode == 0x00EE) return OP_RET;
+            return OP_FALLBACK;
+        case 0x1: return OP_JP;
+        case 0x2: return OP_CALL;
+        case 0x3: return OP_SE_IMM;
+        case 0x4: return OP_SNE_IMM;
+        case 0x5: return N == 0 ? OP_SE_REG : OP_FALLBACK;
+        case 0x6: return OP_LD_IMM;
+        case 0x7: return OP_ADD_IMM;
+        case 0x8:
+            switch (N) {
+                case 0x0: return OP_LD_REG;
+                case 0x1: return OP_OR;
+                case 0x2: return OP_AND;
+                case 0x3: return OP_XOR;
+                case 0x4: return OP_ADD_REG;
+                case 0x5: return OP_SUB;
+                case 0x6: return OP_SHR;
+                case 0x7: return OP_SUBN;
+                case 0xE: return OP_SHL;
+                default:  return OP_FALLBACK;
+            }
+        case 0x9: return N == 0 ? OP_SNE_REG : OP_FALLBACK;
+        case 0xA: return OP_LD_I;
+        case 0xB: return OP_JP_V0;
+        case 0xC: return OP_RND;
+        case 0xD: return OP_DRW;
+        case 0xE:
+            if (NN == 0x9E) return OP_SKP;
+            if (NN == 0xA1) return OP_SKNP;
+            return OP_FALLBACK;
+        default:
+            switch (NN) {
+                case 0x07: return OP_LD_VX_DT;
+                case 0x0A: return OP_LD_KEY;
+                case 0x15: return OP_LD_DT;
+                case 0x18: return OP_LD_ST;
+                case 0x1E: return OP_ADD_I;
+                case 0x29: return OP_LD_F;
+                case 0x33: return OP_BCD;
+                case 0x55: return OP_STORE;
+                case 0x65: return OP_LOAD;
+                default:   return OP_FALLBACK;
+            }
+    }
+}
+
+static uint16_t fetch(const chip8_t *chip8, const uint16_t pc) {
+    return (chip8->ram[pc] << 8) | chip8->ram[pc + 1];
+}
+
+static void decode_one(const chip8_t *chip8, decoded_inst_t *d, const uint16_t pc) {
+    const uint16_t opcode = fetch(chip8, pc);
+    *d = (decoded_inst_t){
+        .handler = decode_handler(opcode),
+        .X = (opcode >> 8) & 0x0F,
+        .Y = (opcode >> 4) & 0x0F,
+        .NN = opcode & 0xFF,
+        .NNN = opcode & 0x0FFF,
+        .opcode = opcode,
+    };
+}
+
+// Fused handler for the sequence starting with handler at pc, and its length; length 1
+//   (handler unchanged) if no sequence starts there
+static uint8_t fuse(const chip8_t *chip8, const uint16_t pc, const uint8_t handler, uint8_t *length) {
+    *length = 1;
+    if (pc + 4 > CHIP8_RAM_SIZE) return handler;
+    const uint16_t second = fetch(chip8, pc + 2);
+
+    if (handler == OP_LD_I && second >> 12 == 0xD) {
+        *length = 2;
+        return OP_FUSE_DRAW;
+    }
+
+    if (pc + 6 > CHIP8_RAM_SIZE) return handler;
+    const uint16_t third = fetch(chip8, pc + 4);
+    if ((handler == OP_ADD_IMM || handler == OP_LD_VX_DT) && second >> 12 == 0x3 && third >> 12 == 0x1) {
+        *length = 3;
+        return handler == OP_ADD_IMM ? OP_FUSE_COUNT_LOOP : OP_FUSE_TIMER_WAIT;
+    }
+    return handler;
+}
+
+// Decode the entry at pc, fused with the instructions after it if they make a sequence
+static void decode(const chip8_t *chip8, decoded_inst_t *d, const uint16_t pc) {
+    decode_one(chip8, d, pc);
+
+    uint8_t length;
+    const uint8_t handler = fuse(chip8, pc, d->handler, &length);
+    for (uint8_t i = 1; i < length; i++) {
+        if (d[i].handler == OP_DECODE) decode_one(chip8, &d[i], pc + 2 * i);
+    }
+    d->handler = handler;
+}
+
+void chip8_predecode(chip8_t *chip8, uint16_t pc) {
+    decoded_inst_t *d = &chip8->icache[(pc >> 1) & (CHIP8_ICACHE_SIZE - 1)];
+    if (d->handler == OP_DECODE) decode(chip8, d, pc & (CHIP8_RAM_SIZE - 2));
+}
+
+#ifdef DEBUG
+// Trace the pre-decoded instruction just executed (the fallbacks trace themselves)
+#define TRACE(d) do { \
+        if (chip8->trace && (d)) chip8_trace_instruction(chip8, ((d) - chip8->icache) * 2, (d)->opcode); \
+    } while (0)
+// Fused handlers run the single instruction handler instead while tracing
+#define TRACING() (chip8->trace != NULL)
+#else
+#define TRACE(d) do { } while (0)
+#define TRACING() false
+#endif
+
+// One copy of the handlers per quirk profile
+#define RUN_CACHED run_cached_vip
+#define QUIRKS CHIP8_QUIRKS_VIP
+#include "chip8_cached_run.h"
+
+#define RUN_CACHED run_cached_schip
+#define QUIRKS CHIP8_QUIRKS_SCHIP
+#include "chip8_cached_run.h"
+
+#define RUN_CACHED run_cached_modern
+#define QUIRKS CHIP8_QUIRKS_MODERN
+#include "chip8_cached_run.h"
+
+uint32_t chip8_run_cached(chip8_t *chip8, uint32_t max_insts) {
+    switch (chip8->quirks) {
+        case CHIP8_QUIRKS_SCHIP:
+            return run_cached_schip(chip8, max_insts);
+        case CHIP8_QUIRKS_MODERN:
+            return run_cached_modern(chip8, max_insts);
+        default:
+            return run_cached_vip(chip8, max_insts);
+    }
+}
@@ -0,0 +1,332 @@
+// Body of the pre-decoded interpreter (chip8_cached.c), which includes it once per quirk
+//   profile with RUN_CACHED naming the function and QUIRKS set to the profile
+
+static uint32_t RUN_CACHED(chip8_t *chip8, uint32_t max_insts) {
+    static const void *const handlers[OP_COUNT] = {
+        [OP_DECODE] = &&op_decode,   [OP_FALLBACK] = &&op_fallback, [OP_SLOW] = &&op_slow,
+        [OP_CLS] = &&op_cls,         [OP_RET] = &&op_ret,           [OP_JP] = &&op_jp,
+        [OP_CALL] = &&op_call,       [OP_SE_IMM] = &&op_se_imm,     [OP_SNE_IMM] = &&op_sne_imm,
+        [OP_SE_REG] = &&op_se_reg,   [OP_LD_IMM] = &&op_ld_imm,     [OP_ADD_IMM] = &&op_add_imm,
+        [OP_LD_REG] = &&op_ld_reg,   [OP_OR] = &&op_or,             [OP_AND] = &&op_and,
+        [OP_XOR] = &&op_xor,         [OP_ADD_REG] = &&op_add_reg,   [OP_SUB] = &&op_sub,
+        [OP_SHR] = &&op_shr,         [OP_SUBN] = &&op_subn,         [OP_SHL] = &&op_shl,
+        [OP_SNE_REG] = &&op_sne_reg, [OP_LD_I] = &&op_ld_i,         [OP_JP_V0] = &&op_jp_v0,
+        [OP_RND] = &&op_rnd,         [OP_DRW] = &&op_drw,           [OP_SKP] = &&op_skp,
+        [OP_SKNP] = &&op_sknp,       [OP_LD_VX_DT] = &&op_ld_vx_dt, [OP_LD_KEY] = &&op_ld_key,
+        [OP_LD_DT] = &&op_ld_dt,     [OP_LD_ST] = &&op_ld_st,       [OP_ADD_I] = &&op_add_i,
+        [OP_LD_F] = &&op_ld_f,       [OP_BCD] = &&op_bcd,           [OP_STORE] = &&op_store,
+        [OP_LOAD] = &&op_load,
+        [OP_FUSE_DRAW] = &&op_fuse_draw,             [OP_FUSE_COUNT_LOOP] = &&op_fuse_count_loop,
+        [OP_FUSE_TIMER_WAIT] = &&op_fuse_timer_wait,
+    };
+
+    // The profile's quirks, constants here: the handlers test them at compile time
+    const chip8_quirk_flags_t q = chip8_quirk_flags[QUIRKS];
+
+    // PC lives in a local while running and is written back whenever something
+    //   outside this function needs it
+    uint8_t *const V = chip8->V;
+    uint16_t pc = chip8->PC;
+    decoded_inst_t *d = NULL;
+    uint32_t n = 0;
+
+// Jump straight to the handler of the pre-decoded entry at PC
+#define DISPATCH() do { \
+        if ((pc & 1) || pc >= CHIP8_RAM_SIZE) goto op_slow; \
+        d = &chip8->icache[pc >> 1]; \
+        pc += 2; \
+        goto *handlers[d->handler]; \
+    } while (0)
+
+// Count the instruction just executed, then dispatch the next one
+#define NEXT() do { \
+        TRACE(d); \
+        if (++n >= max_insts) goto done; \
+        DISPATCH(); \
+    } while (0)
+
+// Count the k instructions a fused handler ran (d is the last one's entry), then
+//   dispatch the next one
+#define NEXT_FUSED(k) do { \
+        n += (k); \
+        if (n >= max_insts) goto done; \
+        DISPATCH(); \
+    } while (0)
+
+    if (max_insts == 0) return 0;
+    DISPATCH();
+
+done:
+    chip8->PC = pc;
+    if (d) chip8->inst.opcode = d->opcode;
+    return n;
+
+op_decode:
+    decode(chip8, d, pc - 2);
+    goto *handlers[d->handler];
+
+op_fallback:
+    // Not worth a handler: rewind and let the reference interpreter run it
+    chip8->PC = pc - 2;
+    emulate_instruction(chip8);
+    pc = chip8->PC;
+    d = NULL;
+    NEXT();
+
+op_slow:
+    // Odd or out of range PC, can't be pre-decoded (the reference interpreter wraps it)
+    chip8->PC = pc;
+    emulate_instruction(chip8);
+    pc = chip8->PC;
+    d = NULL;
+    if (chip8->inst.opcode >> 12 == 0xD) {
+        n++;
+        goto done;
+    }
+    NEXT();
+
+op_cls:
+    //0x00E0: Clear the screen
+    memset(chip8->display, 0, sizeof chip8->display);
+    chip8->dirty_rows = CHIP8_ALL_ROWS;
+    NEXT();
+
+op_ret:
+    //0x00EE: Return from subroutine; an empty stack faults and stays here
+    if (!chip8_pop(chip8, &pc)) pc -= 2;
+    NEXT();
+
+op_jp:
+    //0x1NNN: Jumps to address NNN
+    pc = d->NNN;
+    NEXT();
+
+op_call:
+    //0x2NNN: Call subroutine at NNN; a full stack faults and stays here
+    pc = chip8_push(chip8, pc) ? d->NNN : pc - 2;
+    NEXT();
+
+op_se_imm:
+    // 0x3XNN: Check if VX == NN, if so, skip the next instruction
+    if (V[d->X] == d->NN) pc += 2;
+    NEXT();
+
+op_sne_imm:
+    // 0x4XNN: Check if VX != NN, if so, skip the next instruction
+    if (V[d->X] != d->NN) pc += 2;
+    NEXT();
+
+op_se_reg:
+    // 0x5XY0: Check if VX == VY, if so, skip the next instruction
+    if (V[d->X] == V[d->Y]) pc += 2;
+    NEXT();
+
+op_ld_imm:
+    //0x6XNN: Set register VX to NN.
+    V[d->X] = d->NN;
+    NEXT();
+
+op_add_imm:
+    //0x7XNN: Set register VX += NN.
+    V[d->X] += d->NN;
+    NEXT();
+
+op_ld_reg:
+    // 0x8XY0 Sets VX to the value of VY.
+    V[d->X] = V[d->Y];
+    NEXT();
+
+op_or:
+    // 0x8XY1 Sets VX |= VY, VF reset (vf_reset)
+    V[d->X] |= V[d->Y];
+    if (q.vf_reset) V[0xF] = 0;
+    NEXT();
+
+op_and:
+    // 0x8XY2 Sets VX &= VY, VF reset (vf_reset)
+    V[d->X] &= V[d->Y];
+    if (q.vf_reset) V[0xF] = 0;
+    NEXT();
+
+op_xor:
+    // 0x8XY3 Sets VX ^= VY, VF reset (vf_reset)
+    V[d->X] ^= V[d->Y];
+    if (q.vf_reset) V[0xF] = 0;
+    NEXT();
+
+op_add_reg: {
+    // 0x8XY4 VX += VY, VF = 1 on overflow
+    const uint8_t orig_X = V[d->X];
+    V[d->X] += V[d->Y];
+    V[0xF] = orig_X > V[d->X];
+    NEXT();
+}
+
+op_sub: {
+    // 0x8XY5 VX -= VY, VF = 1 if there is no borrow
+    const bool no_borrow = V[d->X] >= V[d->Y];
+    V[d->X] -= V[d->Y];
+    V[0xF] = no_borrow;
+    NEXT();
+}
+
+op_shr: {
+    // 0x8XY6 VX = VY >> 1 (VX >> 1 with shift_vx), VF = shifted off bit
+    const uint8_t src = V[q.shift_vx ? d->X : d->Y];
+    const bool carry = src & 0x01;
+    V[d->X] = src >> 1;
+    V[0xF] = carry;
+    NEXT();
+}
+
+op_subn: {
+    // 0x8XY7 VX = VY - VX, VF = 1 if there is no borrow
+    const bool no_borrow = V[d->Y] >= V[d->X];
+    V[d->X] = V[d->Y] - V[d->X];
+    V[0xF] = no_borrow;
+    NEXT();
+}
+
+op_shl: {
+    // 0x8XYE VX = VY << 1 (VX << 1 with shift_vx), VF = shifted off bit
+    const uint8_t src = V[q.shift_vx ? d->X : d->Y];
+    const bool carry = src >> 7;
+    V[d->X] = src << 1;
+    V[0xF] = carry;
+    NEXT();
+}
+
+op_sne_reg:
+    //0x9XY0: Skips the next instruction if VX does not equal VY
+    if (V[d->X] != V[d->Y]) pc += 2;
+    NEXT();
+
+op_ld_i:
+    //0xANNN: Set index register I to NNN
+    chip8->I = d->NNN;
+    NEXT();
+
+op_jp_v0:
+    //0xBNNN: Jumps to the address NNN plus V0 (BXNN: plus VX with jump_vx)
+    pc = d->NNN + V[q.jump_vx ? d->X : 0];
+    NEXT();
+
+op_rnd:
+    //0xCXNN: VX = random byte & NN
+    V[d->X] = chip8_rand(chip8) & d->NN;
+    NEXT();
+
+op_drw:
+    //0xDXYN: Draw sprite; only 1 sprite per frame (display wait), so stop here
+    chip8_draw_sprite(chip8, d->X, d->Y, d->NN & 0x0F, q.wrap);
+    TRACE(d);
+    n++;
+    goto done;
+
+op_skp:
+    //0xEX9E: Skips the next instruction if the key stored in VX is pressed
+    if (chip8->keypad[V[d->X] & 0x0F]) pc += 2;
+    NEXT();
+
+op_sknp:
+    //0xEXA1: Skips the next instruction if the key stored in VX is not pressed
+    if (!chip8->keypad[V[d->X] & 0x0F]) pc += 2;
+    NEXT();
+
+op_ld_vx_dt:
+    // 0xFX07: VX = delay timer
+    V[d->X] = chip8->delay_timer;
+    NEXT();
+
+op_ld_key:
+    // 0xFX0A: Await until a keypress & release, and store in VX
+    if (!chip8_wait_key(chip8, d->X)) pc -= 2;
+    NEXT();
+
+op_ld_dt:
+    // 0xFX15: delay timer = VX
+    chip8->delay_timer = V[d->X];
+    NEXT();
+
+op_ld_st:
+    // 0xFX18: sound timer = VX; stop if that starts or stops the tone, chip8_run notes where
+    if ((V[d->X] != 0) != (chip8->sound_timer != 0)) {
+        chip8->sound_timer = V[d->X];
+        TRACE(d);
+        n++;
+        goto done;
+    }
+    chip8->sound_timer = V[d->X];
+    NEXT();
+
+op_add_i:
+    // 0xFX1E: I += VX
+    chip8->I += V[d->X];
+    NEXT();
+
+op_ld_f:
+    // 0xFX29: Set register I to sprite location in memory for character in VX
+    chip8->I = V[d->X] * 5;
+    NEXT();
+
+op_bcd:
+    // 0xFX33: Store BCD representation of VX at I..I+2
+    chip8_store_bcd(chip8, d->X);
+    NEXT();
+
+op_store:
+    // 0xFX55: Register dump V0-VX inclusive to memory offset from I
+    chip8_store_registers(chip8, d->X, q.increment_i);
+    NEXT();
+
+op_load:
+    // 0xFX65: Register load V0-VX inclusive from memory offset from I
+    chip8_load_registers(chip8, d->X, q.increment_i);
+    NEXT();
+
+op_fuse_draw:
+    // ANNN, DXYN: I = NNN, then draw and stop for the display wait like op_drw
+    if (max_insts - n < 2 || TRACING()) goto op_ld_i;
+    chip8->I = d->NNN;
+    d++;
+    chip8_draw_sprite(chip8, d->X, d->Y, d->NN & 0x0F, q.wrap);
+    pc += 2;
+    chip8->fusions[CHIP8_FUSE_DRAW]++;
+    n += 2;
+    goto done;
+
+op_fuse_count_loop:
+    // 7XNN, 3XNN, 1NNN: add, then leave the loop or jump back
+    if (max_insts - n < 3 || TRACING()) goto op_add_imm;
+    V[d->X] += d->NN;
+    chip8->fusions[CHIP8_FUSE_COUNT_LOOP]++;
+    if (V[d[1].X] == d[1].NN) {
+        d++;
+        pc += 4;
+        NEXT_FUSED(2);
+    }
+    d += 2;
+    pc = d->NNN;
+    NEXT_FUSED(3);
+
+op_fuse_timer_wait:
+    // FX07, 3XNN, 1NNN: read the delay timer, then leave the loop or jump back
+    if (max_insts - n < 3 || TRACING()) goto op_ld_vx_dt;
+    V[d->X] = chip8->delay_timer;
+    chip8->fusions[CHIP8_FUSE_TIMER_WAIT]++;
+    if (V[d[1].X] == d[1].NN) {
+        d++;
+        pc += 4;
+        NEXT_FUSED(2);
+    }
+    d += 2;
+    pc = d->NNN;
+    NEXT_FUSED(3);
+
+#undef NEXT_FUSED
+#undef NEXT
+#undef DISPATCH
+}
+
+#undef QUIRKS
+#undef RUN_CACHED
@@ -0,0 +1,617 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chip8_core.h"
+#include "chip8_ops.h"
+
+static const uint8_t font[] = {
+    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+    0x20, 0x60, 0x20, 0x20, 0x70, // 1
+    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
+
+bool chip8_load_rom_file(const char *rom_name, uint8_t *rom, size_t max_size, size_t *rom_size) {
+    FILE* f = fopen(rom_name, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Rom file %s is invalid or does not exist\n", rom_name);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    const size_t size = ftell(f);
+    rewind(f);
+
+    if (max_size < size) {
+        fprintf(stderr, "Rom file %s is too big! Rom size: %zu, Max size allowed: %zu\n",
+            rom_name, size, max_size);
+        fclose(f);
+        return false;
+    }
+
+    if (size > 0 && fread(rom, size, 1, f) != 1) {
+        fprintf(stderr, "Could not read Rom file %s into memory\n", rom_name);
+        fclose(f);
+        return false;
+    }
+
+    fclose(f);
+    *rom_size = size;
+    return true;
+}
+
+bool chip8_init(chip8_t* chip8, const uint8_t *rom, size_t rom_size) {
+    if (rom_size > CHIP8_MAX_ROM_SIZE) return false;
+
+    memset(chip8, 0, sizeof(chip8_t));
+
+    //load Font
+    memcpy(&chip8->ram, font, sizeof(font));
+
+    //load ROM
+    memcpy(&chip8->ram[CHIP8_ENTRY_POINT], rom, rom_size);
+
+    chip8->state = RUNNING;
+    chip8->PC = CHIP8_ENTRY_POINT;
+    chip8->stack_ptr = &chip8->stack[0];
+    chip8->key_wait_key = 0xFF;
+    chip8->dirty_rows = CHIP8_ALL_ROWS;     // Nothing has been drawn for this machine yet
+    chip8_seed(chip8, 0);
+    return true;
+}
+
+void chip8_seed(chip8_t *chip8, uint32_t seed) {
+    chip8->rng = seed ? seed : 0x2545F491;     // xorshift state must not be 0
+}
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+uint64_t chip8_display_hash(const chip8_t *chip8) {
+    return fnv1a(0xCBF29CE484222325ULL, chip8->display, sizeof chip8->display);
+}
+
+uint64_t chip8_state_hash(const chip8_t *chip8) {
+    const uint8_t sp = chip8->stack_ptr - chip8->stack;
+    const uint8_t quirks = chip8->quirks;
+    uint64_t hash = chip8_display_hash(chip8);
+    hash = fnv1a(hash, chip8->ram, sizeof chip8->ram);
+    hash = fnv1a(hash, chip8->V, sizeof chip8->V);
+    hash = fnv1a(hash, &chip8->I, sizeof chip8->I);
+    hash = fnv1a(hash, &chip8->PC, sizeof chip8->PC);
+    hash = fnv1a(hash, &sp, sizeof sp);
+    hash = fnv1a(hash, chip8->stack, sp * sizeof chip8->stack[0]);
+    hash = fnv1a(hash, &chip8->delay_timer, sizeof chip8->delay_timer);
+    hash = fnv1a(hash, &chip8->sound_timer, sizeof chip8->sound_timer);
+    hash = fnv1a(hash, &quirks, sizeof quirks);
+    return hash;
+}
+
+// Invalid opcodes run as no-ops; the core prints nothing (it may run on any thread,
+//   next to a frontend's own output), it counts them for the frontend to report
+static inline void invalid_opcode(chip8_t *chip8) {
+    chip8->invalid_insts++;
+    chip8->invalid_opcode = chip8->inst.opcode;
+}
+
+// The reference interpreter for the quirk profile q. Every caller passes a constant
+//   profile, so each copy it is inlined into below compiles without the quirk tests.
+static inline __attribute__((always_inline)) void interpret(chip8_t *chip8, const chip8_quirk_flags_t q) {
+    //Get next opcode from RAM
+    bool carry;
+    const uint16_t pc = chip8->PC & CHIP8_ADDR_MASK;     // PC wraps around the end of RAM
+    chip8->inst.opcode = (chip8->ram[pc] << 8) | (chip8->ram[(pc + 1) & CHIP8_ADDR_MASK]);
+    chip8->PC = pc + 2;
+
+    //Fill out current instruction format
+    chip8->inst.NNN = chip8->inst.opcode & 0x0FFF;
+    chip8->inst.NN = chip8->inst.opcode & 0x0FF;
+    chip8->inst.N = chip8->inst.opcode & 0x0F;
+    chip8->inst.X = (chip8->inst.opcode >> 8) & 0x0F;
+    chip8->inst.Y = (chip8->inst.opcode >> 4) & 0x0F;
+
+    switch ((chip8->inst.opcode >> 12) & 0x0F) {
+        case 0x00:
+            if (chip8->inst.NN == 0xE0) {
+                //0x00E0: Clear the screen 
+                memset(chip8->display, 0, sizeof chip8->display);
+                chip8->dirty_rows = CHIP8_ALL_ROWS;  // Will update screen on next 60hz tick
+            } else if (chip8->inst.NN == 0xEE) {
+                //0x00EE: Return from subroutine 
+                //Set program counter to last address on subroutine stack ("pop" it off the stack)
+                if (!chip8_pop(chip8, &chip8->PC)) chip8->PC -= 2;   // Empty stack: stay on the fault
+            } else {
+                //0x0NNN: Machine code routine on the RCA1802, not emulated
+                invalid_opcode(chip8);
+            }
+            break;
+
+        case 0x01:
+            //0x1NNN: Jumps to address NNN
+            chip8->PC = chip8->inst.NNN; // Set the program counter so that the next opcode is from NNN
+            break;
+
+        case 0x02:
+            //0x2NNN: Call subroutine at NNN   (like jump register in MIPS: jumps to next instructions)
+            //Store current address to return to on subroutine stack 
+            //  and set program counter to subroutine address so that 
+            //  the next opcode is gotten from there
+            if (chip8_push(chip8, chip8->PC)) {
+                chip8->PC = chip8->inst.NNN;   //jumps to the next instruction
+            } else {
+                chip8->PC -= 2;                // Full stack: stay on the fault
+            }
+            break;
+
+        case 0x03:
+            // 0x3XNN: Check if VX == NN, if so, skip the next instruction
+            if (chip8->V[chip8->inst.X] == chip8->inst.NN) {
+                chip8->PC += 2;
+            }
+            break;
+
+        case 0x04:
+            // 0x4XNN: Check if VX != NN, if so, skip the next instruction
+            if (chip8->V[chip8->inst.X] != chip8->inst.NN) {
+                chip8->PC += 2;
+            }
+            break;
+            
+        case 0x05:
+            // 0x5XNN: Check if VX != NN, if so, skip the next instruction
+            if (chip8->inst.N != 0) break; // Wrong opcode
+
+            if (chip8->V[chip8->inst.X] == chip8->V[chip8->inst.Y]) {
+                chip8->PC += 2;
+            }
+            break;
+
+        case 0x06:
+            //0x6XNN: Set register VX to NN.
+            chip8->V[chip8->inst.X] = chip8->inst.NN;
+            break;
+
+        case 0x07:
+            //0x7XNN: Set register VX += NN.
+            chip8->V[chip8->inst.X] += chip8->inst.NN;
+            break;
+
+        case 0x08:
+            //0x8XNN: 
+            if (chip8->inst.N == 0) {
+                // 0x8XY0 Sets VX to the value of VY.
+                chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y];
+            } else if (chip8->inst.N == 1) {
+                // 0x8XY1 Sets VX to VX or VY. (bitwise OR operation)
+                chip8->V[chip8->inst.X] |= chip8->V[chip8->inst.Y];
+                if (q.vf_reset) chip8->V[0xF] = 0;
+            } else if (chip8->inst.N == 2) {
+                // 0x8XY2 Sets VX to VX and VY. (bitwise AND operation)
+                chip8->V[chip8->inst.X] &= chip8->V[chip8->inst.Y];
+                if (q.vf_reset) chip8->V[0xF] = 0;
+            } else if (chip8->inst.N == 3) {
+                // 0x8XY3 Sets VX to VX xor VY
+                chip8->V[chip8->inst.X] ^= chip8->V[chip8->inst.Y];
+                if (q.vf_reset) chip8->V[0xF] = 0;
+            } else if (chip8->inst.N == 4) {
+                // 0x8XY4 Adds VY to VX. VF is set to 1 when there's an overflow, and to 0 when there is not
+                uint8_t orig_X = chip8->V[chip8->inst.X];
+                chip8->V[chip8->inst.X] += chip8->V[chip8->inst.Y];
+                if (orig_X > chip8->V[chip8->inst.X]) { //overflow
+                    chip8->V[0xF] = 1;
+                } else {
+                    chip8->V[0xF] = 0;
+                }
+            } else if (chip8->inst.N == 5) {
+                // 0x8XY5 VY is subtracted from VX. VF is set to 0 when there's an underflow, and 1 when there is not. (i.e. VF set to 1 if VX >= VY and 0 if not)
+                if (chip8->V[chip8->inst.X] >= chip8->V[chip8->inst.Y]) {
+                    chip8->V[chip8->inst.X] -= chip8->V[chip8->inst.Y];
+                    chip8->V[0xF] = 1;
+                } else {
+                    chip8->V[chip8->inst.X] -= chip8->V[chip8->inst.Y];  //the order has to be before the chip8->V[0xF] = 0;
+                    chip8->V[0xF] = 0;
+                }
+            } else if (chip8->inst.N == 6) {
+                // 0x8XY6 Stores the least significant bit of VY (VX with shift_vx) in VF and
+                //   then stores it shifted to the right by 1 in VX
+                const uint8_t src = q.shift_vx ? chip8->inst.X : chip8->inst.Y;
+                carry = chip8->V[src] & 0x01;
+                chip8->V[chip8->inst.X] = chip8->V[src] >> 1;
+                chip8->V[0xF] = carry;
+            } else if (chip8->inst.N == 7) {
+                // 0x8XY7 Sets VX to VY minus VX. VF is set to 0 when there's an underflow, and 1 when there is not. (i.e. VF set to 1 if VY >= VX)
+                if (chip8->V[chip8->inst.Y] >= chip8->V[chip8->inst.X]) {
+                    chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y] - chip8->V[chip8->inst.X];
+                    chip8->V[0xF] = 1;
+                } else {
+                    chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y] - chip8->V[chip8->inst.X];
+                    chip8->V[0xF] = 0;
+                }
+            } else if (chip8->inst.N == 0xE) {
+                // 0x8XYE Stores the most significant bit of VY (VX with shift_vx) in VF and
+                //   then stores it shifted to the left by 1 in VX
+                const uint8_t src = q.shift_vx ? chip8->inst.X : chip8->inst.Y;
+                carry = chip8->V[src] >> 7;
+                chip8->V[chip8->inst.X] = chip8->V[src] << 1;
+                chip8->V[0xF] = carry;
+            } else {
+                invalid_opcode(chip8);
+            }
+            break;
+
+        case 0x09:
+            //0x9XY0: Skips the next instruction if VX does not equal VY. (Usually the next instruction is a jump to skip a code block)
+            if (chip8->inst.N != 0) break; // Wrong opcode
+
+            if (chip8->V[chip8->inst.X] != chip8->V[chip8->inst.Y]) {
+                chip8->PC += 2;
+            }
+            break;
+
+        case 0x0A:
+            //0xANNN: Set index register I to NNN
+            chip8->I = chip8->inst.NNN;
+            break;
+
+        case 0x0B:
+            //0xBNNN: Jumps to the address NNN plus V0 (BXNN: plus VX with jump_vx)
+            chip8->PC = chip8->inst.NNN + chip8->V[q.jump_vx ? chip8->inst.X : 0];
+            break;
+
+        case 0x0C:
+            //0xCXNN: Sets VX to the result of a bitwise and operation on a random number (Typically: 0 to 255) and NN.
+            chip8->V[chip8->inst.X] = chip8_rand(chip8) & chip8->inst.NN;
+            break;
+        
+        case 0x0D:
+            //0xDXYN: Draw N-height sprite at coordinate VX, VY; VF = collision
+            chip8_draw_sprite(chip8, chip8->inst.X, chip8->inst.Y, chip8->inst.N, q.wrap);
+            break;
+
+        case 0x0E:
+            if (chip8->inst.NN == 0x9E) {
+                //Skips the next instruction if the key stored in VX is pressed
+                if (chip8->keypad[chip8->V[chip8->inst.X] & 0x0F]) {
+                    chip8->PC += 2;
+                }
+            } else if (chip8->inst.NN == 0xA1) {
+                //Skips the next instruction if the key stored in VX is pressed
+                if (!chip8->keypad[chip8->V[chip8->inst.X] & 0x0F]) {
+                    chip8->PC += 2;
+                }
+            } else {
+                invalid_opcode(chip8);
+            }
+            break;
+
+        case 0x0F:
+            switch (chip8->inst.NN) {
+                case 0x0A:
+                    // 0xFX0A: VX = get_key(); Await until a keypress & release, and store in VX
+                    if (!chip8_wait_key(chip8, chip8->inst.X)) {
+                        chip8->PC -= 2;
+                    }
+                    break;
+
+                case 0x1E:
+                    chip8->I += chip8->V[chip8->inst.X];
+                    break;
+
+                case 0x07:
+                    // 0xFX07: VX = delay timer
+                    chip8->V[chip8->inst.X] = chip8->delay_timer;
+                    break;
+
+                case 0x15:
+                    // 0xFX15: delay timer = VX
+                    chip8->delay_timer = chip8->V[chip8->inst.X];
+                    break;
+
+                case 0x18:
+                    // 0xFX18: sound timer = VX
+                   chip8->sound_timer =  chip8->V[chip8->inst.X];
+                    break;
+
+                case 0x29:
+                    // 0xFX29: Set register I to sprite location in memory for character in VX (0x0-0xF)
+                    chip8->I = chip8->V[chip8->inst.X] * 5;
+                    break;
+
+                case 0x33:
+                    // 0xFX33: Store BCD representation of VX at memory offset from I
+                    chip8_store_bcd(chip8, chip8->inst.X);
+                    break;
+
+                case 0x55:
+                    // 0xFX55: Register dump V0-VX inclusive to memory offset from I
+                    chip8_store_registers(chip8, chip8->inst.X, q.increment_i);
+                    break;
+
+                case 0x65:
+                    // 0xFX65: Register load V0-VX inclusive from memory offset from I
+                    chip8_load_registers(chip8, chip8->inst.X, q.increment_i);
+                    break;
+
+                default:
+                    invalid_opcode(chip8);
+                    break;
+            }
+            break;
+    }
+
+#ifdef DEBUG
+    if (chip8->trace) chip8_trace_instruction(chip8, pc, chip8->inst.opcode);
+#endif
+}
+
+static void interpret_vip(chip8_t *chip8) { interpret(chip8, chip8_quirk_flags[CHIP8_QUIRKS_VIP]); }
+static void interpret_schip(chip8_t *chip8) { interpret(chip8, chip8_quirk_flags[CHIP8_QUIRKS_SCHIP]); }
+static void interpret_modern(chip8_t *chip8) { interpret(chip8, chip8_quirk_flags[CHIP8_QUIRKS_MODERN]); }
+
+static const chip8_interpreter_t interpreters[CHIP8_QUIRK_PROFILES] = {
+    [CHIP8_QUIRKS_VIP] = interpret_vip,
+    [CHIP8_QUIRKS_SCHIP] = interpret_schip,
+    [CHIP8_QUIRKS_MODERN] = interpret_modern,
+};
+
+chip8_interpreter_t chip8_interpreter(chip8_quirks_t quirks) {
+    return interpreters[quirks];
+}
+
+void emulate_instruction(chip8_t *chip8) {
+    interpreters[chip8->quirks](chip8);
+}
+
+static const char *const quirk_names[CHIP8_QUIRK_PROFILES] = {
+    [CHIP8_QUIRKS_VIP] = "vip",
+    [CHIP8_QUIRKS_SCHIP] = "schip",
+    [CHIP8_QUIRKS_MODERN] = "modern",
+};
+
+void chip8_set_quirks(chip8_t *chip8, chip8_quirks_t quirks) {
+    chip8->quirks = quirks < CHIP8_QUIRK_PROFILES ? quirks : CHIP8_QUIRKS_VIP;
+    chip8->data_pages = 0;              // A ROM map is for one profile: apply it after this
+    if (chip8->jit) {
+        chip8_jit_reset(chip8->jit);     // Blocks were translated with the previous quirks
+        chip8->jit_pages = 0;
+    }
+}
+
+bool chip8_quirks_from_name(const char *name, chip8_quirks_t *quirks) {
+    for (uint32_t i = 0; i < CHIP8_QUIRK_PROFILES; i++) {
+        if (strcmp(name, quirk_names[i]) == 0) {
+            *quirks = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *chip8_quirks_name(chip8_quirks_t quirks) {
+    return quirks < CHIP8_QUIRK_PROFILES ? quirk_names[quirks] : "?";
+}
+
+const char *chip8_fault_name(chip8_fault_t fault) {
+    static const char *const names[CHIP8_FAULTS] = {
+        [CHIP8_FAULT_NONE] = "none",
+        [CHIP8_FAULT_STACK_OVERFLOW] = "stack overflow",
+        [CHIP8_FAULT_STACK_UNDERFLOW] = "stack underflow",
+    };
+    return fault < CHIP8_FAULTS ? names[fault] : "?";
+}
+
+bool chip8_set_backend(chip8_t *chip8, chip8_backend_t backend, chip8_jit_t *jit) {
+    chip8->jit = NULL;
+    chip8->jit_pages = 0;
+
+    if (backend == CHIP8_BACKEND_JIT) {
+        if (jit == NULL) {
+            chip8->backend = CHIP8_BACKEND_CACHED;
+            return false;
+        }
+        chip8_jit_reset(jit);       // Blocks were translated from the previous RAM contents
+        chip8->jit = jit;
+    }
+    chip8->backend = backend;
+    return true;
+}
+
+bool chip8_backend_from_name(const char *name, chip8_backend_t *backend) {
+    if (strcmp(name, "interpreter") == 0) *backend = CHIP8_BACKEND_INTERPRETER;
+    else if (strcmp(name, "cached") == 0) *backend = CHIP8_BACKEND_CACHED;
+    else if (strcmp(name, "jit") == 0) *backend = CHIP8_BACKEND_JIT;
+    else return false;
+    return true;
+}
+
+const char *chip8_backend_name(chip8_backend_t backend) {
+    switch (backend) {
+        case CHIP8_BACKEND_INTERPRETER: return "interpreter";
+        case CHIP8_BACKEND_CACHED: return "cached";
+        case CHIP8_BACKEND_JIT: return "jit";
+        default: return "?";
+    }
+}
+
+void chip8_step(chip8_t *chip8) {
+#ifdef CHIP8_PROFILE
+    if (chip8->profile) {
+        chip8_run_profiled(chip8, 1);
+        return;
+    }
+#endif
+    switch (chip8->backend) {
+        case CHIP8_BACKEND_CACHED:
+            chip8_run_cached(chip8, 1);
+            break;
+        case CHIP8_BACKEND_JIT:
+            chip8_run_jit(chip8, 1);
+            break;
+        default:
+            emulate_instruction(chip8);
+            break;
+    }
+}
+
+#define IDLE_CHECK_INTERVAL 1024    // Instructions run between idle loop checks
+
+static uint16_t fetch(const chip8_t *chip8, uint32_t addr) {
+    return addr + 1 < CHIP8_RAM_SIZE ? (chip8->ram[addr] << 8) | chip8->ram[addr + 1] : 0;
+}
+
+// Would FX0A leave the machine as it is? Yes with no key down and none pressed before,
+//   or with the pressed key still held and no lower one down (the lowest one wins)
+static bool key_wait_idle(const chip8_t *chip8) {
+    for (uint8_t key = 0; key < sizeof chip8->keypad; key++) {
+        if (chip8->keypad[key]) return chip8->key_wait_pressed && chip8->key_wait_key == key;
+    }
+    return !chip8->key_wait_pressed;
+}
+
+// Keys and timers only change between runs, so a machine in one of these loops goes
+//   around it until the budget runs out. Skip whole iterations of it: returns the
+//   instructions skipped, 0 if the machine isn't in an idle loop at PC.
+static uint32_t skip_idle(chip8_t *chip8, uint32_t budget) {
+#ifdef DEBUG
+    if (chip8->trace) return 0;     // Traces show every instruction
+#endif
+    const uint16_t pc = chip8->PC;
+    const uint16_t opcode = fetch(chip8, pc);
+
+    // A faulted machine only runs into the same fault again
+    if (chip8->fault) {
+        chip8->inst.opcode = opcode;
+        return budget;
+    }
+
+    // 1NNN to itself
+    if (opcode == (0x1000 | pc)) {
+        chip8->inst.opcode = opcode;
+        return budget;
+    }
+
+    // FX0A with nothing to change until a key goes down or up
+    if ((opcode & 0xF0FF) == 0xF00A && key_wait_idle(chip8)) {
+        chip8->inst.opcode = opcode;
+        return budget;
+    }
+
+    // FX07, then 3XNN or 4XNN not skipping the 1NNN back to the FX07: every iteration
+    //   after the first just reads the same delay timer value again
+    if ((opcode & 0xF0FF) == 0xF007 && budget >= 3) {
+        const uint8_t X = (opcode >> 8) & 0x0F;
+        const uint16_t test = fetch(chip8, pc + 2), jump = fetch(chip8, pc + 4);
+        const uint8_t NN = test & 0xFF;
+        const bool loops = jump == (0x1000 | pc) &&
+            (((test & 0xFF00) == (0x3000 | X << 8) && chip8->delay_timer != NN) ||
+             ((test & 0xFF00) == (0x4000 | X << 8) && chip8->delay_timer == NN));
+        if (loops) {
+            chip8->V[X] = chip8->delay_timer;
+            chip8->inst.opcode = jump;
+            return budget - budget % 3;
+        }
+    }
+    return 0;
+}
+
+// The selected backend alone
+static uint32_t run_backend(chip8_t *chip8, uint32_t max_insts) {
+    uint32_t i = 0;
+    switch (chip8->backend) {
+        case CHIP8_BACKEND_CACHED:
+            i = chip8_run_cached(chip8, max_insts);
+            break;
+        case CHIP8_BACKEND_JIT:
+            i = chip8_run_jit(chip8, max_insts);
+            break;
+        default: {
+            const chip8_interpreter_t interpret_one = interpreters[chip8->quirks];
+            const bool tone = chip8->sound_timer != 0;
+            while (i < max_insts) {
+                interpret_one(chip8);
+                i++;
+
+                // If drawing on CHIP8, only draw 1 sprite this frame (display wait)
+                if (chip8->inst.opcode >> 12 == 0xD)
+                    break;
+                // FX18 started or stopped the tone: chip8_run notes where
+                if ((chip8->sound_timer != 0) != tone)
+                    break;
+            }
+            break;
+        }
+    }
+    return i;
+}
+
+uint32_t chip8_run(chip8_t *chip8, uint32_t max_insts) {
+    chip8->sound_edge = 0;
+#ifdef CHIP8_PROFILE
+    if (chip8->profile) return chip8_run_profiled(chip8, max_insts);
+#endif
+    uint32_t i = 0;
+    while (i < max_insts) {
+        const uint32_t idle = skip_idle(chip8, max_insts - i);
+        if (idle) {
+            i += idle;
+            chip8->idle_insts += idle;
+            continue;
+        }
+
+        // Translated blocks don't set inst; clear it so a DXYN from before isn't seen again
+        const uint32_t chunk = max_insts - i < IDLE_CHECK_INTERVAL ? max_insts - i : IDLE_CHECK_INTERVAL;
+        chip8->inst.opcode = 0;
+        const bool tone = chip8->sound_timer != 0;
+        const uint32_t n = run_backend(chip8, chunk);
+        i += n;
+
+        // The backends also stop right after an FX18 that starts or stops the tone
+        const bool edge = (chip8->sound_timer != 0) != tone;
+        if (edge) chip8->sound_edge = i;
+        if (chip8->inst.opcode >> 12 == 0xD || (n < chunk && !edge)) break;    // Display wait
+    }
+    return i;
+}
+
+uint32_t chip8_run_frame(chip8_t *chip8, uint32_t insts_per_frame) {
+    const uint32_t i = chip8_run(chip8, insts_per_frame);
+
+    // Update delay & sound timers every 60hz
+    chip8_update_timers(chip8);
+    return i;
+}
+
+uint32_t chip8_frame_insts(uint32_t insts_per_second, uint64_t frame) {
+    return (frame + 1) * insts_per_second / 60 - frame * insts_per_second / 60;
+}
+
+bool chip8_update_timers(chip8_t *chip8) {
+    if (chip8->delay_timer > 0) {
+        chip8->delay_timer--;
+    }
+
+    if (chip8->sound_timer > 0) {
+        chip8->sound_timer--;
+        chip8->sound_on = true;    //play the sound
+    } else {
+        chip8->sound_on = false;   //pause the sound
+    }
+    return chip8->sound_on;
+}
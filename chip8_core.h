@@ -0,0 +1,513 @@
+#ifndef CHIP8_CORE_H
+#define CHIP8_CORE_H
+
+// Headless CHIP8 core: the machine state and the CPU, with no SDL, no globals and
+//   no hidden statics, so any number of machines can run side by side in one process.
+//   The SDL frontend (chip8.c) is just one client of this library.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CHIP8_DISPLAY_WIDTH  64     // CHIP8 original X resolution
+#define CHIP8_DISPLAY_HEIGHT 32     // CHIP8 original Y resolution
+#define CHIP8_RAM_SIZE       4096
+#define CHIP8_ADDR_MASK      (CHIP8_RAM_SIZE - 1)   // Addresses are 12 bits
+#define CHIP8_ENTRY_POINT    0x200  // CHIP8 ROM will be loaded to 0x200
+#define CHIP8_MAX_ROM_SIZE   (CHIP8_RAM_SIZE - CHIP8_ENTRY_POINT)
+#define CHIP8_ICACHE_SIZE    (CHIP8_RAM_SIZE / 2)   // One pre-decoded entry per even address
+#define CHIP8_ALL_ROWS       0xFFFFFFFFu            // dirty_rows with every display row set
+#define CHIP8_STACK_DEPTH    12     // Subroutine calls that can be nested
+
+typedef enum {
+    QUIT,
+    RUNNING,
+    PAUSED,
+} emulator_state_t;
+
+// Why a machine stopped. No ROM can make the core touch memory outside the machine:
+//   PC wraps to 12 bits when an instruction is fetched, the RAM addresses DXYN, FX33,
+//   FX55 and FX65 compute from I wrap the same way, and EX9E/EXA1 look up the key in
+//   the low 4 bits of VX. The stack is the one thing that can't wrap, so a call with a
+//   full stack or a return with an empty one faults instead: the instruction doesn't
+//   run, PC stays on it and chip8->fault says why. Running a faulted machine just
+//   faults again (chip8_run fast-forwards it like an idle loop) until chip8_init or
+//   chip8_load_state, which clear the fault.
+typedef enum {
+    CHIP8_FAULT_NONE,
+    CHIP8_FAULT_STACK_OVERFLOW,     // 2NNN with CHIP8_STACK_DEPTH calls nested
+    CHIP8_FAULT_STACK_UNDERFLOW,    // 00EE with no call to return from
+    CHIP8_FAULTS,
+} chip8_fault_t;
+
+//CHIP8 Instructions
+typedef struct {
+    uint16_t opcode;
+    uint16_t NNN;          //12 bit address/constants
+    uint8_t NN;            //8 bit constant
+    uint8_t N;             //4 bit constant
+    uint8_t X;             //4 bit register identifier
+    uint8_t Y;             //4 bit register identifier
+} instruction_t;
+
+// Which execution engine chip8_step/chip8_run_frame use
+typedef enum {
+    CHIP8_BACKEND_INTERPRETER,  // Reference interpreter: emulate_instruction
+    CHIP8_BACKEND_CACHED,       // Pre-decoded instruction cache with threaded dispatch
+    CHIP8_BACKEND_JIT,          // x86-64 recompiler for basic blocks, cached interpreter for the rest
+} chip8_backend_t;
+
+// Quirk profiles: the behaviours CHIP8 interpreters disagree on. Every profile has its
+//   own compiled copy of the interpreters, so no instruction tests a quirk while running.
+typedef enum {
+    CHIP8_QUIRKS_VIP,       // COSMAC VIP: 8XY6/8XYE shift VY, 8XY1-3 reset VF, FX55/FX65
+                            //   increment I, BNNN adds V0, sprites clip at the screen edges
+    CHIP8_QUIRKS_SCHIP,     // SUPER-CHIP 1.1: shifts VX in place, VF kept, I unchanged,
+                            //   BXNN adds VX, sprites clip
+    CHIP8_QUIRKS_MODERN,    // Octo / XO-CHIP: as the VIP, but VF kept and sprites wrap around
+    CHIP8_QUIRK_PROFILES,
+} chip8_quirks_t;
+
+// Recompiler state (code arena + translated blocks), owned by the caller; see chip8_jit.c
+typedef struct chip8_jit chip8_jit_t;
+
+// Instruction sequences the cached backend runs as one handler (superinstructions)
+typedef enum {
+    CHIP8_FUSE_DRAW,            // ANNN, DXYN: point I at a sprite and draw it
+    CHIP8_FUSE_COUNT_LOOP,      // 7XNN, 3XNN, 1NNN: count a register, loop until it reads NN
+    CHIP8_FUSE_TIMER_WAIT,      // FX07, 3XNN, 1NNN: loop until the delay timer reads NN
+    CHIP8_FUSIONS,
+} chip8_fusion_t;
+
+// Pre-decoded instruction: handler index plus operands, decoded once per address
+typedef struct {
+    uint8_t handler;       // Index into the handler table, 0 = not decoded yet
+    uint8_t X;             //4 bit register identifier
+    uint8_t Y;             //4 bit register identifier
+    uint8_t NN;            //8 bit constant (N is NN & 0x0F)
+    uint16_t NNN;          //12 bit address/constants
+    uint16_t opcode;
+} decoded_inst_t;
+
+//CHIP8 Machine Project
+//  Note: stack_ptr points into this struct, so a chip8_t must not be copied by value
+typedef struct {
+    emulator_state_t state;
+    uint8_t ram[CHIP8_RAM_SIZE];
+    uint64_t display[CHIP8_DISPLAY_HEIGHT];  //One word per row, bit 63 is the leftmost pixel
+    uint16_t stack[CHIP8_STACK_DEPTH];  //Subroutine stack
+    uint16_t *stack_ptr;       //Stack pointer
+    uint8_t V[16];             //Data registers V0-VF
+    uint16_t I;                //Index registers
+    uint16_t PC;               //Program Counter
+    uint8_t delay_timer;       //Decrements at 60hz when > 0
+    uint8_t sound_timer;       //Decrements at 60hz and plays tone when > 0
+    bool keypad[16];           //Hexadecimal keypad 0x0 - 0xF
+    instruction_t inst;        //Currently executing instructions
+    uint32_t dirty_rows;       // Display rows changed since the frontend last drew (bit per row)
+    bool sound_on;             // Sound timer was active on the last 60hz tick
+    uint32_t sound_edge;       // chip8_run: instructions it had run when an FX18 last started
+                               //   or stopped the tone (sound timer 0 <-> not 0), 0 if none did
+    bool key_wait_pressed;     // FX0A: a key went down while waiting for a release
+    uint8_t key_wait_key;      // FX0A: the key that went down, 0xFF if none
+    chip8_fault_t fault;       // Why the machine stopped, CHIP8_FAULT_NONE while it runs
+    uint32_t rng;              // CXNN: per-machine xorshift32 state, never 0
+    chip8_backend_t backend;   // Execution engine; set with chip8_set_backend after chip8_init
+    chip8_quirks_t quirks;     // Quirk profile; set with chip8_set_quirks after chip8_init
+    chip8_jit_t *jit;          // Recompiler used by CHIP8_BACKEND_JIT
+    uint16_t jit_pages;        // Bitmask of 256 byte RAM pages holding translated code
+    uint16_t data_pages;       // RAM pages a ROM map proved data-only: FX33/FX55 write
+                               //   them without looking for code to throw away
+    struct chip8_profile *profile;  // Guest profiler counters (CHIP8_PROFILE builds), NULL = off
+    struct chip8_trace *trace; // Instruction trace (DEBUG builds), NULL = off
+    uint64_t idle_insts;       // Instructions chip8_run fast-forwarded through idle loops
+    uint64_t invalid_insts;    // Invalid opcodes (0NNN, 8XY8...) run as no-ops
+    uint16_t invalid_opcode;   // The last of them
+    uint64_t fusions[CHIP8_FUSIONS];  // Fused sequences the cached backend ran, by kind
+    decoded_inst_t icache[CHIP8_ICACHE_SIZE];  // Pre-decoded instructions for even addresses
+} chip8_t;
+
+_Static_assert(CHIP8_DISPLAY_WIDTH == 64, "a display row must fit one uint64_t");
+_Static_assert(CHIP8_DISPLAY_HEIGHT == 32, "dirty_rows has one bit per display row");
+
+// Is the pixel at (x, y) on?
+static inline bool chip8_pixel(const chip8_t *chip8, uint32_t x, uint32_t y) {
+    return (chip8->display[y] >> (CHIP8_DISPLAY_WIDTH - 1 - x)) & 1;
+}
+
+// Read a ROM file into rom (at most max_size bytes); reports errors on stderr
+bool chip8_load_rom_file(const char *rom_name, uint8_t *rom, size_t max_size, size_t *rom_size);
+
+// Reset the machine: clear it, load the font and copy the ROM image to 0x200
+bool chip8_init(chip8_t *chip8, const uint8_t *rom, size_t rom_size);
+
+// Seed the machine's CXNN random number generator
+void chip8_seed(chip8_t *chip8, uint32_t seed);
+
+// Hash the architectural state (RAM, display, registers, stack, timers, quirk profile)
+//   or just the display, for comparing runs (64 bit FNV-1a)
+uint64_t chip8_state_hash(const chip8_t *chip8);
+uint64_t chip8_display_hash(const chip8_t *chip8);
+
+// Select the execution engine; call after chip8_init. CHIP8_BACKEND_JIT needs a
+//   recompiler from chip8_jit_create (it is flushed here); without one, or on hosts
+//   without a recompiler, falls back to CHIP8_BACKEND_CACHED and returns false.
+bool chip8_set_backend(chip8_t *chip8, chip8_backend_t backend, chip8_jit_t *jit);
+
+// Parse a backend name ("interpreter", "cached" or "jit"), and back
+bool chip8_backend_from_name(const char *name, chip8_backend_t *backend);
+const char *chip8_backend_name(chip8_backend_t backend);
+
+// Select the quirk profile (chip8_init selects CHIP8_QUIRKS_VIP); translated code and
+//   what a ROM map proved are dropped, they were for the previous profile
+void chip8_set_quirks(chip8_t *chip8, chip8_quirks_t quirks);
+
+// Parse a quirk profile name ("vip", "schip" or "modern"), and back
+bool chip8_quirks_from_name(const char *name, chip8_quirks_t *quirks);
+const char *chip8_quirks_name(chip8_quirks_t quirks);
+
+// What a fault means ("stack overflow"...; "none" for CHIP8_FAULT_NONE)
+const char *chip8_fault_name(chip8_fault_t fault);
+
+// Create/destroy a recompiler; chip8_jit_create returns NULL on unsupported hosts
+chip8_jit_t *chip8_jit_create(void);
+void chip8_jit_destroy(chip8_jit_t *jit);
+
+// Fetch, decode & execute one instruction with the reference interpreter (the copy
+//   compiled for the machine's quirk profile)
+void emulate_instruction(chip8_t *chip8);
+
+// Run up to max_insts instructions from the pre-decoded instruction cache, stopping
+//   early after a DXYN. Returns the number of instructions executed.
+//   The chip8_fusion_t sequences run as one handler when the whole sequence fits in
+//   the budget and no trace is attached, counted in chip8->fusions.
+uint32_t chip8_run_cached(chip8_t *chip8, uint32_t max_insts);
+
+// Opcodes of a fused sequence, e.g. "ANNN+DXYN"
+const char *chip8_fusion_name(chip8_fusion_t fusion);
+
+// Run up to max_insts instructions with the recompiler, stopping early after a DXYN.
+//   Translated blocks only run when they fit in the remaining budget.
+uint32_t chip8_run_jit(chip8_t *chip8, uint32_t max_insts);
+
+// Execute one instruction with the selected backend
+void chip8_step(chip8_t *chip8);
+
+// Run up to max_insts instructions with the selected backend, stopping early after a
+//   DXYN; no timer ticks. Returns the number of instructions executed. Where an FX18
+//   started or stopped the tone is left in chip8->sound_edge, so frontends can place
+//   the edge on the right sample.
+//   Idle loops (1NNN to itself, FX0A still waiting, FX07 / 3XNN or 4XNN / 1NNN back
+//   polling the delay timer) can't end before the next timer tick or key event, so
+//   whole iterations of them are skipped, leaving the state running them would have;
+//   they count as executed, and in chip8->idle_insts.
+uint32_t chip8_run(chip8_t *chip8, uint32_t max_insts);
+
+// Run one 60hz frame: up to insts_per_frame instructions (stopping early after a
+//   DXYN, the original "display wait"), then tick the timers.
+//   Returns the number of instructions executed.
+uint32_t chip8_run_frame(chip8_t *chip8, uint32_t insts_per_frame);
+
+// Instruction budget of frame number frame at insts_per_second: insts_per_second / 60
+//   with the remainder spread over the frames, so every 60 frames run exactly
+//   insts_per_second instructions (integer math: replays get the same budgets)
+uint32_t chip8_frame_insts(uint32_t insts_per_second, uint64_t frame);
+
+// Tick the delay & sound timers once (60hz); returns true while the tone should play
+bool chip8_update_timers(chip8_t *chip8);
+
+// Save states: the architectural machine state in a fixed binary layout (host byte
+//   order), so saving is one copy and a file of states can be mapped and used in place.
+//   Frontend state (pixel colors, pause...) is not part of it. Files may hold any
+//   number of states back to back (e.g. concatenated with cat).
+#define CHIP8_STATE_MAGIC   0x53503843u    // "C8PS" in a little endian file
+#define CHIP8_STATE_VERSION 2
+
+#define CHIP8_STATE_SOUND_ON         0x01  // chip8_state_t.flags
+#define CHIP8_STATE_KEY_WAIT_PRESSED 0x02
+
+typedef struct {
+    uint32_t magic;            // CHIP8_STATE_MAGIC; also catches a foreign byte order
+    uint16_t version;          // CHIP8_STATE_VERSION
+    uint16_t size;             // sizeof(chip8_state_t)
+    uint64_t display[CHIP8_DISPLAY_HEIGHT];
+    uint8_t ram[CHIP8_RAM_SIZE];
+    uint16_t stack[12];
+    uint32_t rng;
+    uint16_t I;
+    uint16_t PC;
+    uint16_t keypad;           // Bit per key
+    uint8_t V[16];
+    uint8_t stack_index;       // Stack entries in use, instead of the stack_ptr pointer
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    uint8_t flags;             // CHIP8_STATE_*
+    uint8_t key_wait_key;
+    uint8_t quirks;            // chip8_quirks_t the machine runs with
+} chip8_state_t;
+
+_Static_assert(sizeof(chip8_state_t) == 4416, "save state layout must not change within a version");
+_Static_assert(CHIP8_STACK_DEPTH == 12, "chip8_state_t.stack holds the whole stack");
+
+// Snapshot a machine
+void chip8_save_state(const chip8_t *chip8, chip8_state_t *state);
+
+// Restore a snapshot into a machine (any backend; only RAM pages that differ are
+//   copied and have their decoded/translated code dropped), quirk profile included.
+//   False if state isn't a valid state of this version, leaving the machine untouched.
+bool chip8_load_state(chip8_t *chip8, const chip8_state_t *state);
+
+// Write one state to a file / read the index'th state of a file; errors on stderr
+bool chip8_save_state_file(const chip8_t *chip8, const char *path);
+bool chip8_load_state_file(chip8_t *chip8, const char *path, size_t index);
+
+// Map a state file read-only; *count is set to the number of states in it. NULL on
+//   error. Unmap with chip8_unmap_states.
+const chip8_state_t *chip8_map_states(const char *path, size_t *count);
+void chip8_unmap_states(const chip8_state_t *states, size_t count);
+
+// Rewind buffer: one record per pushed frame in a fixed size byte ring. Every
+//   keyframe_interval'th record is a keyframe (the whole state, zero runs skipped),
+//   the others hold only the bytes that changed since the frame before (XOR + run
+//   length), so a frame typically costs a few dozen bytes. When the ring is full the
+//   oldest keyframe and its deltas are dropped. Stepping back decodes at most one
+//   keyframe and keyframe_interval - 1 deltas.
+typedef struct chip8_rewind chip8_rewind_t;
+
+// NULL on failure or if max_bytes can't hold a few keyframes
+chip8_rewind_t *chip8_rewind_create(size_t max_bytes, uint32_t keyframe_interval);
+void chip8_rewind_destroy(chip8_rewind_t *rewind);
+
+// Record the machine as it is after a frame
+void chip8_rewind_push(chip8_rewind_t *rewind, const chip8_t *chip8);
+
+// Drop the newest frame and load the one before it into chip8; false (chip8
+//   untouched) if there is no earlier frame left
+bool chip8_rewind_step_back(chip8_rewind_t *rewind, chip8_t *chip8);
+
+// Frames held, and ring bytes they use
+uint32_t chip8_rewind_frames(const chip8_rewind_t *rewind);
+size_t chip8_rewind_bytes(const chip8_rewind_t *rewind);
+
+// Input log: the keypad transitions of a run, keyed by frame number, plus what it
+//   takes to repeat the run exactly (CXNN seed, clock rate, ROM hash) and the state
+//   hash it ended with. Events are a byte stream of (frame delta as a LEB128 varint,
+//   key | 0x80 if down), so a key press and release usually cost 4 bytes.
+//   Files are the header followed by the event bytes.
+#define CHIP8_INPUT_LOG_MAGIC    0x4C493843u     // "C8IL"
+#define CHIP8_INPUT_LOG_VERSION  1
+
+typedef struct {
+    uint32_t magic;            // CHIP8_INPUT_LOG_MAGIC
+    uint16_t version;          // CHIP8_INPUT_LOG_VERSION
+    uint16_t quirks;           // chip8_quirks_t of the run (0, CHIP8_QUIRKS_VIP, in older logs)
+    uint32_t seed;             // chip8_seed after chip8_init
+    uint32_t insts_per_second; // Frame budgets are chip8_frame_insts of this
+    uint32_t frames;           // Frames run (chip8_run_frame) in the recording
+    uint32_t size;             // Event bytes
+    uint64_t rom_hash;         // FNV-1a of the ROM image
+    uint64_t state_hash;       // chip8_state_hash after the last frame
+} chip8_input_log_header_t;
+
+_Static_assert(sizeof(chip8_input_log_header_t) == 40, "input log layout must not change within a version");
+
+typedef struct {
+    chip8_input_log_header_t header;
+    uint8_t *events;
+    size_t capacity;
+    uint32_t last_frame;       // Frame of the last event recorded / replayed
+    size_t cursor;             // Replay: next event byte
+} chip8_input_log_t;
+
+// Start recording a run of rom; the caller seeds its machine with seed
+void chip8_input_log_start(chip8_input_log_t *log, const uint8_t *rom, size_t rom_size,
+                           uint32_t seed, uint32_t insts_per_second);
+
+// Record a key going down/up before frame (frames never decrease); false if out of memory
+bool chip8_input_log_key(chip8_input_log_t *log, uint32_t frame, uint8_t key, bool down);
+
+// Finish a recording after frames frames, ending in chip8's state (and quirk profile)
+void chip8_input_log_end(chip8_input_log_t *log, uint32_t frames, const chip8_t *chip8);
+
+// Write / read a log file; errors on stderr. A loaded log is ready to replay.
+bool chip8_input_log_save(const chip8_input_log_t *log, const char *path);
+bool chip8_input_log_load(chip8_input_log_t *log, const char *path);
+void chip8_input_log_free(chip8_input_log_t *log);
+
+// Does the log belong to this ROM image?
+bool chip8_input_log_matches_rom(const chip8_input_log_t *log, const uint8_t *rom, size_t rom_size);
+
+// Replay: apply the key events up to and including frame to chip8's keypad; call with
+//   frame 0, 1, 2... before running each frame
+void chip8_input_log_replay(chip8_input_log_t *log, uint32_t frame, chip8_t *chip8);
+
+// ROM maps: what static analysis of a ROM (chip8-analyze, make analyze) found. It
+//   follows the control flow from 0x200 (jumps, calls, returns, skips), tracking I where
+//   it is a constant, and marks every byte of RAM as code, sprite data (read by DXYN),
+//   loaded/stored data (FX65, FX33/FX55) or unknown. A map loaded after chip8_init
+//   pre-decodes the code, pre-translates JIT blocks and, if nothing stopped the analysis
+//   from seeing every path and every store, lets stores into data-only pages skip the
+//   self-modifying code checks. Files are one chip8_map_t.
+#define CHIP8_MAP_MAGIC   0x504D3843u    // "C8MP"
+#define CHIP8_MAP_VERSION 2
+
+#define CHIP8_MAP_CODE     0x01     // chip8_map_t.bytes: part of a reachable instruction
+#define CHIP8_MAP_INST     0x02     //   first byte of a reachable instruction
+#define CHIP8_MAP_LEADER   0x04     //   first byte of a basic block (control flow graph node)
+#define CHIP8_MAP_SPRITE   0x08     //   read by DXYN
+#define CHIP8_MAP_LOADED   0x10     //   read by FX65
+#define CHIP8_MAP_STORED   0x20     //   written by FX33/FX55
+#define CHIP8_MAP_INDIRECT 0x40     //   BNNN: jumps where the analysis can't follow
+
+#define CHIP8_MAP_HAS_INDIRECT   0x01   // chip8_map_t.flags: a reachable BNNN
+#define CHIP8_MAP_UNKNOWN_STORES 0x02   //   FX33/FX55 with an I the analysis couldn't pin down
+#define CHIP8_MAP_STORES_CODE    0x04   //   FX33/FX55 into code (self-modifying)
+
+typedef struct {
+    uint32_t magic;            // CHIP8_MAP_MAGIC
+    uint16_t version;          // CHIP8_MAP_VERSION
+    uint16_t size;             // sizeof(chip8_map_t)
+    uint64_t rom_hash;         // FNV-1a of the ROM image analyzed
+    uint32_t rom_size;
+    uint16_t data_pages;       // 256 byte pages proven data-only; 0 if any flag is set
+    uint8_t quirks;            // chip8_quirks_t the ROM was analyzed for
+    uint8_t flags;             // CHIP8_MAP_HAS_INDIRECT...
+    uint8_t bytes[CHIP8_RAM_SIZE];  // CHIP8_MAP_CODE... per RAM address
+} chip8_map_t;
+
+_Static_assert(sizeof(chip8_map_t) == 4120, "map layout must not change within a version");
+
+// Analyze a ROM image as loaded at 0x200, for a quirk profile (FX55/FX65 moving I)
+void chip8_map_build(chip8_map_t *map, const uint8_t *rom, size_t rom_size, chip8_quirks_t quirks);
+
+// Write / read a map file; errors on stderr
+bool chip8_map_save(const chip8_map_t *map, const char *path);
+bool chip8_map_load(chip8_map_t *map, const char *path);
+
+// Use a map on a machine just chip8_init'ed with the ROM it was built from, after
+//   chip8_set_backend and chip8_set_quirks. False (machine untouched) if the map is for
+//   another ROM or quirk profile.
+bool chip8_apply_map(chip8_t *chip8, const chip8_map_t *map);
+
+// Guest profiler: executions per opcode class and per RAM address, plus the
+//   instructions spent waiting (FX0A with no key released yet, delay timer polling
+//   loops). Counting is only compiled in with -DCHIP8_PROFILE (make profile); other
+//   builds don't touch the counters at all. While a profile is attached, chip8_step and
+//   chip8_run execute on the reference interpreter whatever the backend, so every
+//   instruction is counted where it ran.
+typedef enum {
+    CHIP8_OP_CLS,  CHIP8_OP_RET,  CHIP8_OP_SYS,                         // 00E0 00EE 0NNN
+    CHIP8_OP_JP,   CHIP8_OP_CALL, CHIP8_OP_SE_IMM, CHIP8_OP_SNE_IMM,    // 1NNN 2NNN 3XNN 4XNN
+    CHIP8_OP_SE_REG, CHIP8_OP_LD_IMM, CHIP8_OP_ADD_IMM,                 // 5XY0 6XNN 7XNN
+    CHIP8_OP_LD_REG, CHIP8_OP_OR, CHIP8_OP_AND, CHIP8_OP_XOR,           // 8XY0-8XY3
+    CHIP8_OP_ADD_REG, CHIP8_OP_SUB, CHIP8_OP_SHR, CHIP8_OP_SUBN,        // 8XY4-8XY7
+    CHIP8_OP_SHL,  CHIP8_OP_SNE_REG, CHIP8_OP_LD_I, CHIP8_OP_JP_V0,     // 8XYE 9XY0 ANNN BNNN
+    CHIP8_OP_RND,  CHIP8_OP_DRW,  CHIP8_OP_SKP,  CHIP8_OP_SKNP,         // CXNN DXYN EX9E EXA1
+    CHIP8_OP_LD_VX_DT, CHIP8_OP_LD_KEY, CHIP8_OP_LD_DT, CHIP8_OP_LD_ST, // FX07 FX0A FX15 FX18
+    CHIP8_OP_ADD_I, CHIP8_OP_LD_F, CHIP8_OP_BCD,                        // FX1E FX29 FX33
+    CHIP8_OP_STORE, CHIP8_OP_LOAD,                                      // FX55 FX65
+    CHIP8_OP_INVALID,
+    CHIP8_OP_CLASSES,
+} chip8_op_class_t;
+
+typedef struct chip8_profile {
+    uint64_t insts;
+    uint64_t classes[CHIP8_OP_CLASSES];
+    uint64_t pcs[CHIP8_RAM_SIZE];   // By the address the instruction was fetched from
+    uint64_t key_wait;         // FX0A executions that kept waiting
+    uint64_t timer_poll;       // Instructions in loops that only re-read the delay timer
+    uint16_t poll_pc;          // Polling loop detection: address of the last FX07
+    uint8_t poll_insts;        // Instructions since it, 0 once too many for a polling loop
+} chip8_profile_t;
+
+// Attach (or with NULL detach) zeroed counters; chip8_init detaches. False, and nothing
+//   is attached, if the library was built without CHIP8_PROFILE.
+bool chip8_set_profile(chip8_t *chip8, chip8_profile_t *profile);
+
+// Class of an opcode, and its name ("8XY4")
+chip8_op_class_t chip8_op_class(uint16_t opcode);
+const char *chip8_op_class_name(chip8_op_class_t op_class);
+
+// Print the opcode classes by count, the waiting totals and the top hottest addresses
+//   (with the opcode at each as RAM holds it now) on stdout
+void chip8_profile_report(const chip8_profile_t *profile, const chip8_t *chip8, uint32_t top);
+
+// Write the counters as CSV (kind,name,count): the total, every opcode class, the
+//   waiting totals and every address that executed. Errors on stderr.
+bool chip8_profile_write_csv(const chip8_profile_t *profile, const char *path);
+
+// Instruction trace: one fixed size binary record per instruction, appended to an
+//   in-memory ring by the run loops and written to a file by a background thread, so
+//   tracing costs a few stores per instruction instead of a printf. The hooks are only
+//   compiled in with -DDEBUG (make debug); a traced JIT machine runs on the
+//   pre-decoded interpreter, as translated blocks don't trace.
+//   chip8-trace (make trace-decode) turns a trace file into one description per
+//   instruction. Files are a chip8_trace_header_t followed by the records.
+#define CHIP8_TRACE_MAGIC   0x52543843u    // "C8TR"
+#define CHIP8_TRACE_VERSION 2
+
+typedef struct {
+    uint32_t magic;            // CHIP8_TRACE_MAGIC
+    uint16_t version;          // CHIP8_TRACE_VERSION
+    uint16_t record_size;      // sizeof(chip8_trace_record_t)
+    uint8_t quirks;            // chip8_quirks_t the traced machine runs with
+    uint8_t reserved[3];       // 0
+} chip8_trace_header_t;
+
+typedef struct {
+    uint16_t PC;               // Address the instruction was fetched from
+    uint16_t opcode;
+    uint16_t I;                // I after the instruction
+    uint8_t VX;                // V[X] after: the register the instruction changes, if any
+    uint8_t VF;                // VF after: carry, borrow, shifted out bit or collision
+} chip8_trace_record_t;
+
+_Static_assert(sizeof(chip8_trace_record_t) == 8, "trace layout must not change within a version");
+
+typedef struct chip8_trace chip8_trace_t;
+
+// Create path and start its writer thread, with a ring of capacity records (a power
+//   of 2), for machines running the quirks profile (the decoder describes instructions
+//   by it). NULL on error (reported on stderr). path must outlive the trace.
+chip8_trace_t *chip8_trace_open(const char *path, uint32_t capacity, chip8_quirks_t quirks);
+
+// Write out the rest of the ring, stop the writer and close the file; false (and an
+//   error on stderr) if any of it could not be written. Detach it from machines first.
+bool chip8_trace_close(chip8_trace_t *trace);
+
+// Records traced so far, and times the ring was full and a record had to wait
+uint64_t chip8_trace_records(const chip8_trace_t *trace);
+uint64_t chip8_trace_stalls(const chip8_trace_t *trace);
+
+// Attach (or with NULL detach) a trace; chip8_init detaches. False, and nothing is
+//   attached, if the library was built without DEBUG.
+bool chip8_set_trace(chip8_t *chip8, chip8_trace_t *trace);
+
+// Lockstep batch engine: up to CHIP8_BATCH_LANES machines running the same ROM with
+//   their registers in structure-of-arrays lanes, so one vector operation executes an
+//   instruction for every lane on the same PC (see chip8_batch.c). Lanes only differ
+//   by their seeds and keys, and each lane matches a scalar machine given the same.
+//   Lanes always run the CHIP8_QUIRKS_VIP profile.
+#define CHIP8_BATCH_LANES 32
+
+typedef struct chip8_batch chip8_batch_t;
+
+// Create lanes machines (1..CHIP8_BATCH_LANES) with rom loaded; NULL on failure
+chip8_batch_t *chip8_batch_create(const uint8_t *rom, size_t rom_size, uint32_t lanes);
+void chip8_batch_destroy(chip8_batch_t *batch);
+
+// Per lane CXNN seed and keypad
+void chip8_batch_seed(chip8_batch_t *batch, uint32_t lane, uint32_t seed);
+void chip8_batch_set_key(chip8_batch_t *batch, uint32_t lane, uint8_t key, bool down);
+
+// Run one 60hz frame on every lane, with the same rules as chip8_run_frame.
+//   Returns the number of instructions executed over all lanes.
+uint64_t chip8_batch_run_frame(chip8_batch_t *batch, uint32_t insts_per_frame);
+
+// A lane's machine (display, RAM, registers...), valid until the next batch call
+const chip8_t *chip8_batch_machine(chip8_batch_t *batch, uint32_t lane);
+
+// Average number of lanes sharing each instruction fetch so far (lockstep efficiency)
+double chip8_batch_lanes_per_step(const chip8_batch_t *batch);
+
+#endif
@@ -0,0 +1,180 @@
+#include <string.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+#include "chip8_fade.h"
+
+// Fade kernels: one function per instruction set, each fading a display row at a
+//   time (64 pixels, 4 or 8 per step) with the same 8.8 fixed point formula. The
+//   display bits pick each pixel's target color; a row is still fading if any pixel
+//   missed its target after the step.
+
+uint16_t chip8_fade_weight(float rate) {
+    if (rate <= 0.0f) return 0;
+    if (rate >= 1.0f) return 256;
+    return (uint16_t)(rate * 256.0f + 0.5f);
+}
+
+// Run fade_row over the rows set in rows (attr: target attributes for the kernel)
+#define FADE_KERNEL(name, fade_row, attr)                                                  \
+    attr static uint32_t name(uint32_t *colors, const uint64_t *display, uint32_t rows,    \
+                              uint32_t fg_color, uint32_t bg_color, uint16_t weight) {     \
+        uint32_t fading = 0;                                                               \
+        for (uint32_t y = 0; y < CHIP8_DISPLAY_HEIGHT; y++) {                              \
+            if (!(rows & (1u << y))) continue;                                             \
+            if (fade_row(&colors[y * CHIP8_DISPLAY_WIDTH], display[y], fg_color, bg_color, \
+                         weight))                                                          \
+                fading |= 1u << y;                                                         \
+        }                                                                                  \
+        return fading;                                                                     \
+    }
+
+static inline bool fade_row_scalar(uint32_t *colors, uint64_t pixels, uint32_t fg_color,
+                                   uint32_t bg_color, uint16_t weight) {
+    bool fading = false;
+
+    for (uint32_t x = 0; x < CHIP8_DISPLAY_WIDTH; x++) {
+        const uint32_t start = colors[x];
+        const uint32_t target = (pixels >> (CHIP8_DISPLAY_WIDTH - 1 - x)) & 1 ? fg_color : bg_color;
+        uint32_t color = 0;
+
+        for (uint32_t shift = 0; shift < 32; shift += 8) {
+            const uint32_t s = (start >> shift) & 0xFF;
+            const uint32_t t = (target >> shift) & 0xFF;
+            color |= ((s * (256 - weight) + t * weight) >> 8) << shift;
+        }
+        if (color == start) color = target;     // Stalled short of the target
+
+        colors[x] = color;
+        fading |= (color != target);
+    }
+    return fading;
+}
+FADE_KERNEL(fade_scalar, fade_row_scalar, )
+
+#if defined(__SSE2__)
+// 4 pixels per step; channels are widened to 16 bits for the multiply
+static inline bool fade_row_sse2(uint32_t *colors, uint64_t pixels, uint32_t fg_color,
+                                 uint32_t bg_color, uint16_t weight) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i start_weight = _mm_set1_epi16(256 - weight);
+    const __m128i target_weight = _mm_set1_epi16(weight);
+    const __m128i fg = _mm_set1_epi32(fg_color);
+    const __m128i bg = _mm_set1_epi32(bg_color);
+    const __m128i bits = _mm_set_epi32(1, 2, 4, 8);     // Leftmost pixel is the top bit
+    __m128i missed = zero;
+
+    for (uint32_t x = 0; x < CHIP8_DISPLAY_WIDTH; x += 4) {
+        const __m128i nibble = _mm_set1_epi32((pixels >> (CHIP8_DISPLAY_WIDTH - 4 - x)) & 0xF);
+        const __m128i on = _mm_cmpeq_epi32(_mm_and_si128(nibble, bits), bits);
+        const __m128i target = _mm_or_si128(_mm_and_si128(on, fg), _mm_andnot_si128(on, bg));
+        const __m128i start = _mm_loadu_si128((const __m128i *)&colors[x]);
+
+        const __m128i lo = _mm_srli_epi16(_mm_add_epi16(
+            _mm_mullo_epi16(_mm_unpacklo_epi8(start, zero), start_weight),
+            _mm_mullo_epi16(_mm_unpacklo_epi8(target, zero), target_weight)), 8);
+        const __m128i hi = _mm_srli_epi16(_mm_add_epi16(
+            _mm_mullo_epi16(_mm_unpackhi_epi8(start, zero), start_weight),
+            _mm_mullo_epi16(_mm_unpackhi_epi8(target, zero), target_weight)), 8);
+        __m128i color = _mm_packus_epi16(lo, hi);
+
+        const __m128i stalled = _mm_cmpeq_epi32(color, start);
+        color = _mm_or_si128(_mm_and_si128(stalled, target), _mm_andnot_si128(stalled, color));
+
+        _mm_storeu_si128((__m128i *)&colors[x], color);
+        missed = _mm_or_si128(missed, _mm_xor_si128(color, target));
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(missed, zero)) != 0xFFFF;
+}
+FADE_KERNEL(fade_sse2, fade_row_sse2, )
+
+// 8 pixels per step; unpack and pack both work within 128 bit lanes, so they undo
+//   each other and the pixel order is kept
+__attribute__((target("avx2")))
+static inline bool fade_row_avx2(uint32_t *colors, uint64_t pixels, uint32_t fg_color,
+                                 uint32_t bg_color, uint16_t weight) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i start_weight = _mm256_set1_epi16(256 - weight);
+    const __m256i target_weight = _mm256_set1_epi16(weight);
+    const __m256i fg = _mm256_set1_epi32(fg_color);
+    const __m256i bg = _mm256_set1_epi32(bg_color);
+    const __m256i bits = _mm256_set_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256i missed = zero;
+
+    for (uint32_t x = 0; x < CHIP8_DISPLAY_WIDTH; x += 8) {
+        const __m256i byte = _mm256_set1_epi32((pixels >> (CHIP8_DISPLAY_WIDTH - 8 - x)) & 0xFF);
+        const __m256i on = _mm256_cmpeq_epi32(_mm256_and_si256(byte, bits), bits);
+        const __m256i target = _mm256_blendv_epi8(bg, fg, on);
+        const __m256i start = _mm256_loadu_si256((const __m256i *)&colors[x]);
+
+        const __m256i lo = _mm256_srli_epi16(_mm256_add_epi16(
+            _mm256_mullo_epi16(_mm256_unpacklo_epi8(start, zero), start_weight),
+            _mm256_mullo_epi16(_mm256_unpacklo_epi8(target, zero), target_weight)), 8);
+        const __m256i hi = _mm256_srli_epi16(_mm256_add_epi16(
+            _mm256_mullo_epi16(_mm256_unpackhi_epi8(start, zero), start_weight),
+            _mm256_mullo_epi16(_mm256_unpackhi_epi8(target, zero), target_weight)), 8);
+        __m256i color = _mm256_packus_epi16(lo, hi);
+
+        color = _mm256_blendv_epi8(color, target, _mm256_cmpeq_epi32(color, start));
+
+        _mm256_storeu_si256((__m256i *)&colors[x], color);
+        missed = _mm256_or_si256(missed, _mm256_xor_si256(color, target));
+    }
+    return !_mm256_testz_si256(missed, missed);
+}
+FADE_KERNEL(fade_avx2, fade_row_avx2, __attribute__((target("avx2"))))
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+// 4 pixels per step, same widening as SSE2
+static inline bool fade_row_neon(uint32_t *colors, uint64_t pixels, uint32_t fg_color,
+                                 uint32_t bg_color, uint16_t weight) {
+    const uint16x8_t start_weight = vdupq_n_u16(256 - weight);
+    const uint16x8_t target_weight = vdupq_n_u16(weight);
+    const uint32x4_t fg = vdupq_n_u32(fg_color);
+    const uint32x4_t bg = vdupq_n_u32(bg_color);
+    const uint32_t bit_values[4] = {8, 4, 2, 1};    // Leftmost pixel is the top bit
+    const uint32x4_t bits = vld1q_u32(bit_values);
+    uint32x4_t missed = vdupq_n_u32(0);
+
+    for (uint32_t x = 0; x < CHIP8_DISPLAY_WIDTH; x += 4) {
+        const uint32x4_t nibble = vdupq_n_u32((pixels >> (CHIP8_DISPLAY_WIDTH - 4 - x)) & 0xF);
+        const uint32x4_t target = vbslq_u32(vtstq_u32(nibble, bits), fg, bg);
+        const uint32x4_t start = vld1q_u32(&colors[x]);
+        const uint8x16_t start8 = vreinterpretq_u8_u32(start);
+        const uint8x16_t target8 = vreinterpretq_u8_u32(target);
+
+        const uint16x8_t lo = vshrq_n_u16(vmlaq_u16(
+            vmulq_u16(vmovl_u8(vget_low_u8(start8)), start_weight),
+            vmovl_u8(vget_low_u8(target8)), target_weight), 8);
+        const uint16x8_t hi = vshrq_n_u16(vmlaq_u16(
+            vmulq_u16(vmovl_u8(vget_high_u8(start8)), start_weight),
+            vmovl_u8(vget_high_u8(target8)), target_weight), 8);
+        uint32x4_t color = vreinterpretq_u32_u8(vcombine_u8(vmovn_u16(lo), vmovn_u16(hi)));
+
+        color = vbslq_u32(vceqq_u32(color, start), target, color);
+
+        vst1q_u32(&colors[x], color);
+        missed = vorrq_u32(missed, veorq_u32(color, target));
+    }
+    return vmaxvq_u32(missed) != 0;
+}
+FADE_KERNEL(fade_neon, fade_row_neon, )
+#endif
+
+chip8_fade_fn *chip8_fade_kernel(const char *name) {
+    const bool best = strcmp(name, "best") == 0;
+
+#if defined(__SSE2__)
+    if ((best || strcmp(name, "avx2") == 0) && __builtin_cpu_supports("avx2")) return fade_avx2;
+    if (best || strcmp(name, "sse2") == 0) return fade_sse2;
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    if (best || strcmp(name, "neon") == 0) return fade_neon;
+#endif
+    if (best || strcmp(name, "scalar") == 0) return fade_scalar;
+    return NULL;
+}
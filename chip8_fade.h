@@ -0,0 +1,29 @@
+#ifndef CHIP8_FADE_H
+#define CHIP8_FADE_H
+
+// Pixel color fade for frontends: every RGBA8888 color moves a fixed fraction of the
+//   way toward the foreground (pixel on) or background (pixel off) color each frame.
+//   The math is 8.8 fixed point, so every kernel gives bit-identical results:
+//
+//     channel = (start * (256 - weight) + target * weight) >> 8
+//
+//   A pixel whose color doesn't change in a step (the shift truncates toward the
+//   start color) snaps to its target, so fades always finish.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "chip8_core.h"
+
+// Fade the pixel colors (CHIP8_DISPLAY_WIDTH per row, row-major) of the display rows
+//   set in rows; returns the rows that still have pixels short of their target color
+typedef uint32_t chip8_fade_fn(uint32_t *colors, const uint64_t *display, uint32_t rows,
+                               uint32_t fg_color, uint32_t bg_color, uint16_t weight);
+
+// Fixed point weight (0-256) for a lerp rate in [0.0, 1.0]
+uint16_t chip8_fade_weight(float rate);
+
+// Fade kernel by name ("scalar", "sse2", "avx2", "neon"), or the fastest one this host
+//   runs for "best"; NULL if the kernel isn't built in or the CPU lacks it
+chip8_fade_fn *chip8_fade_kernel(const char *name);
+
+#endif
@@ -0,0 +1,81 @@
+#define _POSIX_C_SOURCE 200809L  // clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "chip8_fade.h"
+
+// Fade kernel microbenchmark: fades a full screen of random colors toward a
+//   display that changes every frame (every row dirty, the worst case), checks
+//   every kernel against the scalar one and reports the time per frame.
+//   Usage: chip8-fade-bench [frames] [lerp rate]
+
+#define PIXELS (CHIP8_DISPLAY_WIDTH * CHIP8_DISPLAY_HEIGHT)
+
+static const char *kernels[] = {"scalar", "sse2", "avx2", "neon"};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// Fade frames frames with the same colors and displays for every kernel; returns
+//   a hash of the colors and fading rows of every frame, and the seconds taken
+static uint64_t run(chip8_fade_fn *fade, uint32_t frames, uint16_t weight, double *seconds) {
+    static uint32_t colors[PIXELS];
+    uint64_t display[CHIP8_DISPLAY_HEIGHT];
+    uint64_t random = 0x9E3779B97F4A7C15ULL;
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    for (uint32_t i = 0; i < PIXELS; i++) colors[i] = (uint32_t)next_random(&random);
+
+    const double start = now_seconds();
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        for (uint32_t y = 0; y < CHIP8_DISPLAY_HEIGHT; y++) display[y] = next_random(&random);
+
+        const uint32_t fading = fade(colors, display, CHIP8_ALL_ROWS, 0xFFCC00FF, 0x202040FF, weight);
+        hash = (hash ^ fading ^ colors[frame % PIXELS]) * 0x100000001B3ULL;
+    }
+    *seconds = now_seconds() - start;
+
+    for (uint32_t i = 0; i < PIXELS; i++) hash = (hash ^ colors[i]) * 0x100000001B3ULL;
+    return hash;
+}
+
+int main(int argc, char **argv) {
+    const uint32_t frames = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : 200000;
+    const float rate = argc > 2 ? strtof(argv[2], NULL) : 0.7f;
+    const uint16_t weight = chip8_fade_weight(rate);
+
+    double seconds;
+    const uint64_t expected = run(chip8_fade_kernel("scalar"), frames, weight, &seconds);
+    bool ok = true;
+
+    printf("frames: %u, pixels/frame: %d, rate: %.2f (weight %u/256), best: ", frames, PIXELS, rate, weight);
+    for (size_t k = 0; k < sizeof kernels / sizeof kernels[0]; k++) {
+        if (chip8_fade_kernel(kernels[k]) == chip8_fade_kernel("best")) printf("%s\n", kernels[k]);
+    }
+
+    for (size_t k = 0; k < sizeof kernels / sizeof kernels[0]; k++) {
+        chip8_fade_fn *fade = chip8_fade_kernel(kernels[k]);
+        if (fade == NULL) {
+            printf("%-6s  not available\n", kernels[k]);
+            continue;
+        }
+
+        const uint64_t hash = run(fade, frames, weight, &seconds);
+        printf("%-6s  ns/frame: %8.1f, Mpixels/s: %8.1f, hash: %016llX%s\n", kernels[k],
+               seconds * 1e9 / frames, seconds > 0 ? (double)frames * PIXELS / seconds / 1e6 : 0.0,
+               (unsigned long long)hash, hash == expected ? "" : "  MISMATCH");
+        ok &= (hash == expected);
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,371 @@
+#define _POSIX_C_SOURCE 200809L  // clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "chip8_core.h"
+
+// Fleet runner: runs many independent headless CHIP8 machines on a
+//   work-stealing thread pool. Jobs come from a manifest file, one per line:
+//
+//     <rom_name> <frames> [insts_per_second] [seed] [vip|schip|modern]     # comment
+//
+//   the last field being the quirk profile the ROM was written for (vip if left out).
+//   Results go to an output file (stdout by default), one line per job in manifest order.
+//   ROM images are loaded once up front and only read afterwards; every
+//   worker owns its own chip8_t (and recompiler arena), so the only shared
+//   writes are the job ranges below and each job's own result slot.
+
+typedef struct {
+    const char *manifest_name;
+    const char *output_name;    // NULL = stdout
+    uint32_t threads;
+    chip8_backend_t backend;    // Execution engine
+} fleet_config_t;
+
+typedef struct {
+    char name[256];
+    uint8_t data[CHIP8_MAX_ROM_SIZE];
+    size_t size;
+} fleet_rom_t;
+
+typedef struct {
+    uint32_t rom;               // Index into the ROM table
+    uint32_t frames;            // Number of 60hz frames to run
+    uint32_t insts_per_second;  // CHIP8 CPU "clock rate" or hz
+    uint32_t seed;              // CXNN random seed
+    chip8_quirks_t quirks;      // Quirk profile
+} fleet_job_t;
+
+typedef struct {
+    bool ok;
+    uint64_t insts;
+    uint16_t PC;
+    uint16_t I;
+    uint64_t display_hash;
+    uint64_t state_hash;
+    chip8_fault_t fault;        // What stopped the machine, if anything
+} fleet_result_t;
+
+typedef struct fleet fleet_t;
+
+// Each worker owns a contiguous range of job indices, packed as head:32|tail:32
+//   in one atomic word. The owner takes jobs from the head; idle workers steal
+//   the upper half of someone else's range from the tail. Both sides update the
+//   range with a single compare-exchange, so no locks are needed. A job index is
+//   handed out exactly once, so a non-empty range value can never reappear (no ABA).
+typedef struct {
+    _Alignas(64) _Atomic uint64_t range;
+    fleet_t *fleet;
+    pthread_t thread;
+    uint32_t id;
+    uint32_t jobs_run;
+    uint32_t jobs_stolen;
+    chip8_t chip8;
+    chip8_jit_t *jit;
+} fleet_worker_t;
+
+struct fleet {
+    const fleet_config_t *config;
+    const fleet_rom_t *roms;
+    const fleet_job_t *jobs;
+    fleet_result_t *results;
+    fleet_worker_t *workers;
+    _Atomic uint32_t unclaimed;  // Jobs not yet taken by any worker
+};
+
+static inline uint64_t range_pack(uint32_t head, uint32_t tail) {
+    return (uint64_t)head << 32 | tail;
+}
+
+static inline uint32_t range_head(uint64_t range) { return range >> 32; }
+static inline uint32_t range_tail(uint64_t range) { return (uint32_t)range; }
+
+bool init_config_from_args(fleet_config_t *config, const int argc, char **argv) {
+    *config = (fleet_config_t) {
+        .manifest_name = NULL,
+        .output_name = NULL,
+        .threads = 4,
+        .backend = CHIP8_BACKEND_CACHED,
+    };
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            config->threads = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            config->output_name = argv[++i];
+        } else if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc) {
+            if (!chip8_backend_from_name(argv[++i], &config->backend)) {
+                fprintf(stderr, "Unknown backend %s\n", argv[i]);
+                return false;
+            }
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return false;
+        } else {
+            config->manifest_name = argv[i];
+        }
+    }
+    if (config->threads == 0) config->threads = 1;
+    return config->manifest_name != NULL;
+}
+
+// Find a ROM in the table by file name, loading it on first use
+static bool find_rom(fleet_rom_t **roms, uint32_t *rom_count, const char *name, uint32_t *index) {
+    for (uint32_t i = 0; i < *rom_count; i++) {
+        if (strcmp((*roms)[i].name, name) == 0) {
+            *index = i;
+            return true;
+        }
+    }
+
+    fleet_rom_t *grown = realloc(*roms, (*rom_count + 1) * sizeof **roms);
+    if (!grown) return false;
+    *roms = grown;
+
+    fleet_rom_t *rom = &grown[*rom_count];
+    snprintf(rom->name, sizeof rom->name, "%s", name);
+    if (!chip8_load_rom_file(name, rom->data, sizeof rom->data, &rom->size)) return false;
+
+    *index = (*rom_count)++;
+    return true;
+}
+
+// Parse the manifest into the job list, loading every distinct ROM once
+bool load_manifest(const char *manifest_name, fleet_rom_t **roms, uint32_t *rom_count,
+                   fleet_job_t **jobs, uint32_t *job_count) {
+    FILE *manifest = fopen(manifest_name, "r");
+    if (!manifest) {
+        fprintf(stderr, "Manifest file %s is invalid or does not exist\n", manifest_name);
+        return false;
+    }
+
+    bool ok = true;
+    uint32_t capacity = 0;
+    char line[512];
+    for (uint32_t line_no = 1; fgets(line, sizeof line, manifest); line_no++) {
+        char *comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+
+        char name[256], quirks_name[16] = "vip";
+        unsigned frames = 0, insts_per_second = 600, seed = 0;
+        chip8_quirks_t quirks;
+        const int fields = sscanf(line, "%255s %u %u %u %15s", name, &frames, &insts_per_second, &seed, quirks_name);
+        if (fields <= 0) continue;  // Blank or comment-only line
+        if (fields < 2 || !chip8_quirks_from_name(quirks_name, &quirks)) {
+            fprintf(stderr, "%s:%u: expected <rom_name> <frames> [insts_per_second] [seed] [vip|schip|modern]\n",
+                    manifest_name, line_no);
+            ok = false;
+            break;
+        }
+
+        if (*job_count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            fleet_job_t *grown = realloc(*jobs, capacity * sizeof **jobs);
+            if (!grown) { ok = false; break; }
+            *jobs = grown;
+        }
+
+        fleet_job_t *job = &(*jobs)[*job_count];
+        if (!find_rom(roms, rom_count, name, &job->rom)) { ok = false; break; }
+        job->frames = frames;
+        job->insts_per_second = insts_per_second;
+        job->seed = seed;
+        job->quirks = quirks;
+        (*job_count)++;
+    }
+
+    fclose(manifest);
+    return ok;
+}
+
+// Take the next job from this worker's own range
+static bool pop_job(fleet_worker_t *self, uint32_t *job) {
+    uint64_t range = atomic_load_explicit(&self->range, memory_order_acquire);
+    while (range_head(range) < range_tail(range)) {
+        const uint64_t next = range_pack(range_head(range) + 1, range_tail(range));
+        if (atomic_compare_exchange_weak_explicit(&self->range, &range, next,
+                                                  memory_order_acq_rel, memory_order_acquire)) {
+            *job = range_head(range);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Move the upper half of another worker's range into this (empty) worker's range.
+//   Other thieves leave an empty range alone, so a plain store is enough here.
+static bool steal_jobs(fleet_t *fleet, fleet_worker_t *self) {
+    const uint32_t threads = fleet->config->threads;
+    for (uint32_t i = 1; i < threads; i++) {
+        fleet_worker_t *victim = &fleet->workers[(self->id + i) % threads];
+        uint64_t range = atomic_load_explicit(&victim->range, memory_order_acquire);
+        while (range_head(range) < range_tail(range)) {
+            const uint32_t head = range_head(range), tail = range_tail(range);
+            const uint32_t count = (tail - head + 1) / 2;
+            if (atomic_compare_exchange_weak_explicit(&victim->range, &range,
+                                                      range_pack(head, tail - count),
+                                                      memory_order_acq_rel, memory_order_acquire)) {
+                atomic_store_explicit(&self->range, range_pack(tail - count, tail),
+                                      memory_order_release);
+                self->jobs_stolen += count;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Run one job to completion on this worker's own machine
+static void run_job(fleet_t *fleet, fleet_worker_t *self, uint32_t index) {
+    const fleet_job_t *job = &fleet->jobs[index];
+    const fleet_rom_t *rom = &fleet->roms[job->rom];
+    fleet_result_t *result = &fleet->results[index];
+    chip8_t *chip8 = &self->chip8;
+
+    *result = (fleet_result_t){0};
+    if (!chip8_init(chip8, rom->data, rom->size)) return;
+    chip8_set_backend(chip8, fleet->config->backend, self->jit);
+    chip8_set_quirks(chip8, job->quirks);
+    chip8_seed(chip8, job->seed);
+
+    uint64_t insts = 0;
+    for (uint32_t frame = 0; frame < job->frames && chip8->state != QUIT; frame++) {
+        insts += chip8_run_frame(chip8, chip8_frame_insts(job->insts_per_second, frame));
+    }
+
+    result->ok = true;
+    result->insts = insts;
+    result->PC = chip8->PC;
+    result->I = chip8->I;
+    result->display_hash = chip8_display_hash(chip8);
+    result->state_hash = chip8_state_hash(chip8);
+    result->fault = chip8->fault;
+    self->jobs_run++;
+}
+
+static void *worker_main(void *arg) {
+    fleet_worker_t *self = arg;
+    fleet_t *fleet = self->fleet;
+
+    while (atomic_load_explicit(&fleet->unclaimed, memory_order_acquire) > 0) {
+        uint32_t job;
+        if (pop_job(self, &job)) {
+            atomic_fetch_sub_explicit(&fleet->unclaimed, 1, memory_order_acq_rel);
+            run_job(fleet, self, job);
+        } else if (!steal_jobs(fleet, self)) {
+            sched_yield();  // Remaining jobs are in flight between a victim and a thief
+        }
+    }
+    return NULL;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+bool write_results(const char *output_name, const fleet_t *fleet, uint32_t job_count) {
+    FILE *out = output_name ? fopen(output_name, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "Could not open output file %s\n", output_name);
+        return false;
+    }
+
+    fprintf(out, "# job rom frames instructions PC I display_hash state_hash [# fault]\n");
+    for (uint32_t i = 0; i < job_count; i++) {
+        const fleet_job_t *job = &fleet->jobs[i];
+        const fleet_result_t *result = &fleet->results[i];
+        if (!result->ok) {
+            fprintf(out, "%u %s error\n", i, fleet->roms[job->rom].name);
+            continue;
+        }
+        fprintf(out, "%u %s %u %llu 0x%04X 0x%04X %016llX %016llX",
+                i, fleet->roms[job->rom].name, job->frames,
+                (unsigned long long)result->insts, result->PC, result->I,
+                (unsigned long long)result->display_hash, (unsigned long long)result->state_hash);
+        if (result->fault) fprintf(out, "  # %s", chip8_fault_name(result->fault));
+        fprintf(out, "\n");
+    }
+
+    if (out != stdout) fclose(out);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    fleet_config_t config;
+    if (!init_config_from_args(&config, argc, argv)) {
+        fprintf(stderr, "Usage: %s <manifest> [--threads N] [--output file]\n"
+                        "         [--backend interpreter|cached|jit]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    fleet_rom_t *roms = NULL;
+    fleet_job_t *jobs = NULL;
+    uint32_t rom_count = 0, job_count = 0;
+    if (!load_manifest(config.manifest_name, &roms, &rom_count, &jobs, &job_count)) exit(EXIT_FAILURE);
+
+    fleet_t fleet = {
+        .config = &config,
+        .roms = roms,
+        .jobs = jobs,
+        .results = calloc(job_count ? job_count : 1, sizeof(fleet_result_t)),
+        .workers = aligned_alloc(64, config.threads * sizeof(fleet_worker_t)),
+    };
+    if (!fleet.results || !fleet.workers) {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    atomic_init(&fleet.unclaimed, job_count);
+
+    // Deal the manifest out in equal contiguous ranges; stealing evens out the rest
+    for (uint32_t i = 0; i < config.threads; i++) {
+        fleet_worker_t *worker = &fleet.workers[i];
+        const uint32_t head = (uint64_t)job_count * i / config.threads;
+        const uint32_t tail = (uint64_t)job_count * (i + 1) / config.threads;
+        atomic_init(&worker->range, range_pack(head, tail));
+        worker->fleet = &fleet;
+        worker->id = i;
+        worker->jobs_run = 0;
+        worker->jobs_stolen = 0;
+        worker->jit = config.backend == CHIP8_BACKEND_JIT ? chip8_jit_create() : NULL;
+        if (config.backend == CHIP8_BACKEND_JIT && !worker->jit && i == 0) {
+            fprintf(stderr, "No recompiler for this host, using the cached interpreter\n");
+        }
+    }
+
+    const double start = now_seconds();
+    for (uint32_t i = 1; i < config.threads; i++) {
+        if (pthread_create(&fleet.workers[i].thread, NULL, worker_main, &fleet.workers[i]) != 0) {
+            fprintf(stderr, "Could not start worker thread %u\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    worker_main(&fleet.workers[0]);  // The main thread is worker 0
+    for (uint32_t i = 1; i < config.threads; i++) pthread_join(fleet.workers[i].thread, NULL);
+    const double elapsed = now_seconds() - start;
+
+    if (!write_results(config.output_name, &fleet, job_count)) exit(EXIT_FAILURE);
+
+    uint64_t insts = 0;
+    for (uint32_t i = 0; i < job_count; i++) insts += fleet.results[i].insts;
+
+    FILE *report = config.output_name ? stdout : stderr;
+    fprintf(report, "jobs: %u, roms: %u, threads: %u, instructions: %llu, seconds: %.6f, MIPS: %.2f\n",
+            job_count, rom_count, config.threads, (unsigned long long)insts, elapsed,
+            elapsed > 0 ? insts / elapsed / 1e6 : 0.0);
+    for (uint32_t i = 0; i < config.threads; i++) {
+        fprintf(report, "  worker %u: %u jobs (%u stolen)\n",
+                i, fleet.workers[i].jobs_run, fleet.workers[i].jobs_stolen);
+        chip8_jit_destroy(fleet.workers[i].jit);
+    }
+
+    free(fleet.workers);
+    free(fleet.results);
+    free(jobs);
+    free(roms);
+    exit(EXIT_SUCCESS);
+}
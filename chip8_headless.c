@@ -0,0 +1,248 @@
+#define _POSIX_C_SOURCE 200809L  // clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "chip8_core.h"
+
+// Headless CHIP8 runner: no window, no audio, no frame pacing.
+//   Runs a ROM for a number of 60hz frames as fast as the host allows and
+//   reports the emulated throughput and final machine state.
+
+typedef struct {
+    const char *rom_name;
+    uint32_t frames;            // Number of 60hz frames to run
+    uint32_t insts_per_second;  // CHIP8 CPU "clock rate" or hz
+    chip8_backend_t backend;    // Execution engine
+    chip8_quirks_t quirks;      // Quirk profile the ROM was written for
+    uint32_t lanes;             // > 0: run this many seeded copies on the lockstep batch engine
+    const char *load_state;     // Start from this save state file (first state in it)
+    const char *save_state;     // Save the final state to this file
+    const char *replay;         // Feed this input log in (its seed, clock rate and length)
+    const char *profile;        // Profile the run (CHIP8_PROFILE builds), CSV to this file
+    const char *trace;          // Trace every instruction to this file (DEBUG builds)
+    const char *map;            // ROM map from chip8-analyze to start with
+} headless_config_t;
+
+#define TRACE_RING_RECORDS (1u << 20)   // 8 MB of trace records in flight
+
+bool init_config_from_args(headless_config_t *config, const int argc, char **argv) {
+    *config = (headless_config_t) {
+        .rom_name = NULL,
+        .frames = 60 * 60,          // One emulated minute
+        .insts_per_second = 600,
+        .backend = CHIP8_BACKEND_CACHED,
+        .quirks = CHIP8_QUIRKS_VIP,
+        .lanes = 0,
+        .load_state = NULL,
+        .save_state = NULL,
+        .replay = NULL,
+        .profile = NULL,
+        .trace = NULL,
+        .map = NULL,
+    };
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            config->frames = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--insts-per-second") == 0 && i + 1 < argc) {
+            config->insts_per_second = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc) {
+            if (!chip8_backend_from_name(argv[++i], &config->backend)) {
+                fprintf(stderr, "Unknown backend %s\n", argv[i]);
+                return false;
+            }
+        } else if (strcmp(argv[i], "--quirks") == 0 && i + 1 < argc) {
+            if (!chip8_quirks_from_name(argv[++i], &config->quirks)) {
+                fprintf(stderr, "Unknown quirk profile %s (vip, schip or modern)\n", argv[i]);
+                return false;
+            }
+        } else if (strcmp(argv[i], "--lanes") == 0 && i + 1 < argc) {
+            config->lanes = (uint32_t)strtoul(argv[++i], NULL, 10);
+            if (config->lanes > CHIP8_BATCH_LANES) {
+                fprintf(stderr, "At most %d lanes\n", CHIP8_BATCH_LANES);
+                return false;
+            }
+        } else if (strcmp(argv[i], "--load-state") == 0 && i + 1 < argc) {
+            config->load_state = argv[++i];
+        } else if (strcmp(argv[i], "--save-state") == 0 && i + 1 < argc) {
+            config->save_state = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            config->replay = argv[++i];
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            config->profile = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            config->trace = argv[++i];
+        } else if (strcmp(argv[i], "--map") == 0 && i + 1 < argc) {
+            config->map = argv[++i];
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return false;
+        } else {
+            config->rom_name = argv[i];
+        }
+    }
+    if (config->lanes > 0 && config->quirks != CHIP8_QUIRKS_VIP) {
+        fprintf(stderr, "The batch engine only runs the vip quirk profile\n");
+        return false;
+    }
+    return config->rom_name != NULL;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Run config->lanes copies of the ROM (lane l seeded with l + 1) on the batch engine
+void run_batch(const headless_config_t *config, const uint8_t *rom, size_t rom_size) {
+    chip8_batch_t *batch = chip8_batch_create(rom, rom_size, config->lanes);
+    if (!batch) exit(EXIT_FAILURE);
+    for (uint32_t lane = 0; lane < config->lanes; lane++) chip8_batch_seed(batch, lane, lane + 1);
+
+    uint64_t insts = 0;
+
+    const double start = now_seconds();
+    for (uint32_t frame = 0; frame < config->frames; frame++) {
+        insts += chip8_batch_run_frame(batch, chip8_frame_insts(config->insts_per_second, frame));
+    }
+    const double elapsed = now_seconds() - start;
+
+    printf("rom: %s\n", config->rom_name);
+    printf("lanes: %u, frames: %u, instructions: %llu, seconds: %.6f, MIPS: %.2f, frames/s: %.0f\n",
+           config->lanes, config->frames, (unsigned long long)insts, elapsed,
+           elapsed > 0 ? insts / elapsed / 1e6 : 0.0,
+           elapsed > 0 ? (double)config->frames * config->lanes / elapsed : 0.0);
+    printf("lanes per instruction fetch: %.2f\n", chip8_batch_lanes_per_step(batch));
+    for (uint32_t lane = 0; lane < config->lanes; lane++) {
+        const chip8_t *chip8 = chip8_batch_machine(batch, lane);
+        printf("lane %2u: PC: 0x%04X, I: 0x%04X, state hash: %016llX%s%s\n",
+               lane, chip8->PC, chip8->I, (unsigned long long)chip8_state_hash(chip8),
+               chip8->fault ? ", fault: " : "", chip8->fault ? chip8_fault_name(chip8->fault) : "");
+    }
+    chip8_batch_destroy(batch);
+}
+
+int main(int argc, char **argv) {
+    headless_config_t config;
+    if (!init_config_from_args(&config, argc, argv)) {
+        fprintf(stderr, "Usage: %s <rom_name> [--frames N] [--insts-per-second N]\n"
+                        "         [--backend interpreter|cached|jit] [--quirks vip|schip|modern]\n"
+                        "         [--lanes N]"
+                        "         [--load-state FILE] [--save-state FILE] [--replay FILE]\n"
+                        "         [--profile CSV] [--trace FILE] [--map FILE]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    static uint8_t rom[CHIP8_MAX_ROM_SIZE];
+    size_t rom_size = 0;
+    if (!chip8_load_rom_file(config.rom_name, rom, sizeof rom, &rom_size)) exit(EXIT_FAILURE);
+
+    if (config.lanes > 0) {
+        run_batch(&config, rom, rom_size);
+        exit(EXIT_SUCCESS);
+    }
+
+    // A replay repeats the recorded run: its seed, quirks, clock rate and number of frames
+    chip8_input_log_t log = {0};
+    if (config.replay) {
+        if (!chip8_input_log_load(&log, config.replay)) exit(EXIT_FAILURE);
+        if (!chip8_input_log_matches_rom(&log, rom, rom_size)) {
+            fprintf(stderr, "Input log %s was recorded with a different ROM\n", config.replay);
+            exit(EXIT_FAILURE);
+        }
+        config.quirks = log.header.quirks;
+        config.insts_per_second = log.header.insts_per_second;
+        config.frames = log.header.frames;
+    }
+
+    chip8_t chip8;
+    if (!chip8_init(&chip8, rom, rom_size)) exit(EXIT_FAILURE);
+    chip8_jit_t *jit = config.backend == CHIP8_BACKEND_JIT ? chip8_jit_create() : NULL;
+    if (!chip8_set_backend(&chip8, config.backend, jit)) {
+        fprintf(stderr, "No recompiler for this host, using the cached interpreter\n");
+    }
+    chip8_set_quirks(&chip8, config.quirks);
+
+    // Before a state is loaded: the map describes the ROM as chip8_init leaves it
+    if (config.map) {
+        static chip8_map_t map;
+        if (!chip8_map_load(&map, config.map)) exit(EXIT_FAILURE);
+        if (!chip8_apply_map(&chip8, &map)) {
+            fprintf(stderr, "ROM map %s is for another ROM or quirk profile\n", config.map);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (config.load_state && !chip8_load_state_file(&chip8, config.load_state, 0)) exit(EXIT_FAILURE);
+    if (config.replay) {
+        if (config.load_state) fprintf(stderr, "Replaying from a loaded state, the recorded run started from reset\n");
+        chip8_seed(&chip8, log.header.seed);
+    }
+
+    chip8_profile_t *profile = config.profile ? calloc(1, sizeof *profile) : NULL;
+    if (profile && !chip8_set_profile(&chip8, profile)) {
+        fprintf(stderr, "Built without CHIP8_PROFILE (make profile), not profiling\n");
+        free(profile);
+        profile = NULL;
+    }
+
+    chip8_trace_t *trace = config.trace ? chip8_trace_open(config.trace, TRACE_RING_RECORDS, chip8.quirks) : NULL;
+    if (config.trace && trace == NULL) exit(EXIT_FAILURE);
+    if (trace && !chip8_set_trace(&chip8, trace)) {
+        fprintf(stderr, "Built without DEBUG (make debug), not tracing\n");
+    }
+
+    uint64_t insts = 0;
+
+    const double start = now_seconds();
+    for (uint32_t frame = 0; frame < config.frames && chip8.state != QUIT; frame++) {
+        if (config.replay) chip8_input_log_replay(&log, frame, &chip8);
+        insts += chip8_run_frame(&chip8, chip8_frame_insts(config.insts_per_second, frame));
+    }
+    const double elapsed = now_seconds() - start;
+
+    if (trace) {
+        chip8_set_trace(&chip8, NULL);
+        printf("trace: %llu instructions, ring full %llu times\n",
+               (unsigned long long)chip8_trace_records(trace), (unsigned long long)chip8_trace_stalls(trace));
+        if (!chip8_trace_close(trace)) exit(EXIT_FAILURE);
+    }
+
+    printf("rom: %s (%s quirks)\n", config.rom_name, chip8_quirks_name(chip8.quirks));
+    printf("frames: %u, instructions: %llu, seconds: %.6f, MIPS: %.2f\n",
+           config.frames, (unsigned long long)insts, elapsed,
+           elapsed > 0 ? insts / elapsed / 1e6 : 0.0);
+    printf("idle: %llu instructions fast-forwarded\n", (unsigned long long)chip8.idle_insts);
+    if (chip8.invalid_insts) {
+        printf("invalid: %llu opcodes run as no-ops, the last %04X\n",
+               (unsigned long long)chip8.invalid_insts, chip8.invalid_opcode);
+    }
+    printf("fused:");
+    for (uint32_t i = 0; i < CHIP8_FUSIONS; i++) {
+        printf(" %s %llu", chip8_fusion_name(i), (unsigned long long)chip8.fusions[i]);
+    }
+    printf("\n");
+    printf("PC: 0x%04X, I: 0x%04X, V:", chip8.PC, chip8.I);
+    for (int i = 0; i < 16; i++) printf(" %02X", chip8.V[i]);
+    printf("\n");
+    printf("state hash: %016llX\n", (unsigned long long)chip8_state_hash(&chip8));
+    if (chip8.fault) printf("fault: %s at 0x%03X\n", chip8_fault_name(chip8.fault), chip8.PC);
+    if (profile) {
+        chip8_profile_report(profile, &chip8, 16);
+        chip8_profile_write_csv(profile, config.profile);
+        free(profile);
+    }
+
+    if (config.replay) {
+        const bool match = chip8_state_hash(&chip8) == log.header.state_hash;
+        printf("replay: %s the recorded state hash %016llX\n", match ? "matches" : "MISMATCH with",
+               (unsigned long long)log.header.state_hash);
+        chip8_input_log_free(&log);
+        if (!match) exit(EXIT_FAILURE);
+    }
+
+    if (config.save_state && !chip8_save_state_file(&chip8, config.save_state)) exit(EXIT_FAILURE);
+    chip8_jit_destroy(jit);
+    exit(EXIT_SUCCESS);
+}
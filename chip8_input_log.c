@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chip8_core.h"
+
+// Input logs. Everything else a run depends on is fixed by the header (ROM, CXNN seed,
+//   instruction budget of every frame), so feeding the same key events in before the
+//   same frames repeats the run bit for bit, on any backend and at any speed, given the
+//   recorded quirk profile.
+
+#define KEY_DOWN 0x80           // Event byte: key in the low nibble
+
+static uint64_t rom_hash(const uint8_t *rom, size_t rom_size) {
+    uint64_t hash = 0xCBF29CE484222325ULL;     // FNV-1a
+    for (size_t i = 0; i < rom_size; i++) {
+        hash ^= rom[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+void chip8_input_log_start(chip8_input_log_t *log, const uint8_t *rom, size_t rom_size,
+                           uint32_t seed, uint32_t insts_per_second) {
+    *log = (chip8_input_log_t){
+        .header = {
+            .magic = CHIP8_INPUT_LOG_MAGIC,
+            .version = CHIP8_INPUT_LOG_VERSION,
+            .seed = seed,
+            .insts_per_second = insts_per_second,
+            .rom_hash = rom_hash(rom, rom_size),
+        },
+    };
+}
+
+bool chip8_input_log_key(chip8_input_log_t *log, uint32_t frame, uint8_t key, bool down) {
+    // Worst case: 5 varint bytes + the key byte
+    if (log->header.size + 6 > log->capacity) {
+        const size_t capacity = log->capacity ? log->capacity * 2 : 4096;
+        uint8_t *events = realloc(log->events, capacity);
+        if (events == NULL) return false;
+        log->events = events;
+        log->capacity = capacity;
+    }
+
+    uint32_t delta = frame - log->last_frame;
+    do {
+        log->events[log->header.size++] = (delta & 0x7F) | (delta > 0x7F ? 0x80 : 0);
+        delta >>= 7;
+    } while (delta);
+    log->events[log->header.size++] = (key & 0x0F) | (down ? KEY_DOWN : 0);
+    log->last_frame = frame;
+    return true;
+}
+
+void chip8_input_log_end(chip8_input_log_t *log, uint32_t frames, const chip8_t *chip8) {
+    log->header.frames = frames;
+    log->header.quirks = chip8->quirks;
+    log->header.state_hash = chip8_state_hash(chip8);
+}
+
+bool chip8_input_log_save(const chip8_input_log_t *log, const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "Could not create input log %s\n", path);
+        return false;
+    }
+    bool ok = fwrite(&log->header, sizeof log->header, 1, f) == 1;
+    if (log->header.size) ok &= fwrite(log->events, log->header.size, 1, f) == 1;
+    if (fclose(f) != 0 || !ok) {
+        fprintf(stderr, "Could not write input log %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+bool chip8_input_log_load(chip8_input_log_t *log, const char *path) {
+    *log = (chip8_input_log_t){0};
+
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Input log %s is invalid or does not exist\n", path);
+        return false;
+    }
+
+    bool ok = fread(&log->header, sizeof log->header, 1, f) == 1 &&
+              log->header.magic == CHIP8_INPUT_LOG_MAGIC &&
+              log->header.version == CHIP8_INPUT_LOG_VERSION &&
+              log->header.quirks < CHIP8_QUIRK_PROFILES;
+    if (ok && log->header.size) {
+        log->events = malloc(log->header.size);
+        log->capacity = log->header.size;
+        ok = log->events && fread(log->events, log->header.size, 1, f) == 1;
+    }
+    fclose(f);
+
+    if (!ok) {
+        fprintf(stderr, "%s is not a version %d CHIP8 input log\n", path, CHIP8_INPUT_LOG_VERSION);
+        chip8_input_log_free(log);
+    }
+    return ok;
+}
+
+void chip8_input_log_free(chip8_input_log_t *log) {
+    free(log->events);
+    *log = (chip8_input_log_t){0};
+}
+
+bool chip8_input_log_matches_rom(const chip8_input_log_t *log, const uint8_t *rom, size_t rom_size) {
+    return log->header.rom_hash == rom_hash(rom, rom_size);
+}
+
+void chip8_input_log_replay(chip8_input_log_t *log, uint32_t frame, chip8_t *chip8) {
+    while (log->cursor < log->header.size) {
+        // Peek at the next event's frame
+        size_t at = log->cursor;
+        uint32_t delta = 0;
+        for (uint32_t shift = 0; at < log->header.size && shift < 32; shift += 7) {
+            const uint8_t byte = log->events[at++];
+            delta |= (uint32_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) break;
+        }
+        if (at >= log->header.size || log->last_frame + delta > frame) return;    // Truncated, or later
+
+        const uint8_t event = log->events[at++];
+        chip8->keypad[event & 0x0F] = event & KEY_DOWN;
+        log->last_frame += delta;
+        log->cursor = at;
+    }
+}
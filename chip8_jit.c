@@ -0,0 +1,729 @@
+#define _DEFAULT_SOURCE             // mmap/MAP_ANONYMOUS
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "chip8_core.h"
+#include "chip8_ops.h"
+
+// Dynamic recompiler: straight-line CHIP8 blocks are translated into x86-64 code.
+//   A block runs until (and including) the first 1NNN/2NNN/00EE/BNNN or skip
+//   instruction, or stops right before an instruction it doesn't translate
+//   (DXYN, FX0A, FX18, CXNN, 00E0, EX9E/EXA1, FX33/FX55, invalid opcodes), which the
+//   pre-decoded interpreter then executes. The V registers a block touches are
+//   loaded into host registers on entry and stored back on exit.
+//
+//   Blocks are indexed by start address. RAM is split in 16 pages of 256 bytes;
+//   a write into a page that holds translated code (chip8->jit_pages) throws away
+//   the blocks covering the written byte, see chip8_write_ram. Only blocks starting
+//   at most BLOCK_REACH bytes before it can, so that is all the write looks at;
+//   variables sharing a page with code cost no translations. A page whose code
+//   keeps being overwritten (VOLATILE_WRITES times) is left to the pre-decoded
+//   interpreter, which re-decodes single instructions far cheaper than blocks can
+//   be translated again. Loading a state throws away whole pages instead.
+//
+//   The arena is RX; a translation makes only the host pages it writes RW, and
+//   RX again afterwards. If the host refuses (W^X policies), the JIT stops
+//   translating and everything runs on the pre-decoded interpreter.
+//
+//   Blocks are translated for the machine's quirk profile; chip8_set_quirks drops them.
+
+#define BLOCK_MAX_INSTS  32             // Longest translated block
+#define PAGE_SHIFT       8              // 256 byte CHIP8 pages for invalidation
+#define ARENA_SIZE       (1 << 20)      // Executable code for one machine
+#define BLOCK_MAX_BYTES  16384          // Upper bound of the code for one block
+#define PAGES            (CHIP8_RAM_SIZE >> PAGE_SHIFT)
+#define BLOCK_REACH      (2 * BLOCK_MAX_INSTS - 1)      // Bytes a block can start before a byte it covers
+#define VOLATILE_WRITES  8              // Overwrites of a page's code before it is only interpreted
+
+typedef void (*block_fn_t)(chip8_t *chip8);
+
+typedef enum {
+    BLOCK_NONE,         // Not translated yet
+    BLOCK_NATIVE,       // Translated, code is valid
+    BLOCK_INTERPRET,    // First instruction can't be translated: interpret it
+} block_state_t;
+
+typedef struct {
+    block_fn_t code;
+    uint16_t pages;     // Bitmask of CHIP8 pages the block was translated from
+    uint8_t insts;      // Number of CHIP8 instructions the block executes
+    uint8_t state;      // block_state_t
+} block_t;
+
+struct chip8_jit {
+    uint8_t *arena;     // mmap'd code arena, RX but for the host pages being translated into
+    size_t arena_used;
+    size_t host_page;   // Host page size, what mprotect works in
+    bool failed;        // The host refused to change the arena's protection: translate nothing
+    block_t blocks[CHIP8_ICACHE_SIZE];
+    uint16_t page_blocks[PAGES];    // Blocks registered on each page (block->pages)
+    uint8_t page_writes[PAGES];     // Writes over translated code on each page, up to VOLATILE_WRITES
+    uint64_t code_bytes[CHIP8_RAM_SIZE / 64];  // Bytes blocks were translated from; cleared when next written
+};
+
+// Throw a block away (add_block undone); it is translated again when next reached
+static void drop_block(chip8_t *chip8, chip8_jit_t *jit, block_t *block) {
+    for (uint16_t pages = block->pages; pages; pages &= pages - 1) {
+        const int page = __builtin_ctz(pages);
+        if (--jit->page_blocks[page] == 0) chip8->jit_pages &= ~(1u << page);
+    }
+    block->state = BLOCK_NONE;
+    block->pages = 0;
+}
+
+static bool page_volatile(const chip8_jit_t *jit, uint16_t addr) {
+    return jit->page_writes[addr >> PAGE_SHIFT] >= VOLATILE_WRITES;
+}
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#include <sys/mman.h>
+
+// x86-64 register numbers
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+// Host registers V registers can live in; RDI holds the chip8_t*, RAX/RDX are scratch
+static const uint8_t host_regs[] = { RBX, RBP, RSI, RCX, R8, R9, R10, R11, R12, R13, R14, R15 };
+#define HOST_REG_COUNT (sizeof host_regs / sizeof host_regs[0])
+
+typedef struct {
+    uint8_t *code;
+    size_t len;
+} emitter_t;
+
+static void emit8(emitter_t *e, uint8_t b) { e->code[e->len++] = b; }
+static void emit16(emitter_t *e, uint16_t v) { emit8(e, v); emit8(e, v >> 8); }
+static void emit32(emitter_t *e, uint32_t v) { emit16(e, v); emit16(e, v >> 16); }
+
+// REX prefix; emitted only when needed unless force is set (byte access to SIL etc.)
+static void emit_rex(emitter_t *e, bool w, uint8_t reg, uint8_t rm, bool force) {
+    const uint8_t rex = 0x40 | (w << 3) | ((reg >= 8) << 2) | (rm >= 8);
+    if (rex != 0x40 || force) emit8(e, rex);
+}
+
+// op r/m32, r32 with two registers (mov 89, add 01, or 09, and 21, sub 29, xor 31, cmp 39)
+static void emit_rr(emitter_t *e, uint8_t op, uint8_t dst, uint8_t src) {
+    emit_rex(e, false, src, dst, false);
+    emit8(e, op);
+    emit8(e, 0xC0 | (src & 7) << 3 | (dst & 7));
+}
+
+// Group 1 op r32, imm32 (ext: add 0, or 1, and 4, sub 5, xor 6, cmp 7)
+static void emit_ri(emitter_t *e, uint8_t ext, uint8_t dst, uint32_t imm) {
+    emit_rex(e, false, 0, dst, false);
+    emit8(e, 0x81);
+    emit8(e, 0xC0 | ext << 3 | (dst & 7));
+    emit32(e, imm);
+}
+
+static void emit_mov_ri(emitter_t *e, uint8_t dst, uint32_t imm) {
+    emit_rex(e, false, 0, dst, false);
+    emit8(e, 0xB8 | (dst & 7));
+    emit32(e, imm);
+}
+
+// Shift r32 by an immediate (ext: shl 4, shr 5)
+static void emit_shift(emitter_t *e, uint8_t ext, uint8_t dst, uint8_t count) {
+    emit_rex(e, false, 0, dst, false);
+    emit8(e, 0xC1);
+    emit8(e, 0xC0 | ext << 3 | (dst & 7));
+    emit8(e, count);
+}
+
+// ModRM + disp32 for [rdi + disp]
+static void emit_mem(emitter_t *e, uint8_t reg, uint32_t disp) {
+    emit8(e, 0x80 | (reg & 7) << 3 | RDI);
+    emit32(e, disp);
+}
+
+// movzx r32, byte [rdi + disp]
+static void emit_load8(emitter_t *e, uint8_t dst, uint32_t disp) {
+    emit_rex(e, false, dst, 0, false);
+    emit8(e, 0x0F); emit8(e, 0xB6);
+    emit_mem(e, dst, disp);
+}
+
+// mov byte [rdi + disp], r8
+static void emit_store8(emitter_t *e, uint8_t src, uint32_t disp) {
+    emit_rex(e, false, src, 0, true);
+    emit8(e, 0x88);
+    emit_mem(e, src, disp);
+}
+
+// mov word [rdi + disp], r16
+static void emit_store16(emitter_t *e, uint8_t src, uint32_t disp) {
+    emit8(e, 0x66);
+    emit_rex(e, false, src, 0, false);
+    emit8(e, 0x89);
+    emit_mem(e, src, disp);
+}
+
+// mov word [rdi + disp], imm16
+static void emit_store16_imm(emitter_t *e, uint32_t disp, uint16_t imm) {
+    emit8(e, 0x66); emit8(e, 0xC7);
+    emit_mem(e, 0, disp);
+    emit16(e, imm);
+}
+
+// add word [rdi + disp], r16
+static void emit_add16(emitter_t *e, uint8_t src, uint32_t disp) {
+    emit8(e, 0x66);
+    emit_rex(e, false, src, 0, false);
+    emit8(e, 0x01);
+    emit_mem(e, src, disp);
+}
+
+// Conditional/unconditional short jump forward (jb 72, ja 77, jmp EB); returns the
+//   position patch_jump8 fills in once the target is emitted
+static size_t emit_jump8(emitter_t *e, uint8_t op) {
+    emit8(e, op);
+    emit8(e, 0);
+    return e->len;
+}
+
+static void patch_jump8(emitter_t *e, size_t from) {
+    e->code[from - 1] = (uint8_t)(e->len - from);
+}
+
+// Unconditional near jump forward (jmp rel32), for targets further than 127 bytes
+static size_t emit_jump32(emitter_t *e) {
+    emit8(e, 0xE9);
+    emit32(e, 0);
+    return e->len;
+}
+
+static void patch_jump32(emitter_t *e, size_t from) {
+    const uint32_t rel = (uint32_t)(e->len - from);
+    memcpy(&e->code[from - 4], &rel, sizeof rel);
+}
+
+// Set eax to 1 if the last compare was "above or equal" (unsigned), else 0
+static void emit_setae_eax(emitter_t *e) {
+    emit8(e, 0x0F); emit8(e, 0x93); emit8(e, 0xC0);     // setae al
+    emit8(e, 0x0F); emit8(e, 0xB6); emit8(e, 0xC0);     // movzx eax, al
+}
+
+static void emit_push(emitter_t *e, uint8_t r) {
+    if (r >= 8) emit8(e, 0x41);
+    emit8(e, 0x50 | (r & 7));
+}
+
+static void emit_pop(emitter_t *e, uint8_t r) {
+    if (r >= 8) emit8(e, 0x41);
+    emit8(e, 0x58 | (r & 7));
+}
+
+static bool is_callee_saved(uint8_t r) {
+    return r == RBX || r == RBP || r >= R12;
+}
+
+// Which V registers an instruction reads or writes; false if it can't be translated
+static bool inst_regs(const uint16_t opcode, const chip8_quirk_flags_t *q, uint16_t *used) {
+    const uint8_t X = (opcode >> 8) & 0x0F;
+    const uint8_t Y = (opcode >> 4) & 0x0F;
+    const uint8_t NN = opcode & 0xFF;
+
+    switch (opcode >> 12) {
+        case 0x0: *used = 0; return opcode == 0x00EE;
+        case 0x1: case 0x2: *used = 0; return true;
+        case 0x3: case 0x4: case 0x6: case 0x7: *used = 1u << X; return true;
+        case 0x5: case 0x9: *used = (1u << X) | (1u << Y); return (opcode & 0x0F) == 0;
+        case 0x8:
+            *used = (1u << X) | (1u << Y) | (1u << 0xF);
+            switch (opcode & 0x0F) {
+                case 0x0: *used = (1u << X) | (1u << Y); return true;
+                case 0x1: case 0x2: case 0x3: case 0x4: case 0x5:
+                case 0x6: case 0x7: case 0xE: return true;
+                default: return false;
+            }
+        case 0xA: *used = 0; return true;
+        case 0xB: *used = q->jump_vx ? 1u << X : 1u; return true;
+        case 0xF:
+            *used = 1u << X;
+            switch (NN) {
+                case 0x07: case 0x15: case 0x1E: case 0x29: return true;
+                case 0x65: *used = (uint16_t)((2u << X) - 1); return true;
+                default: return false;
+            }
+        default:
+            return false;
+    }
+}
+
+static bool ends_block(const uint16_t opcode) {
+    switch (opcode >> 12) {
+        case 0x0: case 0x1: case 0x2: case 0x3: case 0x4:
+        case 0x5: case 0x9: case 0xB:
+            return true;
+        default:
+            return false;
+    }
+}
+
+#define OFF_V(i)    ((uint32_t)(offsetof(chip8_t, V) + (i)))
+#define OFF_I       ((uint32_t)offsetof(chip8_t, I))
+#define OFF_PC      ((uint32_t)offsetof(chip8_t, PC))
+#define OFF_DT      ((uint32_t)offsetof(chip8_t, delay_timer))
+#define OFF_SP      ((uint32_t)offsetof(chip8_t, stack_ptr))
+#define OFF_STACK   ((uint32_t)offsetof(chip8_t, stack))
+#define OFF_FAULT   ((uint32_t)offsetof(chip8_t, fault))
+#define OFF_RAM     ((uint32_t)offsetof(chip8_t, ram))
+
+_Static_assert(sizeof(chip8_fault_t) == 4, "faults are stored as dwords");
+
+// Stack fault in the instruction at pc: record it and leave PC (edx) on the instruction
+static void emit_fault(emitter_t *e, chip8_fault_t fault, uint16_t pc) {
+    emit8(e, 0xC7); emit_mem(e, 0, OFF_FAULT); emit32(e, fault);       // mov dword [rdi+fault], fault
+    emit_mov_ri(e, RDX, pc);
+}
+
+// Translate one instruction at address pc; the new PC (if the instruction ends
+//   the block) is left in edx.
+static void emit_inst(emitter_t *e, const uint8_t *reg, const chip8_quirk_flags_t *q,
+                      const uint16_t opcode, const uint16_t pc) {
+    const uint8_t X = (opcode >> 8) & 0x0F;
+    const uint8_t Y = (opcode >> 4) & 0x0F;
+    const uint8_t NN = opcode & 0xFF;
+    const uint16_t NNN = opcode & 0x0FFF;
+    const uint8_t rX = reg[X], rY = reg[Y], rF = reg[0xF];
+    const uint8_t rS = q->shift_vx ? rX : rY;  // 8XY6/8XYE source
+
+    switch (opcode >> 12) {
+        case 0x0:
+            //0x00EE: Return from subroutine: edx = *--stack_ptr, unless the stack is empty
+            emit8(e, 0x48); emit8(e, 0x8B); emit_mem(e, RAX, OFF_SP);         // mov rax, [rdi+sp]
+            emit8(e, 0x48); emit8(e, 0x8D); emit_mem(e, RDX, OFF_STACK);      // lea rdx, [rdi+stack]
+            emit8(e, 0x48); emit8(e, 0x39); emit8(e, 0xD0);                   // cmp rax, rdx
+            {
+                const size_t pop = emit_jump8(e, 0x77);                       // ja pop
+                emit_fault(e, CHIP8_FAULT_STACK_UNDERFLOW, pc);
+                const size_t done = emit_jump8(e, 0xEB);                      // jmp done
+                patch_jump8(e, pop);
+                emit8(e, 0x48); emit8(e, 0x83); emit8(e, 0xE8); emit8(e, 2);  // sub rax, 2
+                emit8(e, 0x48); emit8(e, 0x89); emit_mem(e, RAX, OFF_SP);     // mov [rdi+sp], rax
+                emit8(e, 0x0F); emit8(e, 0xB7); emit8(e, 0x10);               // movzx edx, word [rax]
+                patch_jump8(e, done);
+            }
+            break;
+
+        case 0x1:
+            //0x1NNN: Jumps to address NNN
+            emit_mov_ri(e, RDX, NNN);
+            break;
+
+        case 0x2:
+            //0x2NNN: *stack_ptr++ = return address; jump to NNN, unless the stack is full
+            emit8(e, 0x48); emit8(e, 0x8B); emit_mem(e, RAX, OFF_SP);         // mov rax, [rdi+sp]
+            emit8(e, 0x48); emit8(e, 0x8D);                                   // lea rdx, [rdi+stack+depth]
+            emit_mem(e, RDX, OFF_STACK + 2 * CHIP8_STACK_DEPTH);
+            emit8(e, 0x48); emit8(e, 0x39); emit8(e, 0xD0);                   // cmp rax, rdx
+            {
+                const size_t push = emit_jump8(e, 0x72);                      // jb push
+                emit_fault(e, CHIP8_FAULT_STACK_OVERFLOW, pc);
+                const size_t done = emit_jump8(e, 0xEB);                      // jmp done
+                patch_jump8(e, push);
+                emit8(e, 0x66); emit8(e, 0xC7); emit8(e, 0x00); emit16(e, pc + 2);  // mov word [rax], pc+2
+                emit8(e, 0x48); emit8(e, 0x83); emit_mem(e, 0, OFF_SP); emit8(e, 2); // add qword [rdi+sp], 2
+                emit_mov_ri(e, RDX, NNN);
+                patch_jump8(e, done);
+            }
+            break;
+
+        case 0x3: case 0x4: case 0x5: case 0x9:
+            // Skips: edx = pc + 2, or pc + 4 if the condition holds
+            if ((opcode >> 12) == 0x3 || (opcode >> 12) == 0x4) {
+                emit_ri(e, 7, rX, NN);                      // cmp VX, NN
+            } else {
+                emit_rr(e, 0x39, rX, rY);                   // cmp VX, VY
+            }
+            emit_mov_ri(e, RDX, pc + 2);
+            emit_mov_ri(e, RAX, pc + 4);
+            emit8(e, 0x0F);
+            emit8(e, ((opcode >> 12) == 0x3 || (opcode >> 12) == 0x5) ? 0x44 : 0x45);  // cmove/cmovne
+            emit8(e, 0xD0);                                 // edx, eax
+            break;
+
+        case 0x6:
+            //0x6XNN: VX = NN
+            emit_mov_ri(e, rX, NN);
+            break;
+
+        case 0x7:
+            //0x7XNN: VX += NN
+            emit_ri(e, 0, rX, NN);
+            emit_ri(e, 4, rX, 0xFF);
+            break;
+
+        case 0x8:
+            switch (opcode & 0x0F) {
+                case 0x0:
+                    emit_rr(e, 0x89, rX, rY);               // VX = VY
+                    break;
+                case 0x1: case 0x2: case 0x3: {
+                    static const uint8_t ops[] = { 0, 0x09, 0x21, 0x31 };
+                    emit_rr(e, ops[opcode & 0x0F], rX, rY); // VX |= &= ^= VY
+                    if (q->vf_reset) emit_rr(e, 0x31, rF, rF);  // VF = 0
+                    break;
+                }
+                case 0x4:
+                    emit_rr(e, 0x01, rX, rY);               // VX += VY (9 bits)
+                    emit_rr(e, 0x89, RAX, rX);
+                    emit_shift(e, 5, RAX, 8);               // eax = carry
+                    emit_ri(e, 4, rX, 0xFF);
+                    emit_rr(e, 0x89, rF, RAX);
+                    break;
+                case 0x5:
+                    emit_rr(e, 0x39, rX, rY);               // cmp VX, VY
+                    emit_setae_eax(e);                      // eax = no borrow
+                    emit_rr(e, 0x29, rX, rY);
+                    emit_ri(e, 4, rX, 0xFF);
+                    emit_rr(e, 0x89, rF, RAX);
+                    break;
+                case 0x6:
+                    emit_rr(e, 0x89, RAX, rS);
+                    emit_ri(e, 4, RAX, 0x01);               // eax = VY & 1 (VX with shift_vx)
+                    emit_rr(e, 0x89, rX, rS);
+                    emit_shift(e, 5, rX, 1);
+                    emit_rr(e, 0x89, rF, RAX);
+                    break;
+                case 0x7:
+                    emit_rr(e, 0x39, rY, rX);               // cmp VY, VX
+                    emit_setae_eax(e);                      // eax = no borrow
+                    emit_rr(e, 0x89, RDX, rY);
+                    emit_rr(e, 0x29, RDX, rX);
+                    emit_ri(e, 4, RDX, 0xFF);
+                    emit_rr(e, 0x89, rX, RDX);
+                    emit_rr(e, 0x89, rF, RAX);
+                    break;
+                case 0xE:
+                    emit_rr(e, 0x89, RAX, rS);
+                    emit_shift(e, 5, RAX, 7);               // eax = VY >> 7 (VX with shift_vx)
+                    emit_rr(e, 0x89, rX, rS);
+                    emit_shift(e, 4, rX, 1);
+                    emit_ri(e, 4, rX, 0xFF);
+                    emit_rr(e, 0x89, rF, RAX);
+                    break;
+            }
+            break;
+
+        case 0xA:
+            //0xANNN: I = NNN
+            emit_store16_imm(e, OFF_I, NNN);
+            break;
+
+        case 0xB:
+            //0xBNNN: Jump to NNN + V0 (BXNN: + VX with jump_vx)
+            emit_rr(e, 0x89, RDX, q->jump_vx ? rX : reg[0]);
+            emit_ri(e, 0, RDX, NNN);
+            break;
+
+        case 0xF:
+            switch (NN) {
+                case 0x07:
+                    emit_load8(e, rX, OFF_DT);              // VX = delay timer
+                    break;
+                case 0x15:
+                    emit_store8(e, rX, OFF_DT);             // delay timer = VX
+                    break;
+                case 0x1E:
+                    emit_add16(e, rX, OFF_I);               // I += VX
+                    break;
+                case 0x29:
+                    emit_rex(e, false, RAX, rX, false);     // imul eax, VX, 5
+                    emit8(e, 0x6B); emit8(e, 0xC0 | (rX & 7)); emit8(e, 5);
+                    emit_store16(e, RAX, OFF_I);
+                    break;
+                case 0x65:
+                    // V0..VX = ram[I..I+X]; I += X + 1 with increment_i. Reads wrap around
+                    //   the end of RAM: the masked loads only run when I + X is past it.
+                    emit8(e, 0x0F); emit8(e, 0xB7); emit_mem(e, RAX, OFF_I);   // movzx eax, word [rdi+I]
+                    emit8(e, 0x3D); emit32(e, CHIP8_ADDR_MASK - X);            // cmp eax, 0xFFF - X
+                    {
+                        const size_t wrap = emit_jump8(e, 0x77);               // ja wrap
+                        for (uint8_t i = 0; i <= X; i++) {
+                            emit_rex(e, false, reg[i], 0, false);              // movzx Vi, byte [rdi+rax+ram+i]
+                            emit8(e, 0x0F); emit8(e, 0xB6);
+                            emit8(e, 0x84 | (reg[i] & 7) << 3);
+                            emit8(e, 0x07);                                    // SIB: rdi + rax
+                            emit32(e, OFF_RAM + i);
+                        }
+                        const size_t done = emit_jump32(e);                    // jmp done
+                        patch_jump8(e, wrap);
+                        for (uint8_t i = 0; i <= X; i++) {
+                            emit8(e, 0x8D); emit8(e, 0x50); emit8(e, i);       // lea edx, [rax+i]
+                            emit_ri(e, 4, RDX, CHIP8_ADDR_MASK);               // and edx, 0xFFF
+                            emit_rex(e, false, reg[i], 0, false);              // movzx Vi, byte [rdi+rdx+ram]
+                            emit8(e, 0x0F); emit8(e, 0xB6);
+                            emit8(e, 0x84 | (reg[i] & 7) << 3);
+                            emit8(e, 0x17);                                    // SIB: rdi + rdx
+                            emit32(e, OFF_RAM);
+                        }
+                        patch_jump32(e, done);
+                    }
+                    if (q->increment_i) {
+                        emit8(e, 0x66); emit8(e, 0x81); emit_mem(e, 0, OFF_I); emit16(e, X + 1);
+                    }
+                    break;
+            }
+            break;
+    }
+}
+
+// Register a block on the bytes and pages it covers, so writes there throw it away
+static void add_block(chip8_t *chip8, chip8_jit_t *jit, block_t *block, uint16_t start, uint16_t end) {
+    for (uint32_t addr = start; addr <= end; addr++) jit->code_bytes[addr >> 6] |= 1ull << (addr & 63);
+
+    uint16_t pages = (uint16_t)((2u << (end >> PAGE_SHIFT)) - (1u << (start >> PAGE_SHIFT)));
+    block->pages = pages;
+    chip8->jit_pages |= pages;
+    for (; pages; pages &= pages - 1) jit->page_blocks[__builtin_ctz(pages)]++;
+}
+
+// Change the protection of the host pages the next block is emitted into
+static bool protect(chip8_jit_t *jit, int prot) {
+    const size_t from = jit->arena_used & ~(jit->host_page - 1);
+    const size_t to = (jit->arena_used + BLOCK_MAX_BYTES + jit->host_page - 1) & ~(jit->host_page - 1);
+    return mprotect(jit->arena + from, (to < ARENA_SIZE ? to : ARENA_SIZE) - from, prot) == 0;
+}
+
+// Translate the block starting at pc into the arena; false if nothing could be translated
+static bool translate(chip8_t *chip8, chip8_jit_t *jit, const uint16_t start) {
+    block_t *block = &jit->blocks[start >> 1];
+    const chip8_quirk_flags_t *const q = &chip8_quirk_flags[chip8->quirks];
+    uint16_t opcodes[BLOCK_MAX_INSTS];
+    uint16_t used = 0;
+    uint8_t count = 0;
+    bool has_exit = false;      // Last instruction computes the next PC itself
+
+    // Interpreted for good (until chip8_jit_reset): not registered on any page
+    if (jit->failed || page_volatile(jit, start)) {
+        block->state = BLOCK_INTERPRET;
+        return false;
+    }
+
+    // Scan: find the block's extent and the V registers it touches
+    for (uint16_t pc = start; count < BLOCK_MAX_INSTS && pc + 1 < CHIP8_RAM_SIZE; pc += 2) {
+        if (page_volatile(jit, pc)) break;
+        const uint16_t opcode = (chip8->ram[pc] << 8) | chip8->ram[pc + 1];
+        uint16_t regs;
+        if (!inst_regs(opcode, q, &regs)) break;
+        if (__builtin_popcount(used | regs) > (int)HOST_REG_COUNT) break;
+        used |= regs;
+        opcodes[count++] = opcode;
+        if (ends_block(opcode)) {
+            has_exit = true;
+            break;
+        }
+    }
+
+    // Retried once a write to the page changes the instruction
+    if (count == 0) {
+        block->state = BLOCK_INTERPRET;
+        add_block(chip8, jit, block, start, start + 1);
+        return false;
+    }
+
+    // Flush everything when the arena is full
+    if (jit->arena_used + BLOCK_MAX_BYTES > ARENA_SIZE) {
+        memset(jit->blocks, 0, sizeof jit->blocks);
+        memset(jit->page_blocks, 0, sizeof jit->page_blocks);
+        memset(jit->code_bytes, 0, sizeof jit->code_bytes);
+        jit->arena_used = 0;
+        chip8->jit_pages = 0;
+    }
+
+    // Assign host registers
+    uint8_t reg[16] = {0};
+    for (uint8_t i = 0, next = 0; i < 16; i++) {
+        if (used & (1u << i)) reg[i] = host_regs[next++];
+    }
+
+    if (!protect(jit, PROT_READ | PROT_WRITE)) {
+        jit->failed = true;
+        block->state = BLOCK_INTERPRET;
+        return false;
+    }
+    emitter_t e = { .code = jit->arena + jit->arena_used, .len = 0 };
+
+    // Prologue: save callee-saved registers, load V registers
+    for (uint8_t i = 0; i < 16; i++) {
+        if ((used & (1u << i)) && is_callee_saved(reg[i])) emit_push(&e, reg[i]);
+    }
+    for (uint8_t i = 0; i < 16; i++) {
+        if (used & (1u << i)) emit_load8(&e, reg[i], OFF_V(i));
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+        emit_inst(&e, reg, q, opcodes[i], start + 2 * i);
+    }
+
+    // Epilogue: store V registers and PC, restore callee-saved registers
+    for (uint8_t i = 0; i < 16; i++) {
+        if (used & (1u << i)) emit_store8(&e, reg[i], OFF_V(i));
+    }
+    if (has_exit) {
+        emit_store16(&e, RDX, OFF_PC);
+    } else {
+        emit_store16_imm(&e, OFF_PC, start + 2 * count);
+    }
+    for (int i = 15; i >= 0; i--) {
+        if ((used & (1u << i)) && is_callee_saved(reg[i])) emit_pop(&e, reg[i]);
+    }
+    emit8(&e, 0xC3);                                    // ret
+
+    // Blocks sharing these host pages can't run any more either: drop them all
+    if (!protect(jit, PROT_READ | PROT_EXEC)) {
+        jit->failed = true;
+        memset(jit->blocks, 0, sizeof jit->blocks);
+        memset(jit->page_blocks, 0, sizeof jit->page_blocks);
+        chip8->jit_pages = 0;
+        block->state = BLOCK_INTERPRET;
+        return false;
+    }
+
+    const uint16_t end = start + 2 * count - 1;         // Last byte of the block
+    block->code = (block_fn_t)(void *)(jit->arena + jit->arena_used);
+    block->insts = count;
+    block->state = BLOCK_NATIVE;
+    add_block(chip8, jit, block, start, end);
+
+    jit->arena_used += (e.len + 15) & ~(size_t)15;
+    return true;
+}
+
+void chip8_jit_prebuild(chip8_t *chip8, const chip8_map_t *map) {
+    chip8_jit_t *jit = chip8->jit;
+
+    // Execution enters a block at a basic block leader, or right after an instruction
+    //   that was interpreted instead or a block that stopped short of one
+    for (uint32_t leader = 0; leader < CHIP8_RAM_SIZE; leader += 2) {
+        if (!(map->bytes[leader] & CHIP8_MAP_LEADER)) continue;
+
+        for (uint32_t pc = leader; pc + 1 < CHIP8_RAM_SIZE && (map->bytes[pc] & CHIP8_MAP_INST); ) {
+            block_t *block = &jit->blocks[pc >> 1];
+            if (block->state == BLOCK_NONE) translate(chip8, jit, pc);
+            if (block->state != BLOCK_NATIVE) {
+                pc += 2;
+                continue;
+            }
+
+            const uint32_t last = pc + 2 * (block->insts - 1);
+            if (ends_block((chip8->ram[last] << 8) | chip8->ram[last + 1])) break;
+            pc += 2 * block->insts;
+        }
+    }
+}
+
+chip8_jit_t *chip8_jit_create(void) {
+    chip8_jit_t *jit = calloc(1, sizeof *jit);
+    if (jit == NULL) return NULL;
+
+    jit->arena = mmap(NULL, ARENA_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->arena == MAP_FAILED) {
+        free(jit);
+        return NULL;
+    }
+    const long host_page = sysconf(_SC_PAGESIZE);
+    jit->host_page = host_page > 0 ? (size_t)host_page : 4096;
+    return jit;
+}
+
+void chip8_jit_destroy(chip8_jit_t *jit) {
+    if (jit == NULL) return;
+    munmap(jit->arena, ARENA_SIZE);
+    free(jit);
+}
+
+#else
+
+// No recompiler for this host; chip8_set_backend falls back to the cached interpreter
+chip8_jit_t *chip8_jit_create(void) { return NULL; }
+void chip8_jit_destroy(chip8_jit_t *jit) { (void)jit; }
+void chip8_jit_prebuild(chip8_t *chip8, const chip8_map_t *map) { (void)chip8; (void)map; }
+
+static bool translate(chip8_t *chip8, chip8_jit_t *jit, const uint16_t start) {
+    (void)chip8; (void)jit; (void)start;
+    return false;
+}
+
+#endif
+
+void chip8_jit_reset(chip8_jit_t *jit) {
+    memset(jit->blocks, 0, sizeof jit->blocks);
+    memset(jit->page_blocks, 0, sizeof jit->page_blocks);
+    memset(jit->page_writes, 0, sizeof jit->page_writes);
+    memset(jit->code_bytes, 0, sizeof jit->code_bytes);
+    jit->arena_used = 0;
+}
+
+void chip8_jit_invalidate(chip8_t *chip8, uint16_t addr) {
+    chip8_jit_t *jit = chip8->jit;
+    if (!(jit->code_bytes[addr >> 6] & (1ull << (addr & 63)))) return;    // Data next to code
+
+    const uint32_t first = addr > BLOCK_REACH ? (addr - BLOCK_REACH) & ~1u : 0;
+    bool overwritten = false;
+
+    for (uint32_t pc = first; pc <= addr; pc += 2) {
+        block_t *block = &jit->blocks[pc >> 1];
+        if (block->state == BLOCK_NONE || block->pages == 0) continue;
+
+        // A block that is interpreted covers just its first instruction
+        const uint32_t insts = block->state == BLOCK_NATIVE ? block->insts : 1;
+        if (addr >= pc + 2 * insts) continue;
+        overwritten |= block->state == BLOCK_NATIVE;
+        drop_block(chip8, jit, block);
+    }
+
+    jit->code_bytes[addr >> 6] &= ~(1ull << (addr & 63));  // No block covers it any more
+
+    const uint8_t page = addr >> PAGE_SHIFT;
+    if (overwritten && jit->page_writes[page] < VOLATILE_WRITES) jit->page_writes[page]++;
+}
+
+void chip8_jit_invalidate_page(chip8_t *chip8, uint8_t page) {
+    chip8_jit_t *jit = chip8->jit;
+    const uint32_t page_start = (uint32_t)page << PAGE_SHIFT;
+    const uint32_t first = page_start > BLOCK_REACH ? (page_start - BLOCK_REACH) & ~1u : 0;
+
+    for (uint32_t pc = first; pc < page_start + (1u << PAGE_SHIFT); pc += 2) {
+        block_t *block = &jit->blocks[pc >> 1];
+        if (block->state != BLOCK_NONE && (block->pages & (1u << page))) drop_block(chip8, jit, block);
+    }
+}
+
+uint32_t chip8_run_jit(chip8_t *chip8, uint32_t max_insts) {
+#ifdef DEBUG
+    if (chip8->trace) return chip8_run_cached(chip8, max_insts);   // Blocks don't trace
+#endif
+    chip8_jit_t *jit = chip8->jit;
+    uint32_t n = 0;
+
+    while (n < max_insts) {
+        const uint16_t pc = chip8->PC;
+
+        if (!(pc & 1) && pc < CHIP8_RAM_SIZE) {
+            block_t *block = &jit->blocks[pc >> 1];
+            if (block->state == BLOCK_NONE) translate(chip8, jit, pc);
+
+            // Only run a whole block if it fits in the budget, so frames end
+            //   on exactly the same instruction as the interpreter
+            if (block->state == BLOCK_NATIVE && block->insts <= max_insts - n) {
+                block->code(chip8);
+                n += block->insts;
+                continue;
+            }
+        }
+
+        // Everything else goes through the pre-decoded interpreter, one instruction at a
+        //   time, or a block's worth on a page that is only interpreted
+        uint32_t step = 1;
+        if (!(pc & 1) && pc < CHIP8_RAM_SIZE && page_volatile(jit, pc)) {
+            step = max_insts - n < BLOCK_MAX_INSTS ? max_insts - n : BLOCK_MAX_INSTS;
+        }
+        const bool tone = chip8->sound_timer != 0;
+        n += chip8_run_cached(chip8, step);
+        if (chip8->inst.opcode >> 12 == 0xD) break;     // Display wait
+        if ((chip8->sound_timer != 0) != tone) break;   // FX18 started or stopped the tone
+    }
+    return n;
+}
@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chip8_core.h"
+#include "chip8_ops.h"
+
+// ROM maps. The analysis is a worklist over instruction addresses: each address keeps
+//   the value I has on entry to it (a constant, or unknown once two paths disagree), and
+//   is processed again whenever that value changes, so loops settle after a few rounds.
+//   Returns from subroutines go wherever the stack says, so a call's return site is
+//   queued by the call itself, with I unknown (the subroutine may have moved it).
+//   Like the interpreter, PC and I wrap around the end of RAM.
+
+#define I_UNSEEN  0x10000           // Entry I of an address not reached yet
+#define I_UNKNOWN 0x20000           // Paths into the address disagree about I
+#define PAGE_SHIFT 8
+
+typedef struct {
+    chip8_map_t *map;
+    const uint8_t *ram;
+    const chip8_quirk_flags_t *q;
+    uint32_t entry_I[CHIP8_RAM_SIZE];
+    uint16_t work[CHIP8_RAM_SIZE];  // Addresses to (re)process
+    uint32_t work_count;
+    bool queued[CHIP8_RAM_SIZE];
+} analysis_t;
+
+static uint64_t rom_hash(const uint8_t *rom, size_t rom_size) {
+    uint64_t hash = 0xCBF29CE484222325ULL;     // FNV-1a
+    for (size_t i = 0; i < rom_size; i++) {
+        hash ^= rom[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+// Control can reach pc with I; leader: pc starts a basic block
+static void reach(analysis_t *a, uint32_t pc, uint32_t I, bool leader) {
+    if (pc >= CHIP8_RAM_SIZE) {
+        pc &= CHIP8_ADDR_MASK;
+        leader = true;      // Blocks end at the end of RAM
+    }
+    if (leader) a->map->bytes[pc] |= CHIP8_MAP_LEADER;
+
+    uint32_t *const entry = &a->entry_I[pc];
+    if (*entry == I || *entry == I_UNKNOWN) return;
+    *entry = *entry == I_UNSEEN ? I : I_UNKNOWN;
+    if (!a->queued[pc]) {
+        a->queued[pc] = true;
+        a->work[a->work_count++] = pc;
+    }
+}
+
+// Mark len bytes from I on (if I is known) as accessed; false if I is unknown
+static bool mark(analysis_t *a, uint32_t I, uint32_t len, uint8_t kind) {
+    if (I >= I_UNSEEN) return false;
+    for (uint32_t i = I; i < I + len; i++) a->map->bytes[i & CHIP8_ADDR_MASK] |= kind;
+    return true;
+}
+
+static void analyze(analysis_t *a, const uint16_t pc) {
+    const uint16_t opcode = (a->ram[pc] << 8) | a->ram[(pc + 1) & CHIP8_ADDR_MASK];
+    const uint8_t X = (opcode >> 8) & 0x0F;
+    const uint8_t N = opcode & 0x0F;
+    const uint16_t NNN = opcode & 0x0FFF;
+    uint32_t I = a->entry_I[pc];
+
+    a->map->bytes[pc] |= CHIP8_MAP_CODE | CHIP8_MAP_INST;
+    a->map->bytes[(pc + 1) & CHIP8_ADDR_MASK] |= CHIP8_MAP_CODE;
+
+    switch (opcode >> 12) {
+        case 0x0:
+            if (opcode == 0x00EE) return;       // Back to a return site its call queued
+            break;
+
+        case 0x1:
+            reach(a, NNN, I, true);
+            return;
+
+        case 0x2:
+            reach(a, NNN, I, true);
+            reach(a, pc + 2, I_UNKNOWN, true);
+            return;
+
+        case 0x3: case 0x4: case 0x5: case 0x9: case 0xE:
+            // Skips (EXxx with any other NN does nothing and falls through)
+            if ((opcode >> 12) != 0xE || (opcode & 0xFF) == 0x9E || (opcode & 0xFF) == 0xA1) {
+                reach(a, pc + 2, I, true);
+                reach(a, pc + 4, I, true);
+                return;
+            }
+            break;
+
+        case 0xA:
+            I = NNN;
+            break;
+
+        case 0xB:
+            a->map->bytes[pc] |= CHIP8_MAP_INDIRECT;
+            a->map->flags |= CHIP8_MAP_HAS_INDIRECT;
+            return;
+
+        case 0xD:
+            mark(a, I, N, CHIP8_MAP_SPRITE);
+            break;
+
+        case 0xF:
+            switch (opcode & 0xFF) {
+                case 0x1E: case 0x29:
+                    I = I_UNKNOWN;
+                    break;
+                case 0x33:
+                    if (!mark(a, I, 3, CHIP8_MAP_STORED)) a->map->flags |= CHIP8_MAP_UNKNOWN_STORES;
+                    break;
+                case 0x55:
+                    if (!mark(a, I, X + 1, CHIP8_MAP_STORED)) a->map->flags |= CHIP8_MAP_UNKNOWN_STORES;
+                    if (a->q->increment_i && I < I_UNSEEN) I = (I + X + 1) & 0xFFFF;
+                    break;
+                case 0x65:
+                    mark(a, I, X + 1, CHIP8_MAP_LOADED);
+                    if (a->q->increment_i && I < I_UNSEEN) I = (I + X + 1) & 0xFFFF;
+                    break;
+            }
+            break;
+    }
+    reach(a, pc + 2, I, false);
+}
+
+void chip8_map_build(chip8_map_t *map, const uint8_t *rom, size_t rom_size, chip8_quirks_t quirks) {
+    if (rom_size > CHIP8_MAX_ROM_SIZE) rom_size = CHIP8_MAX_ROM_SIZE;
+    if (quirks >= CHIP8_QUIRK_PROFILES) quirks = CHIP8_QUIRKS_VIP;
+
+    *map = (chip8_map_t){
+        .magic = CHIP8_MAP_MAGIC,
+        .version = CHIP8_MAP_VERSION,
+        .size = sizeof *map,
+        .rom_hash = rom_hash(rom, rom_size),
+        .rom_size = rom_size,
+        .quirks = quirks,
+    };
+
+    // Analyze RAM as chip8_init leaves it (font included)
+    analysis_t *a = calloc(1, sizeof *a);
+    chip8_t *machine = malloc(sizeof *machine);
+    if (a == NULL || machine == NULL) {
+        map->flags = CHIP8_MAP_HAS_INDIRECT;    // Nothing proven
+        free(a);
+        free(machine);
+        return;
+    }
+    chip8_init(machine, rom, rom_size);
+    *a = (analysis_t){ .map = map, .ram = machine->ram, .q = &chip8_quirk_flags[quirks] };
+    for (uint32_t i = 0; i < CHIP8_RAM_SIZE; i++) a->entry_I[i] = I_UNSEEN;
+
+    reach(a, CHIP8_ENTRY_POINT, 0, true);       // chip8_init clears I
+    while (a->work_count) {
+        const uint16_t pc = a->work[--a->work_count];
+        a->queued[pc] = false;
+        analyze(a, pc);
+    }
+
+    for (uint32_t i = 0; i < CHIP8_RAM_SIZE; i++) {
+        if ((map->bytes[i] & CHIP8_MAP_CODE) && (map->bytes[i] & CHIP8_MAP_STORED)) map->flags |= CHIP8_MAP_STORES_CODE;
+    }
+
+    // A page is data-only without code in it or in the last 4 bytes before it: pre-decoded
+    //   entries fused there cover the first instructions of the page
+    if (map->flags == 0) {
+        for (uint32_t page = 0; page < CHIP8_RAM_SIZE >> PAGE_SHIFT; page++) {
+            const uint32_t start = page << PAGE_SHIFT;
+            bool code = false;
+            for (uint32_t i = start >= 4 ? start - 4 : 0; i < start + (1u << PAGE_SHIFT); i++) {
+                code |= map->bytes[i] & CHIP8_MAP_CODE;
+            }
+            if (!code) map->data_pages |= 1u << page;
+        }
+    }
+    free(machine);
+    free(a);
+}
+
+bool chip8_map_save(const chip8_map_t *map, const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "Could not create ROM map %s\n", path);
+        return false;
+    }
+    const bool ok = fwrite(map, sizeof *map, 1, f) == 1;
+    if (fclose(f) != 0 || !ok) {
+        fprintf(stderr, "Could not write ROM map %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+bool chip8_map_load(chip8_map_t *map, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "ROM map %s is invalid or does not exist\n", path);
+        return false;
+    }
+    const bool ok = fread(map, sizeof *map, 1, f) == 1 && map->magic == CHIP8_MAP_MAGIC &&
+                    map->version == CHIP8_MAP_VERSION && map->size == sizeof *map &&
+                    map->quirks < CHIP8_QUIRK_PROFILES && map->rom_size <= CHIP8_MAX_ROM_SIZE;
+    fclose(f);
+    if (!ok) fprintf(stderr, "%s is not a version %d CHIP8 ROM map\n", path, CHIP8_MAP_VERSION);
+    return ok;
+}
+
+bool chip8_apply_map(chip8_t *chip8, const chip8_map_t *map) {
+    if (map->quirks != chip8->quirks) return false;
+    if (map->rom_hash != rom_hash(&chip8->ram[CHIP8_ENTRY_POINT], map->rom_size)) return false;
+
+    for (uint32_t pc = 0; pc < CHIP8_RAM_SIZE; pc += 2) {
+        if (map->bytes[pc] & CHIP8_MAP_INST) chip8_predecode(chip8, pc);
+    }
+    if (chip8->jit) chip8_jit_prebuild(chip8, map);
+    chip8->data_pages = map->data_pages;
+    return true;
+}
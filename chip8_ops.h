@@ -0,0 +1,212 @@
+#ifndef CHIP8_OPS_H
+#define CHIP8_OPS_H
+
+// Instruction semantics shared by the execution engines (reference interpreter,
+//   pre-decoded interpreter, recompiler). Internal to the core library.
+
+#include <string.h>
+#include "chip8_core.h"
+
+#ifdef DEBUG
+// Append the instruction at pc, just executed, to chip8->trace (chip8_trace.c)
+void chip8_trace_instruction(chip8_t *chip8, uint16_t pc, uint16_t opcode);
+#endif
+
+// chip8_run on the reference interpreter, counting into chip8->profile (chip8_profile.c)
+uint32_t chip8_run_profiled(chip8_t *chip8, uint32_t max_insts);
+
+// Throw away translated blocks covering the byte at addr, written by an instruction (chip8_jit.c)
+void chip8_jit_invalidate(chip8_t *chip8, uint16_t addr);
+
+// Throw away translated blocks covering a 256 byte RAM page, replaced by a state load
+void chip8_jit_invalidate_page(chip8_t *chip8, uint8_t page);
+
+// Forget every translated block
+void chip8_jit_reset(chip8_jit_t *jit);
+
+// Translate the blocks a ROM map says execution can enter (chip8_jit.c)
+void chip8_jit_prebuild(chip8_t *chip8, const chip8_map_t *map);
+
+// Pre-decode the instruction at even address pc, fused as it would be on first
+//   execution (chip8_cached.c)
+void chip8_predecode(chip8_t *chip8, uint16_t pc);
+
+// What a quirk profile changes. The interpreters are compiled once per profile with
+//   these as constants (chip8_quirk_flags[profile] with a constant index), so the
+//   tests below fold away.
+typedef struct {
+    bool shift_vx;          // 8XY6/8XYE shift VX in place instead of VY into VX
+    bool vf_reset;          // 8XY1/8XY2/8XY3 reset VF
+    bool increment_i;       // FX55/FX65 leave I past the last register
+    bool jump_vx;           // BNNN jumps to NNN + VX (BXNN) instead of NNN + V0
+    bool wrap;              // DXYN wraps sprites around the screen edges instead of clipping
+} chip8_quirk_flags_t;
+
+static const chip8_quirk_flags_t chip8_quirk_flags[CHIP8_QUIRK_PROFILES] = {
+    [CHIP8_QUIRKS_VIP] =    { .shift_vx = false, .vf_reset = true,  .increment_i = true,  .jump_vx = false, .wrap = false },
+    [CHIP8_QUIRKS_SCHIP] =  { .shift_vx = true,  .vf_reset = false, .increment_i = false, .jump_vx = true,  .wrap = false },
+    [CHIP8_QUIRKS_MODERN] = { .shift_vx = false, .vf_reset = false, .increment_i = true,  .jump_vx = false, .wrap = true },
+};
+
+// emulate_instruction compiled for one quirk profile (chip8_core.c); loops running many
+//   instructions look it up once instead of going through emulate_instruction each time
+typedef void (*chip8_interpreter_t)(chip8_t *chip8);
+chip8_interpreter_t chip8_interpreter(chip8_quirks_t quirks);
+
+// CXNN random byte: per-machine xorshift32, so machines don't share rand()'s state
+static inline uint8_t chip8_rand(chip8_t *chip8) {
+    uint32_t x = chip8->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    chip8->rng = x;
+    return x >> 24;
+}
+
+// Pre-decoded entries with a handler index from here on run a fused sequence, which
+//   covers the two instructions after their own too (chip8_cached.c)
+#define CHIP8_FUSED_HANDLERS 37
+
+// 0x2NNN: push the return address; false (stack overflow fault) with a full stack
+static inline bool chip8_push(chip8_t *chip8, uint16_t pc) {
+    if (chip8->stack_ptr == &chip8->stack[CHIP8_STACK_DEPTH]) {
+        chip8->fault = CHIP8_FAULT_STACK_OVERFLOW;
+        return false;
+    }
+    *chip8->stack_ptr++ = pc;
+    return true;
+}
+
+// 0x00EE: pop the return address into pc; false (stack underflow fault) with an empty stack
+static inline bool chip8_pop(chip8_t *chip8, uint16_t *pc) {
+    if (chip8->stack_ptr == &chip8->stack[0]) {
+        chip8->fault = CHIP8_FAULT_STACK_UNDERFLOW;
+        return false;
+    }
+    *pc = *--chip8->stack_ptr;
+    return true;
+}
+
+// Every RAM write from a CHIP8 instruction goes through here, so pre-decoded
+//   instructions covering the written byte are thrown away (self-modifying code).
+//   addr wraps around the end of RAM.
+static inline void chip8_write_ram(chip8_t *chip8, uint16_t addr, uint8_t value) {
+    addr &= CHIP8_ADDR_MASK;
+    chip8->ram[addr] = value;
+    chip8->icache[(addr >> 1) & (CHIP8_ICACHE_SIZE - 1)].handler = 0;
+
+    const uint8_t page = (addr >> 8) & 0x0F;
+    if (chip8->jit_pages & (1u << page)) chip8_jit_invalidate(chip8, addr);
+}
+
+//0xDXYN: Draw N-height sprite at coordinate VX, VY. Read from memory location I;
+//  The sprite has a width of 8 pixels and a height of N pixels;
+//  Screen pixels are XOR'd with sprite bits
+//  VF(Carry Flag) is set if any screen pixels are set off; This is useful
+//  for collision detection. wrap: sprites wrap around the edges instead of clipping
+//  (the sprite itself wraps around the end of RAM)
+static inline void chip8_draw_sprite(chip8_t *chip8, uint8_t X, uint8_t Y, uint8_t N, const bool wrap) {
+    const uint8_t X_coord = (chip8->V[X] % CHIP8_DISPLAY_WIDTH);
+    const uint8_t Y_coord = (chip8->V[Y] % CHIP8_DISPLAY_HEIGHT);
+    uint64_t collision = 0;
+
+    //Stop drawing entire sprite if hit bottom edge of screen
+    if (!wrap && N > CHIP8_DISPLAY_HEIGHT - Y_coord) N = CHIP8_DISPLAY_HEIGHT - Y_coord;
+
+    //loop over all N rows of the sprite
+    for (uint8_t i = 0; i < N; i++) {
+        //Line the sprite byte up with the row (MSB is the leftmost pixel); bits shifted
+        //  out past the right edge of the screen are dropped (clipped) or rotated
+        //  around to the left edge (wrapped)
+        const uint64_t sprite = (uint64_t)chip8->ram[(chip8->I + i) & CHIP8_ADDR_MASK] << 56;
+        const uint64_t sprite_row = wrap ? sprite >> X_coord | sprite << ((64 - X_coord) & 63)
+                                         : sprite >> X_coord;
+        const uint8_t y = (Y_coord + i) & (CHIP8_DISPLAY_HEIGHT - 1);
+        uint64_t *row = &chip8->display[y];
+
+        collision |= *row & sprite_row;  //both are 1->collision based on XOR
+        *row ^= sprite_row;
+        if (sprite_row) chip8->dirty_rows |= 1u << y;  // Will update on next 60hz tick
+    }
+
+    chip8->V[0xF] = (collision != 0);
+}
+
+// 0xFX0A: VX = get_key(); Await until a keypress & release, and store in VX.
+//   Returns false while still waiting; the caller re-executes the instruction.
+static inline bool chip8_wait_key(chip8_t *chip8, uint8_t X) {
+    for (uint8_t i = 0; i < sizeof chip8->keypad; i++) {
+        if (chip8->keypad[i]) {
+            chip8->key_wait_key = i;
+            chip8->key_wait_pressed = true;
+            break;
+        }
+    }
+
+    if (chip8->key_wait_pressed && !chip8->keypad[chip8->key_wait_key]) {
+        chip8->V[X] = chip8->key_wait_key;
+        chip8->key_wait_key = 0xFF;
+        chip8->key_wait_pressed = false;
+        return true;
+    }
+    return false;
+}
+
+// Before writing RAM from addr on: throw away fused entries up to two instructions
+//   before it, which cover the first bytes written (the entries of the written bytes
+//   themselves go in chip8_write_ram)
+static inline void chip8_invalidate_fused(chip8_t *chip8, uint16_t addr) {
+    for (uint16_t back = 1; back <= 2; back++) {
+        decoded_inst_t *const d = &chip8->icache[((addr >> 1) - back) & (CHIP8_ICACHE_SIZE - 1)];
+        if (d->handler >= CHIP8_FUSED_HANDLERS) d->handler = 0;
+    }
+}
+
+// Can len bytes from addr on be stored without looking for code there? Yes if they are
+//   in RAM and a ROM map proved the (at most two) pages they touch data-only
+static inline bool chip8_data_only(const chip8_t *chip8, uint16_t addr, uint16_t len) {
+    const uint16_t first = 1u << ((addr >> 8) & 0x0F), last = 1u << (((addr + len - 1) >> 8) & 0x0F);
+    return addr + len <= CHIP8_RAM_SIZE && (chip8->data_pages & first) && (chip8->data_pages & last);
+}
+
+// 0xFX33: Store BCD representation of VX at memory offset from I;
+//   I = hundred's place, I+1 = ten's place, I+2 = one's place
+static inline void chip8_store_bcd(chip8_t *chip8, uint8_t X) {
+    uint8_t bcd = chip8->V[X];
+    if (chip8_data_only(chip8, chip8->I, 3)) {
+        chip8->ram[chip8->I] = bcd / 100;
+        chip8->ram[chip8->I + 1] = bcd / 10 % 10;
+        chip8->ram[chip8->I + 2] = bcd % 10;
+        return;
+    }
+    chip8_invalidate_fused(chip8, chip8->I);
+    chip8_write_ram(chip8, chip8->I + 2, bcd % 10);
+    bcd /= 10;
+    chip8_write_ram(chip8, chip8->I + 1, bcd % 10);
+    bcd /= 10;
+    chip8_write_ram(chip8, chip8->I, bcd);
+}
+
+// 0xFX55: Register dump V0-VX inclusive to memory offset from I; increment_i: I is
+//   left past the last register (CHIP8), else unchanged (SCHIP)
+static inline void chip8_store_registers(chip8_t *chip8, uint8_t X, const bool increment_i) {
+    if (chip8_data_only(chip8, chip8->I, X + 1)) {
+        memcpy(&chip8->ram[chip8->I], chip8->V, X + 1);
+    } else {
+        chip8_invalidate_fused(chip8, chip8->I);
+        for (uint8_t i = 0; i <= X; i++) {
+            chip8_write_ram(chip8, chip8->I + i, chip8->V[i]);
+        }
+    }
+    if (increment_i) chip8->I += X + 1;
+}
+
+// 0xFX65: Register load V0-VX inclusive from memory offset from I; I as for FX55
+static inline void chip8_load_registers(chip8_t *chip8, uint8_t X, const bool increment_i) {
+    for (uint8_t i = 0; i <= X; i++) {
+        chip8->V[i] = chip8->ram[(chip8->I + i) & CHIP8_ADDR_MASK];
+    }
+    if (increment_i) chip8->I += X + 1;
+}
+
+#endif
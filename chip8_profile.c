@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "chip8_core.h"
+#include "chip8_ops.h"
+
+// Guest profiler. The run loop below stands in for the backends while a profile is
+//   attached; chip8_step/chip8_run only branch to it in CHIP8_PROFILE builds.
+//
+//   A delay timer polling loop is a short loop back to the same FX07 (FX07, 3X00,
+//   1NNN back, typically): when an FX07 runs again at most POLL_LOOP_MAX instructions
+//   after the last one at that address, those instructions were spent polling.
+
+#define POLL_LOOP_MAX 4
+
+static const char *const class_names[CHIP8_OP_CLASSES] = {
+    [CHIP8_OP_CLS] = "00E0",     [CHIP8_OP_RET] = "00EE",      [CHIP8_OP_SYS] = "0NNN",
+    [CHIP8_OP_JP] = "1NNN",      [CHIP8_OP_CALL] = "2NNN",     [CHIP8_OP_SE_IMM] = "3XNN",
+    [CHIP8_OP_SNE_IMM] = "4XNN", [CHIP8_OP_SE_REG] = "5XY0",   [CHIP8_OP_LD_IMM] = "6XNN",
+    [CHIP8_OP_ADD_IMM] = "7XNN", [CHIP8_OP_LD_REG] = "8XY0",   [CHIP8_OP_OR] = "8XY1",
+    [CHIP8_OP_AND] = "8XY2",     [CHIP8_OP_XOR] = "8XY3",      [CHIP8_OP_ADD_REG] = "8XY4",
+    [CHIP8_OP_SUB] = "8XY5",     [CHIP8_OP_SHR] = "8XY6",      [CHIP8_OP_SUBN] = "8XY7",
+    [CHIP8_OP_SHL] = "8XYE",     [CHIP8_OP_SNE_REG] = "9XY0",  [CHIP8_OP_LD_I] = "ANNN",
+    [CHIP8_OP_JP_V0] = "BNNN",   [CHIP8_OP_RND] = "CXNN",      [CHIP8_OP_DRW] = "DXYN",
+    [CHIP8_OP_SKP] = "EX9E",     [CHIP8_OP_SKNP] = "EXA1",     [CHIP8_OP_LD_VX_DT] = "FX07",
+    [CHIP8_OP_LD_KEY] = "FX0A",  [CHIP8_OP_LD_DT] = "FX15",    [CHIP8_OP_LD_ST] = "FX18",
+    [CHIP8_OP_ADD_I] = "FX1E",   [CHIP8_OP_LD_F] = "FX29",     [CHIP8_OP_BCD] = "FX33",
+    [CHIP8_OP_STORE] = "FX55",   [CHIP8_OP_LOAD] = "FX65",     [CHIP8_OP_INVALID] = "invalid",
+};
+
+chip8_op_class_t chip8_op_class(uint16_t opcode) {
+    const uint8_t N = opcode & 0x0F;
+    const uint8_t NN = opcode & 0xFF;
+
+    switch (opcode >> 12) {
+        case 0x0:
+            if (opcode == 0x00E0) return CHIP8_OP_CLS;
+            if (opcode == 0x00EE) return CHIP8_OP_RET;
+            return CHIP8_OP_SYS;
+        case 0x1: return CHIP8_OP_JP;
+        case 0x2: return CHIP8_OP_CALL;
+        case 0x3: return CHIP8_OP_SE_IMM;
+        case 0x4: return CHIP8_OP_SNE_IMM;
+        case 0x5: return N == 0 ? CHIP8_OP_SE_REG : CHIP8_OP_INVALID;
+        case 0x6: return CHIP8_OP_LD_IMM;
+        case 0x7: return CHIP8_OP_ADD_IMM;
+        case 0x8:
+            switch (N) {
+                case 0x0: return CHIP8_OP_LD_REG;
+                case 0x1: return CHIP8_OP_OR;
+                case 0x2: return CHIP8_OP_AND;
+                case 0x3: return CHIP8_OP_XOR;
+                case 0x4: return CHIP8_OP_ADD_REG;
+                case 0x5: return CHIP8_OP_SUB;
+                case 0x6: return CHIP8_OP_SHR;
+                case 0x7: return CHIP8_OP_SUBN;
+                case 0xE: return CHIP8_OP_SHL;
+                default:  return CHIP8_OP_INVALID;
+            }
+        case 0x9: return N == 0 ? CHIP8_OP_SNE_REG : CHIP8_OP_INVALID;
+        case 0xA: return CHIP8_OP_LD_I;
+        case 0xB: return CHIP8_OP_JP_V0;
+        case 0xC: return CHIP8_OP_RND;
+        case 0xD: return CHIP8_OP_DRW;
+        case 0xE:
+            if (NN == 0x9E) return CHIP8_OP_SKP;
+            if (NN == 0xA1) return CHIP8_OP_SKNP;
+            return CHIP8_OP_INVALID;
+        default:
+            switch (NN) {
+                case 0x07: return CHIP8_OP_LD_VX_DT;
+                case 0x0A: return CHIP8_OP_LD_KEY;
+                case 0x15: return CHIP8_OP_LD_DT;
+                case 0x18: return CHIP8_OP_LD_ST;
+                case 0x1E: return CHIP8_OP_ADD_I;
+                case 0x29: return CHIP8_OP_LD_F;
+                case 0x33: return CHIP8_OP_BCD;
+                case 0x55: return CHIP8_OP_STORE;
+                case 0x65: return CHIP8_OP_LOAD;
+                default:   return CHIP8_OP_INVALID;
+            }
+    }
+}
+
+const char *chip8_op_class_name(chip8_op_class_t op_class) {
+    return op_class < CHIP8_OP_CLASSES ? class_names[op_class] : "?";
+}
+
+bool chip8_set_profile(chip8_t *chip8, chip8_profile_t *profile) {
+#ifdef CHIP8_PROFILE
+    chip8->profile = profile;
+    return true;
+#else
+    (void)profile;
+    chip8->profile = NULL;
+    return false;
+#endif
+}
+
+uint32_t chip8_run_profiled(chip8_t *chip8, uint32_t max_insts) {
+    chip8_profile_t *const profile = chip8->profile;
+    const chip8_interpreter_t interpret_one = chip8_interpreter(chip8->quirks);
+    bool tone = chip8->sound_timer != 0;
+    uint32_t i = 0;
+
+    while (i < max_insts) {
+        const uint16_t pc = chip8->PC;
+        interpret_one(chip8);
+        i++;
+
+        const chip8_op_class_t op_class = chip8_op_class(chip8->inst.opcode);
+        profile->insts++;
+        profile->classes[op_class]++;
+        profile->pcs[pc & (CHIP8_RAM_SIZE - 1)]++;
+
+        if (op_class == CHIP8_OP_LD_KEY && chip8->PC == pc) profile->key_wait++;
+
+        if (op_class == CHIP8_OP_LD_VX_DT) {
+            if (pc == profile->poll_pc && profile->poll_insts) profile->timer_poll += profile->poll_insts;
+            profile->poll_pc = pc;
+            profile->poll_insts = 1;
+        } else if (profile->poll_insts && ++profile->poll_insts > POLL_LOOP_MAX) {
+            profile->poll_insts = 0;
+        }
+
+        // Same tone edges and display wait as chip8_run
+        if ((chip8->sound_timer != 0) != tone) {
+            tone = !tone;
+            chip8->sound_edge = i;
+        }
+        if (op_class == CHIP8_OP_DRW) break;
+    }
+    return i;
+}
+
+static double percent(uint64_t count, uint64_t total) {
+    return total ? 100.0 * count / total : 0.0;
+}
+
+// A counter and its index, sorted together (qsort has no context argument, and
+//   machines may report from any thread)
+typedef struct {
+    uint64_t count;
+    uint16_t index;
+} ranked_t;
+
+// Highest count first, ties in index order
+static int compare_ranked(const void *a, const void *b) {
+    const ranked_t *x = a, *y = b;
+    if (x->count != y->count) return x->count < y->count ? 1 : -1;
+    return x->index - y->index;
+}
+
+static void sort_by_count(ranked_t *ranked, size_t count, const uint64_t *counts) {
+    for (size_t i = 0; i < count; i++) ranked[i] = (ranked_t){ .count = counts[i], .index = i };
+    qsort(ranked, count, sizeof *ranked, compare_ranked);
+}
+
+void chip8_profile_report(const chip8_profile_t *profile, const chip8_t *chip8, uint32_t top) {
+    const uint64_t total = profile->insts;
+    printf("Profile: %llu instructions\n", (unsigned long long)total);
+
+    ranked_t classes[CHIP8_OP_CLASSES];
+    sort_by_count(classes, CHIP8_OP_CLASSES, profile->classes);
+    printf("  opcode         count       %%\n");
+    for (uint32_t i = 0; i < CHIP8_OP_CLASSES && classes[i].count; i++) {
+        printf("  %-7s %12llu  %5.1f%%\n", class_names[classes[i].index], (unsigned long long)classes[i].count,
+               percent(classes[i].count, total));
+    }
+
+    printf("  waiting: FX0A %llu (%.1f%%), delay timer polling %llu (%.1f%%)\n",
+           (unsigned long long)profile->key_wait, percent(profile->key_wait, total),
+           (unsigned long long)profile->timer_poll, percent(profile->timer_poll, total));
+
+    ranked_t *pcs = malloc(CHIP8_RAM_SIZE * sizeof *pcs);
+    if (pcs == NULL) return;
+    sort_by_count(pcs, CHIP8_RAM_SIZE, profile->pcs);
+    printf("  address  opcode         count       %%\n");
+    for (uint32_t i = 0; i < top && i < CHIP8_RAM_SIZE && pcs[i].count; i++) {
+        const uint16_t pc = pcs[i].index;
+        const uint16_t opcode = (chip8->ram[pc] << 8) | chip8->ram[(pc + 1) & (CHIP8_RAM_SIZE - 1)];
+        printf("  0x%03X    %04X %-7s %12llu  %5.1f%%\n", pc, opcode,
+               class_names[chip8_op_class(opcode)], (unsigned long long)pcs[i].count,
+               percent(pcs[i].count, total));
+    }
+    free(pcs);
+}
+
+bool chip8_profile_write_csv(const chip8_profile_t *profile, const char *path) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "Could not create profile %s\n", path);
+        return false;
+    }
+
+    fprintf(f, "kind,name,count\n");
+    fprintf(f, "total,instructions,%llu\n", (unsigned long long)profile->insts);
+    for (uint32_t i = 0; i < CHIP8_OP_CLASSES; i++) {
+        fprintf(f, "opcode,%s,%llu\n", class_names[i], (unsigned long long)profile->classes[i]);
+    }
+    fprintf(f, "wait,FX0A,%llu\n", (unsigned long long)profile->key_wait);
+    fprintf(f, "wait,delay_timer,%llu\n", (unsigned long long)profile->timer_poll);
+    for (uint32_t pc = 0; pc < CHIP8_RAM_SIZE; pc++) {
+        if (profile->pcs[pc]) fprintf(f, "pc,0x%03X,%llu\n", pc, (unsigned long long)profile->pcs[pc]);
+    }
+
+    if (fclose(f) != 0) {
+        fprintf(stderr, "Could not write profile %s\n", path);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,450 @@
+#define _POSIX_C_SOURCE 200809L  // clock_gettime, sysconf
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "chip8_core.h"
+
+// Golden-frame regression runner: runs every test of a suite file on every backend,
+//   hashing the display and the whole machine state (chip8_display_hash,
+//   chip8_state_hash) at checkpoints, and compares the hashes with a golden file.
+//   Tests run in parallel, one machine per worker thread. Suite lines:
+//
+//     <rom_name> <frames> <checkpoint_every> <insts_per_second> [vip|schip|modern] [keys]  # comment
+//
+//   rom_name may be quoted ("IBM Logo.ch8"). keys is a keypad script, comma separated
+//   <frame>:+<key> (down) and <frame>:-<key> (up) events with hex keys, e.g. 30:+5,33:-5;
+//   it is fed in through an input log, like a replay. Golden lines:
+//
+//     <test> <frame> <display_hash> <state_hash>
+//
+//   test being the test's index in the suite. --update writes the golden file from the
+//   run, once every backend agrees.
+
+#define MAX_TESTS 256
+
+typedef struct {
+    const char *suite_name;
+    const char *golden_name;
+    uint32_t threads;           // 0 = one per online CPU
+    bool one_backend;           // Only run backend (default: all of them)
+    chip8_backend_t backend;
+    bool update;                // Write the golden file instead of checking it
+} regress_config_t;
+
+typedef struct {
+    char rom_name[256];
+    uint8_t rom[CHIP8_MAX_ROM_SIZE];
+    size_t rom_size;
+    uint32_t frames;            // Number of 60hz frames to run
+    uint32_t every;             // Checkpoint every this many frames (and after the last)
+    uint32_t insts_per_second;  // CHIP8 CPU "clock rate" or hz
+    chip8_quirks_t quirks;      // Quirk profile
+    chip8_input_log_t keys;     // Keypad script; jobs replay their own copy
+} regress_test_t;
+
+typedef struct {
+    uint32_t frame;
+    uint64_t display_hash;
+    uint64_t state_hash;
+} regress_checkpoint_t;
+
+typedef struct {
+    uint32_t test;
+    chip8_backend_t backend;
+    regress_checkpoint_t *checkpoints;
+    uint32_t checkpoint_count;
+} regress_job_t;
+
+typedef struct {
+    uint32_t test;
+    regress_checkpoint_t checkpoint;
+} regress_golden_t;
+
+typedef struct {
+    const regress_test_t *tests;
+    regress_job_t *jobs;
+    uint32_t job_count;
+    _Atomic uint32_t next_job;  // Workers claim jobs in suite order
+} regress_t;
+
+bool init_config_from_args(regress_config_t *config, const int argc, char **argv) {
+    *config = (regress_config_t) {
+        .suite_name = NULL,
+        .golden_name = NULL,
+        .threads = 0,
+        .one_backend = false,
+        .backend = CHIP8_BACKEND_CACHED,
+        .update = false,
+    };
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            config->threads = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc) {
+            if (!chip8_backend_from_name(argv[++i], &config->backend)) {
+                fprintf(stderr, "Unknown backend %s\n", argv[i]);
+                return false;
+            }
+            config->one_backend = true;
+        } else if (strcmp(argv[i], "--update") == 0) {
+            config->update = true;
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return false;
+        } else if (config->suite_name == NULL) {
+            config->suite_name = argv[i];
+        } else {
+            config->golden_name = argv[i];
+        }
+    }
+    if (config->threads == 0) {
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        config->threads = cpus > 0 ? (uint32_t)cpus : 1;
+    }
+    return config->suite_name != NULL && config->golden_name != NULL;
+}
+
+// Copy the next whitespace separated (or double quoted) field of *line into field
+static bool next_field(char **line, char *field, size_t size) {
+    char *at = *line + strspn(*line, " \t\r\n");
+    if (*at == '\0') return false;
+
+    const bool quoted = *at == '"';
+    if (quoted) at++;
+    const size_t length = quoted ? strcspn(at, "\"") : strcspn(at, " \t\r\n");
+    if (length >= size || (quoted && at[length] != '"')) return false;
+    memcpy(field, at, length);
+    field[length] = '\0';
+    *line = at + length + quoted;
+    return true;
+}
+
+// Turn a keypad script (30:+5,33:-5) into an input log; false if it doesn't parse
+static bool parse_keys(const char *script, regress_test_t *test) {
+    chip8_input_log_start(&test->keys, test->rom, test->rom_size, 0, test->insts_per_second);
+    uint32_t last_frame = 0;
+    while (*script) {
+        unsigned frame, key;
+        char sign;
+        int used = 0;
+        if (sscanf(script, "%u:%c%1x%n", &frame, &sign, &key, &used) != 3 || used == 0 ||
+            (sign != '+' && sign != '-') || frame < last_frame) {
+            return false;
+        }
+        if (!chip8_input_log_key(&test->keys, frame, key, sign == '+')) return false;
+        last_frame = frame;
+        script += used;
+        if (*script == ',') script++;
+        else if (*script) return false;
+    }
+    return true;
+}
+
+// Parse the suite into the test list, loading every ROM
+bool load_suite(const char *suite_name, regress_test_t *tests, uint32_t *test_count) {
+    FILE *suite = fopen(suite_name, "r");
+    if (!suite) {
+        fprintf(stderr, "Suite file %s is invalid or does not exist\n", suite_name);
+        return false;
+    }
+
+    bool ok = true;
+    char line[1024];
+    for (uint32_t line_no = 1; ok && fgets(line, sizeof line, suite); line_no++) {
+        char *comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+
+        char *cursor = line;
+        char rom_name[256], field[4][256];
+        if (!next_field(&cursor, rom_name, sizeof rom_name)) continue;  // Blank or comment-only line
+        uint32_t fields = 0;
+        while (fields < 4 && next_field(&cursor, field[fields], sizeof field[fields])) fields++;
+
+        if (*test_count == MAX_TESTS) {
+            fprintf(stderr, "%s:%u: at most %d tests\n", suite_name, line_no, MAX_TESTS);
+            ok = false;
+            break;
+        }
+        regress_test_t *test = &tests[*test_count];
+        *test = (regress_test_t){ .quirks = CHIP8_QUIRKS_VIP };
+        snprintf(test->rom_name, sizeof test->rom_name, "%s", rom_name);
+        if (fields >= 3) {
+            test->frames = (uint32_t)strtoul(field[0], NULL, 10);
+            test->every = (uint32_t)strtoul(field[1], NULL, 10);
+            test->insts_per_second = (uint32_t)strtoul(field[2], NULL, 10);
+        }
+        if (fields < 3 || test->frames == 0 || test->every == 0 ||
+            (fields >= 4 && !chip8_quirks_from_name(field[3], &test->quirks))) {
+            fprintf(stderr, "%s:%u: expected <rom_name> <frames> <checkpoint_every> <insts_per_second>"
+                            " [vip|schip|modern] [keys]\n", suite_name, line_no);
+            ok = false;
+            break;
+        }
+
+        if (!chip8_load_rom_file(test->rom_name, test->rom, sizeof test->rom, &test->rom_size)) {
+            ok = false;
+            break;
+        }
+        (*test_count)++;
+
+        char keys[256] = "";
+        next_field(&cursor, keys, sizeof keys);
+        if (!parse_keys(keys, test)) {
+            fprintf(stderr, "%s:%u: bad keypad script %s (expected <frame>:+<key>,<frame>:-<key>...)\n",
+                    suite_name, line_no, keys);
+            ok = false;
+        }
+    }
+
+    fclose(suite);
+    return ok;
+}
+
+// Golden values, in any order; a missing file is an empty one (nothing recorded yet)
+regress_golden_t *load_golden(const char *golden_name, uint32_t *golden_count) {
+    *golden_count = 0;
+    FILE *golden = fopen(golden_name, "r");
+    if (!golden) return NULL;
+
+    regress_golden_t *values = NULL;
+    uint32_t capacity = 0;
+    char line[256];
+    for (uint32_t line_no = 1; fgets(line, sizeof line, golden); line_no++) {
+        char *comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+
+        unsigned test, frame;
+        unsigned long long display_hash, state_hash;
+        const int fields = sscanf(line, "%u %u %llx %llx", &test, &frame, &display_hash, &state_hash);
+        if (fields <= 0) continue;
+        if (fields != 4) {
+            fprintf(stderr, "%s:%u: expected <test> <frame> <display_hash> <state_hash>\n", golden_name, line_no);
+            continue;
+        }
+
+        if (*golden_count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            regress_golden_t *grown = realloc(values, capacity * sizeof *values);
+            if (!grown) break;
+            values = grown;
+        }
+        values[(*golden_count)++] = (regress_golden_t){
+            .test = test,
+            .checkpoint = { .frame = frame, .display_hash = display_hash, .state_hash = state_hash },
+        };
+    }
+    fclose(golden);
+    return values;
+}
+
+static const regress_checkpoint_t *find_golden(const regress_golden_t *values, uint32_t count,
+                                               uint32_t test, uint32_t frame) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (values[i].test == test && values[i].checkpoint.frame == frame) return &values[i].checkpoint;
+    }
+    return NULL;
+}
+
+// Run one test on one backend from reset, recording a checkpoint every test->every frames
+static void run_job(const regress_test_t *test, regress_job_t *job, chip8_t *chip8, chip8_jit_t *jit) {
+    chip8_init(chip8, test->rom, test->rom_size);
+    chip8_set_backend(chip8, job->backend, jit);
+    chip8_set_quirks(chip8, test->quirks);
+
+    chip8_input_log_t keys = test->keys;    // The events are only read
+    keys.last_frame = 0;                    // Replay from the start
+    keys.cursor = 0;
+    job->checkpoint_count = 0;
+    for (uint32_t frame = 0; frame < test->frames; frame++) {
+        chip8_input_log_replay(&keys, frame, chip8);
+        chip8_run_frame(chip8, chip8_frame_insts(test->insts_per_second, frame));
+        if ((frame + 1) % test->every == 0 || frame + 1 == test->frames) {
+            job->checkpoints[job->checkpoint_count++] = (regress_checkpoint_t){
+                .frame = frame + 1,
+                .display_hash = chip8_display_hash(chip8),
+                .state_hash = chip8_state_hash(chip8),
+            };
+        }
+    }
+}
+
+static void *worker_main(void *arg) {
+    regress_t *regress = arg;
+    chip8_t *chip8 = malloc(sizeof *chip8);
+    chip8_jit_t *jit = NULL;
+    if (chip8 == NULL) return NULL;
+
+    for (;;) {
+        const uint32_t index = atomic_fetch_add_explicit(&regress->next_job, 1, memory_order_relaxed);
+        if (index >= regress->job_count) break;
+        regress_job_t *job = &regress->jobs[index];
+        if (job->backend == CHIP8_BACKEND_JIT && jit == NULL) jit = chip8_jit_create();
+        run_job(&regress->tests[job->test], job, chip8, jit);
+    }
+
+    chip8_jit_destroy(jit);
+    free(chip8);
+    return NULL;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Check every job against the golden values; the number of runs that differ
+uint32_t check_golden(const regress_t *regress, const regress_golden_t *values, uint32_t golden_count) {
+    uint32_t failures = 0;
+    for (uint32_t i = 0; i < regress->job_count; i++) {
+        const regress_job_t *job = &regress->jobs[i];
+        const regress_test_t *test = &regress->tests[job->test];
+        for (uint32_t c = 0; c < job->checkpoint_count; c++) {
+            const regress_checkpoint_t *got = &job->checkpoints[c];
+            const regress_checkpoint_t *want = find_golden(values, golden_count, job->test, got->frame);
+            if (want && want->display_hash == got->display_hash && want->state_hash == got->state_hash) continue;
+
+            failures++;
+            printf("FAIL test %u (%s, %s quirks) on %s, frame %u: ", job->test, test->rom_name,
+                   chip8_quirks_name(test->quirks), chip8_backend_name(job->backend), got->frame);
+            if (want == NULL) {
+                printf("no golden value\n");
+                continue;
+            }
+            printf("%s %016llX %016llX, golden %016llX %016llX\n",
+                   want->display_hash != got->display_hash ? "display" : "state",
+                   (unsigned long long)got->display_hash, (unsigned long long)got->state_hash,
+                   (unsigned long long)want->display_hash, (unsigned long long)want->state_hash);
+            break;      // Later checkpoints of a diverged run only repeat the failure
+        }
+    }
+    return failures;
+}
+
+// Write the golden file from the first backend's run; false if the backends disagree
+bool write_golden(const char *golden_name, const regress_t *regress, uint32_t backends) {
+    bool agree = true;
+    for (uint32_t i = 0; i < regress->job_count; i++) {
+        const regress_job_t *job = &regress->jobs[i];
+        const regress_job_t *first = &regress->jobs[i - i % backends];
+        for (uint32_t c = 0; c < job->checkpoint_count; c++) {
+            if (job->checkpoints[c].display_hash == first->checkpoints[c].display_hash &&
+                job->checkpoints[c].state_hash == first->checkpoints[c].state_hash) continue;
+            printf("test %u (%s): %s and %s differ at frame %u\n", job->test, regress->tests[job->test].rom_name,
+                   chip8_backend_name(first->backend), chip8_backend_name(job->backend), job->checkpoints[c].frame);
+            agree = false;
+            break;
+        }
+    }
+    if (!agree) {
+        fprintf(stderr, "Backends disagree, not writing %s\n", golden_name);
+        return false;
+    }
+
+    FILE *out = fopen(golden_name, "w");
+    if (!out) {
+        fprintf(stderr, "Could not create golden file %s\n", golden_name);
+        return false;
+    }
+    fprintf(out, "# chip8-regress golden values: <test> <frame> <display_hash> <state_hash>\n");
+    for (uint32_t i = 0; i < regress->job_count; i += backends) {
+        const regress_job_t *job = &regress->jobs[i];
+        const regress_test_t *test = &regress->tests[job->test];
+        fprintf(out, "# test %u: %s, %s quirks\n", job->test, test->rom_name, chip8_quirks_name(test->quirks));
+        for (uint32_t c = 0; c < job->checkpoint_count; c++) {
+            fprintf(out, "%u %u %016llX %016llX\n", job->test, job->checkpoints[c].frame,
+                    (unsigned long long)job->checkpoints[c].display_hash,
+                    (unsigned long long)job->checkpoints[c].state_hash);
+        }
+    }
+    if (fclose(out) != 0) {
+        fprintf(stderr, "Could not write golden file %s\n", golden_name);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    regress_config_t config;
+    if (!init_config_from_args(&config, argc, argv)) {
+        fprintf(stderr, "Usage: %s <suite> <golden> [--update] [--threads N]\n"
+                        "         [--backend interpreter|cached|jit]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    static regress_test_t tests[MAX_TESTS];
+    uint32_t test_count = 0;
+    if (!load_suite(config.suite_name, tests, &test_count)) exit(EXIT_FAILURE);
+
+    // One job per test and backend, a test's backends next to each other
+    static const chip8_backend_t all_backends[] = {
+        CHIP8_BACKEND_INTERPRETER, CHIP8_BACKEND_CACHED, CHIP8_BACKEND_JIT,
+    };
+    const uint32_t backends = config.one_backend ? 1 : sizeof all_backends / sizeof all_backends[0];
+    regress_t regress = {
+        .tests = tests,
+        .job_count = test_count * backends,
+        .jobs = calloc(test_count * backends + 1, sizeof(regress_job_t)),
+    };
+    if (!regress.jobs) {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    atomic_init(&regress.next_job, 0);
+    for (uint32_t i = 0; i < regress.job_count; i++) {
+        const regress_test_t *test = &tests[i / backends];
+        regress_job_t *job = &regress.jobs[i];
+        job->test = i / backends;
+        job->backend = config.one_backend ? config.backend : all_backends[i % backends];
+        job->checkpoints = malloc((test->frames / test->every + 1) * sizeof *job->checkpoints);
+        if (!job->checkpoints) {
+            fprintf(stderr, "Out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // No more threads than jobs
+    const uint32_t threads = config.threads < regress.job_count ? config.threads : regress.job_count;
+    pthread_t *workers = calloc(threads + 1, sizeof *workers);
+    const double start = now_seconds();
+    for (uint32_t i = 1; i < threads; i++) {
+        if (pthread_create(&workers[i], NULL, worker_main, &regress) != 0) {
+            fprintf(stderr, "Could not start worker thread %u\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    worker_main(&regress);  // The main thread is worker 0
+    for (uint32_t i = 1; i < threads; i++) pthread_join(workers[i], NULL);
+    const double elapsed = now_seconds() - start;
+
+    uint32_t checkpoints = 0;
+    for (uint32_t i = 0; i < regress.job_count; i++) checkpoints += regress.jobs[i].checkpoint_count;
+
+    int status = EXIT_SUCCESS;
+    if (config.update) {
+        if (write_golden(config.golden_name, &regress, backends)) {
+            printf("golden: %u tests, %u checkpoints written to %s\n", test_count,
+                   checkpoints / backends, config.golden_name);
+        } else {
+            status = EXIT_FAILURE;
+        }
+    } else {
+        uint32_t golden_count;
+        regress_golden_t *values = load_golden(config.golden_name, &golden_count);
+        const uint32_t failures = check_golden(&regress, values, golden_count);
+        printf("%s: %u tests x %u backends, %u checkpoints, %u runs failed\n", failures ? "FAILED" : "ok",
+               test_count, backends, checkpoints, failures);
+        if (failures) status = EXIT_FAILURE;
+        free(values);
+    }
+    printf("threads: %u, seconds: %.3f\n", threads, elapsed);
+
+    for (uint32_t i = 0; i < regress.job_count; i++) free(regress.jobs[i].checkpoints);
+    for (uint32_t i = 0; i < test_count; i++) chip8_input_log_free(&tests[i].keys);
+    free(regress.jobs);
+    free(workers);
+    exit(status);
+}
@@ -0,0 +1,244 @@
+#include <stdlib.h>
+#include <string.h>
+#include "chip8_core.h"
+
+// Rewind buffer. Records live back to back in a byte ring, each one a record_t header
+//   followed by runs of (uint16_t skip, uint16_t length, length XOR bytes) over the
+//   bytes of a chip8_state_t. A keyframe is XORed against an all zero state (so it is
+//   the state minus its zero runs), a delta against the frame before it; XOR undoes
+//   itself, so applying a delta to a frame gives the frame before.
+//
+//   Records only ever come off the ends: the oldest keyframe and its deltas when space
+//   runs out, the newest record when stepping back. A record that doesn't fit above the
+//   newest one goes to the bottom of the ring (wrapped).
+
+#define STATE_BYTES  sizeof(chip8_state_t)
+#define RUN_HEADER   (2 * sizeof(uint16_t))
+#define MIN_GAP      RUN_HEADER     // Fewer equal bytes than this between runs: merge them
+
+typedef struct {
+    uint32_t prev;      // Offset of the record before this one
+    uint16_t size;      // Bytes, header included
+    uint8_t keyframe;
+    uint8_t reserved;
+} record_t;
+
+// Worst case: runs of 1 byte each MIN_GAP bytes apart
+#define RECORD_MAX   (sizeof(record_t) + STATE_BYTES + RUN_HEADER * (STATE_BYTES / (MIN_GAP + 1) + 1))
+
+_Static_assert(RECORD_MAX <= UINT16_MAX, "record sizes are uint16_t");
+
+struct chip8_rewind {
+    uint8_t *ring;
+    size_t capacity;
+    size_t head;                // Oldest record
+    size_t tail;                // Where the next record goes
+    size_t wrap;                // While wrapped: end of the records at the top of the ring
+    bool wrapped;               // Records run [head, wrap) then [0, tail)
+    size_t newest;              // Newest record
+    uint32_t frames;
+    size_t bytes;
+    uint32_t keyframe_interval;
+    uint32_t deltas;            // Delta records after the newest keyframe
+    size_t *chain;              // Step back over a keyframe: the records to decode
+    chip8_state_t current;      // The newest frame, decoded
+    chip8_state_t next;         // Frame being pushed
+    uint8_t encoded[RECORD_MAX];
+};
+
+static const chip8_state_t zero_state;
+
+static inline uint64_t load64(const uint8_t *p) {
+    uint64_t word;
+    memcpy(&word, p, sizeof word);
+    return word;
+}
+
+static record_t read_record(const chip8_rewind_t *rewind, size_t at) {
+    record_t record;
+    memcpy(&record, &rewind->ring[at], sizeof record);
+    return record;
+}
+
+// Encode the XOR of a and b into rewind->encoded after room for the header; returns
+//   the record size. Equal stretches are skipped a word at a time.
+static uint16_t encode(chip8_rewind_t *rewind, const uint8_t *a, const uint8_t *b) {
+    uint8_t *out = rewind->encoded + sizeof(record_t);
+    size_t pos = 0, last = 0;
+
+    while (pos < STATE_BYTES) {
+        if (pos % 8 == 0 && pos + 8 <= STATE_BYTES && load64(&a[pos]) == load64(&b[pos])) {
+            pos += 8;
+            continue;
+        }
+        if (a[pos] == b[pos]) {
+            pos++;
+            continue;
+        }
+
+        // Literal run: until MIN_GAP equal bytes in a row
+        const size_t start = pos;
+        size_t end = pos;
+        for (; pos < STATE_BYTES && pos - end < MIN_GAP; pos++) {
+            if (a[pos] != b[pos]) end = pos + 1;
+        }
+
+        const uint16_t skip = start - last, length = end - start;
+        memcpy(out, &skip, sizeof skip);
+        memcpy(out + sizeof skip, &length, sizeof length);
+        out += RUN_HEADER;
+        for (size_t i = start; i < end; i++) *out++ = a[i] ^ b[i];
+        last = pos = end;
+    }
+    return out - rewind->encoded;
+}
+
+// XOR the record at offset at into state
+static void apply(const chip8_rewind_t *rewind, chip8_state_t *state, size_t at) {
+    const record_t record = read_record(rewind, at);
+    const uint8_t *in = &rewind->ring[at + sizeof record];
+    const uint8_t *end = &rewind->ring[at + record.size];
+    uint8_t *bytes = (uint8_t *)state;
+    size_t pos = 0;
+
+    while (in < end) {
+        uint16_t skip, length;
+        memcpy(&skip, in, sizeof skip);
+        memcpy(&length, in + sizeof skip, sizeof length);
+        in += RUN_HEADER;
+        pos += skip;
+        for (uint16_t i = 0; i < length; i++) bytes[pos + i] ^= in[i];
+        pos += length;
+        in += length;
+    }
+}
+
+static void drop_oldest(chip8_rewind_t *rewind) {
+    const record_t record = read_record(rewind, rewind->head);
+    rewind->head += record.size;
+    rewind->bytes -= record.size;
+    rewind->frames--;
+    if (rewind->wrapped && rewind->head == rewind->wrap) {
+        rewind->head = 0;
+        rewind->wrapped = false;
+    }
+}
+
+// Drop the oldest keyframe and the deltas that need it
+static void drop_oldest_group(chip8_rewind_t *rewind) {
+    do {
+        drop_oldest(rewind);
+    } while (rewind->frames > 0 && !read_record(rewind, rewind->head).keyframe);
+}
+
+// Offset for a record of size bytes, dropping old records until it fits
+static size_t reserve(chip8_rewind_t *rewind, size_t size) {
+    for (;;) {
+        if (rewind->frames == 0) {
+            rewind->head = rewind->tail = 0;
+            rewind->wrapped = false;
+        }
+
+        if (!rewind->wrapped) {
+            if (rewind->capacity - rewind->tail >= size) return rewind->tail;
+            if (rewind->head >= size) {
+                rewind->wrap = rewind->tail;
+                rewind->wrapped = true;
+                return 0;
+            }
+        } else if (rewind->head - rewind->tail >= size) {
+            return rewind->tail;
+        }
+        drop_oldest_group(rewind);
+    }
+}
+
+chip8_rewind_t *chip8_rewind_create(size_t max_bytes, uint32_t keyframe_interval) {
+    if (keyframe_interval == 0 || max_bytes < 4 * RECORD_MAX || max_bytes > UINT32_MAX) return NULL;
+
+    chip8_rewind_t *rewind = calloc(1, sizeof *rewind);
+    if (rewind == NULL) return NULL;
+    rewind->ring = malloc(max_bytes);
+    rewind->chain = calloc(keyframe_interval, sizeof *rewind->chain);
+    if (rewind->ring == NULL || rewind->chain == NULL) {
+        chip8_rewind_destroy(rewind);
+        return NULL;
+    }
+    rewind->capacity = max_bytes;
+    rewind->keyframe_interval = keyframe_interval;
+    return rewind;
+}
+
+void chip8_rewind_destroy(chip8_rewind_t *rewind) {
+    if (rewind == NULL) return;
+    free(rewind->chain);
+    free(rewind->ring);
+    free(rewind);
+}
+
+void chip8_rewind_push(chip8_rewind_t *rewind, const chip8_t *chip8) {
+    chip8_save_state(chip8, &rewind->next);
+
+    bool keyframe = rewind->frames == 0 || rewind->deltas + 1 >= rewind->keyframe_interval;
+    const uint8_t *base = (const uint8_t *)(keyframe ? &zero_state : &rewind->current);
+    uint16_t size = encode(rewind, (const uint8_t *)&rewind->next, base);
+    size_t at = reserve(rewind, size);
+
+    // Making room dropped the frame this delta is against
+    if (rewind->frames == 0 && !keyframe) {
+        keyframe = true;
+        size = encode(rewind, (const uint8_t *)&rewind->next, (const uint8_t *)&zero_state);
+        at = reserve(rewind, size);
+    }
+
+    const record_t record = { .prev = rewind->newest, .size = size, .keyframe = keyframe };
+    memcpy(rewind->encoded, &record, sizeof record);
+    memcpy(&rewind->ring[at], rewind->encoded, size);
+
+    rewind->newest = at;
+    rewind->tail = at + size;
+    rewind->frames++;
+    rewind->bytes += size;
+    rewind->deltas = keyframe ? 0 : rewind->deltas + 1;
+    rewind->current = rewind->next;
+}
+
+bool chip8_rewind_step_back(chip8_rewind_t *rewind, chip8_t *chip8) {
+    if (rewind->frames < 2) return false;
+
+    const record_t newest = read_record(rewind, rewind->newest);
+    if (!newest.keyframe) {
+        apply(rewind, &rewind->current, rewind->newest);
+        rewind->deltas--;
+    } else {
+        // The frame before starts a chain back to its own keyframe; decode it forward
+        uint32_t length = 0;
+        for (size_t at = newest.prev; ; ) {
+            rewind->chain[length++] = at;
+            const record_t record = read_record(rewind, at);
+            if (record.keyframe) break;
+            at = record.prev;
+        }
+        rewind->current = zero_state;
+        for (uint32_t i = length; i-- > 0; ) apply(rewind, &rewind->current, rewind->chain[i]);
+        rewind->deltas = length - 1;
+    }
+
+    rewind->tail = rewind->newest;
+    if (rewind->wrapped && rewind->tail == 0) {
+        rewind->tail = rewind->wrap;
+        rewind->wrapped = false;
+    }
+    rewind->newest = newest.prev;
+    rewind->frames--;
+    rewind->bytes -= newest.size;
+    return chip8_load_state(chip8, &rewind->current);
+}
+
+uint32_t chip8_rewind_frames(const chip8_rewind_t *rewind) {
+    return rewind->frames;
+}
+
+size_t chip8_rewind_bytes(const chip8_rewind_t *rewind) {
+    return rewind->bytes;
+}
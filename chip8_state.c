@@ -0,0 +1,139 @@
+#define _DEFAULT_SOURCE             // mmap
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "chip8_core.h"
+#include "chip8_ops.h"
+
+// Save states. Saving is a handful of copies into a chip8_state_t (RAM being most of
+//   it); loading copies only the 256 byte RAM pages that differ, so restoring a state of
+//   the same ROM doesn't throw away the pre-decoded or translated code of unchanged pages.
+
+#define PAGE_SIZE  256
+#define PAGES      (CHIP8_RAM_SIZE / PAGE_SIZE)
+
+void chip8_save_state(const chip8_t *chip8, chip8_state_t *state) {
+    state->magic = CHIP8_STATE_MAGIC;
+    state->version = CHIP8_STATE_VERSION;
+    state->size = sizeof *state;
+    memcpy(state->display, chip8->display, sizeof state->display);
+    memcpy(state->ram, chip8->ram, sizeof state->ram);
+    memcpy(state->stack, chip8->stack, sizeof state->stack);
+    state->rng = chip8->rng;
+    state->I = chip8->I;
+    state->PC = chip8->PC;
+
+    state->keypad = 0;
+    for (uint8_t key = 0; key < 16; key++) state->keypad |= chip8->keypad[key] << key;
+
+    memcpy(state->V, chip8->V, sizeof state->V);
+    state->stack_index = chip8->stack_ptr - chip8->stack;
+    state->delay_timer = chip8->delay_timer;
+    state->sound_timer = chip8->sound_timer;
+    state->flags = (chip8->sound_on ? CHIP8_STATE_SOUND_ON : 0)
+                 | (chip8->key_wait_pressed ? CHIP8_STATE_KEY_WAIT_PRESSED : 0);
+    state->key_wait_key = chip8->key_wait_key;
+    state->quirks = chip8->quirks;
+}
+
+bool chip8_load_state(chip8_t *chip8, const chip8_state_t *state) {
+    if (state->magic != CHIP8_STATE_MAGIC || state->version != CHIP8_STATE_VERSION ||
+        state->size != sizeof *state) return false;
+    if (state->stack_index > sizeof chip8->stack / sizeof chip8->stack[0]) return false;
+    if (state->key_wait_key > 0xF && state->key_wait_key != 0xFF) return false;
+    if (state->quirks >= CHIP8_QUIRK_PROFILES) return false;
+
+    // Before the pages: switching profiles throws away all translated code anyway
+    if (state->quirks != chip8->quirks) chip8_set_quirks(chip8, state->quirks);
+
+    for (uint32_t page = 0; page < PAGES; page++) {
+        const uint32_t start = page * PAGE_SIZE;
+        if (memcmp(&chip8->ram[start], &state->ram[start], PAGE_SIZE) == 0) continue;
+
+        memcpy(&chip8->ram[start], &state->ram[start], PAGE_SIZE);
+        if (!(chip8->data_pages & (1u << page))) chip8->data_pages = 0;  // Not the code the ROM map proved things about
+        // From two entries before the page: fused ones reach two instructions ahead
+        for (uint32_t i = start ? start / 2 - 2 : 0; i < (start + PAGE_SIZE) / 2; i++) chip8->icache[i].handler = 0;
+        if (chip8->jit_pages & (1u << page)) chip8_jit_invalidate_page(chip8, page);
+    }
+
+    memcpy(chip8->display, state->display, sizeof chip8->display);
+    chip8->dirty_rows = CHIP8_ALL_ROWS;
+    memcpy(chip8->stack, state->stack, sizeof state->stack);
+    chip8->stack_ptr = &chip8->stack[state->stack_index];
+    chip8->fault = CHIP8_FAULT_NONE;     // A faulting instruction faults again when it runs
+    chip8_seed(chip8, state->rng);
+    chip8->I = state->I;
+    chip8->PC = state->PC;
+    for (uint8_t key = 0; key < 16; key++) chip8->keypad[key] = (state->keypad >> key) & 1;
+    memcpy(chip8->V, state->V, sizeof chip8->V);
+    chip8->delay_timer = state->delay_timer;
+    chip8->sound_timer = state->sound_timer;
+    chip8->sound_on = state->flags & CHIP8_STATE_SOUND_ON;
+    chip8->key_wait_pressed = state->flags & CHIP8_STATE_KEY_WAIT_PRESSED;
+    chip8->key_wait_key = state->key_wait_key;
+    return true;
+}
+
+bool chip8_save_state_file(const chip8_t *chip8, const char *path) {
+    chip8_state_t state;
+    chip8_save_state(chip8, &state);
+
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "Could not create state file %s\n", path);
+        return false;
+    }
+    const bool ok = fwrite(&state, sizeof state, 1, f) == 1;
+    if (fclose(f) != 0 || !ok) {
+        fprintf(stderr, "Could not write state file %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+bool chip8_load_state_file(chip8_t *chip8, const char *path, size_t index) {
+    size_t count;
+    const chip8_state_t *states = chip8_map_states(path, &count);
+    if (states == NULL) return false;
+
+    bool ok = index < count;
+    if (!ok) {
+        fprintf(stderr, "State file %s has %zu states, no state %zu\n", path, count, index);
+    } else if (!(ok = chip8_load_state(chip8, &states[index]))) {
+        fprintf(stderr, "State %zu of %s is not a version %d CHIP8 state\n", index, path, CHIP8_STATE_VERSION);
+    }
+    chip8_unmap_states(states, count);
+    return ok;
+}
+
+const chip8_state_t *chip8_map_states(const char *path, size_t *count) {
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "State file %s is invalid or does not exist\n", path);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0 || st.st_size % sizeof(chip8_state_t) != 0) {
+        fprintf(stderr, "State file %s is not a whole number of states\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    void *states = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);      // The mapping keeps the file
+    if (states == MAP_FAILED) {
+        fprintf(stderr, "Could not map state file %s\n", path);
+        return NULL;
+    }
+    *count = st.st_size / sizeof(chip8_state_t);
+    return states;
+}
+
+void chip8_unmap_states(const chip8_state_t *states, size_t count) {
+    munmap((void *)states, count * sizeof *states);
+}
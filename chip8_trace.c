@@ -0,0 +1,144 @@
+#define _POSIX_C_SOURCE 200809L  // nanosleep
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "chip8_core.h"
+#include "chip8_ops.h"
+
+// Instruction trace. The emulation thread is the only writer of head and the writer
+//   thread the only writer of tail, so the ring needs no locks: a record is filled in,
+//   then published by moving head. The writer wakes up every millisecond and writes
+//   whatever was published in one or two fwrites. A full ring makes the emulation
+//   thread wait (a trace with holes in it is no use), counted as stalls.
+
+#define WRITER_SLEEP_NS 1000000
+
+struct chip8_trace {
+    chip8_trace_record_t *records;
+    uint32_t mask;              // Capacity - 1
+    _Alignas(64) _Atomic uint64_t head;     // Records published
+    uint64_t tail_seen;         // Emulation thread: tail as last read
+    uint64_t stalls;
+    _Alignas(64) _Atomic uint64_t tail;     // Records written out
+    _Atomic bool stop;
+    bool write_error;
+    FILE *file;
+    const char *path;
+    pthread_t thread;
+};
+
+static void *writer_main(void *data) {
+    chip8_trace_t *trace = data;
+    const uint64_t capacity = trace->mask + 1ull;
+
+    for (;;) {
+        const bool stopping = atomic_load_explicit(&trace->stop, memory_order_acquire);
+        const uint64_t head = atomic_load_explicit(&trace->head, memory_order_acquire);
+        uint64_t tail = atomic_load_explicit(&trace->tail, memory_order_relaxed);
+
+        while (tail != head) {
+            // Up to the end of the ring, then from its start
+            const uint32_t at = tail & trace->mask;
+            const uint64_t count = head - tail < capacity - at ? head - tail : capacity - at;
+            if (!trace->write_error && fwrite(&trace->records[at], sizeof *trace->records, count, trace->file) != count) {
+                trace->write_error = true;      // Keep draining so the emulation never blocks
+            }
+            tail += count;
+            atomic_store_explicit(&trace->tail, tail, memory_order_release);
+        }
+
+        if (stopping) return NULL;     // Everything published before the stop is written
+        nanosleep(&(struct timespec){ .tv_nsec = WRITER_SLEEP_NS }, NULL);
+    }
+}
+
+chip8_trace_t *chip8_trace_open(const char *path, uint32_t capacity, chip8_quirks_t quirks) {
+    if (capacity < 2 || (capacity & (capacity - 1))) {
+        fprintf(stderr, "Trace ring capacity must be a power of 2\n");
+        return NULL;
+    }
+
+    chip8_trace_t *trace = calloc(1, sizeof *trace);
+    if (trace == NULL) return NULL;
+    trace->records = malloc((size_t)capacity * sizeof *trace->records);
+    trace->file = fopen(path, "wb");
+    trace->mask = capacity - 1;
+    trace->path = path;
+
+    const chip8_trace_header_t header = {
+        .magic = CHIP8_TRACE_MAGIC,
+        .version = CHIP8_TRACE_VERSION,
+        .record_size = sizeof(chip8_trace_record_t),
+        .quirks = quirks < CHIP8_QUIRK_PROFILES ? quirks : CHIP8_QUIRKS_VIP,
+    };
+    if (trace->records == NULL || trace->file == NULL || fwrite(&header, sizeof header, 1, trace->file) != 1 ||
+        pthread_create(&trace->thread, NULL, writer_main, trace) != 0) {
+        fprintf(stderr, "Could not start a trace to %s\n", path);
+        if (trace->file) fclose(trace->file);
+        free(trace->records);
+        free(trace);
+        return NULL;
+    }
+    return trace;
+}
+
+bool chip8_trace_close(chip8_trace_t *trace) {
+    if (trace == NULL) return true;
+
+    atomic_store_explicit(&trace->stop, true, memory_order_release);
+    pthread_join(trace->thread, NULL);
+
+    bool ok = !trace->write_error;
+    if (fclose(trace->file) != 0) ok = false;
+    if (!ok) fprintf(stderr, "Could not write trace %s\n", trace->path);
+
+    free(trace->records);
+    free(trace);
+    return ok;
+}
+
+uint64_t chip8_trace_records(const chip8_trace_t *trace) {
+    return atomic_load(&trace->head);
+}
+
+uint64_t chip8_trace_stalls(const chip8_trace_t *trace) {
+    return trace->stalls;
+}
+
+bool chip8_set_trace(chip8_t *chip8, chip8_trace_t *trace) {
+#ifdef DEBUG
+    chip8->trace = trace;
+    return true;
+#else
+    (void)trace;
+    chip8->trace = NULL;
+    return false;
+#endif
+}
+
+void chip8_trace_instruction(chip8_t *chip8, uint16_t pc, uint16_t opcode) {
+    chip8_trace_t *const trace = chip8->trace;
+    const uint64_t head = atomic_load_explicit(&trace->head, memory_order_relaxed);
+
+    // Only look at the writer's progress when the ring looks full
+    if (head - trace->tail_seen > trace->mask) {
+        trace->tail_seen = atomic_load_explicit(&trace->tail, memory_order_acquire);
+        while (head - trace->tail_seen > trace->mask) {
+            trace->stalls++;
+            sched_yield();
+            trace->tail_seen = atomic_load_explicit(&trace->tail, memory_order_acquire);
+        }
+    }
+
+    trace->records[head & trace->mask] = (chip8_trace_record_t){
+        .PC = pc,
+        .opcode = opcode,
+        .I = chip8->I,
+        .VX = chip8->V[(opcode >> 8) & 0x0F],
+        .VF = chip8->V[0xF],
+    };
+    atomic_store_explicit(&trace->head, head + 1, memory_order_release);
+}
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "chip8_core.h"
+#include "chip8_ops.h"
+
+// Offline trace decoder: one description per record of a trace file (chip8_trace.c).
+//   A record holds I, VX and VF as they were after the instruction; the other
+//   registers are shown as last seen in the trace, '?' until then. Where control went
+//   (skips, returns, jumps, FX0A still waiting) comes from the next record's address.
+//   Instructions the quirk profile changes are described the way the traced machine
+//   ran them (the profile is in the file header).
+
+typedef struct {
+    uint8_t V[16];
+    uint16_t known;             // Bit per register seen in the trace so far
+    char text[2][8];
+} shadow_t;
+
+// "0x1F", or "?" if the register hasn't shown up in the trace yet
+static const char *reg(shadow_t *shadow, uint8_t i, int slot) {
+    if (!(shadow->known & (1u << i))) return "?";
+    snprintf(shadow->text[slot], sizeof shadow->text[slot], "0x%02X", shadow->V[i]);
+    return shadow->text[slot];
+}
+
+static void describe(shadow_t *shadow, const chip8_quirk_flags_t *q,
+                     const chip8_trace_record_t *r, const chip8_trace_record_t *next) {
+    const uint16_t NNN = r->opcode & 0x0FFF;
+    const uint8_t NN = r->opcode & 0xFF;
+    const uint8_t N = r->opcode & 0x0F;
+    const uint8_t X = (r->opcode >> 8) & 0x0F;
+    const uint8_t Y = (r->opcode >> 4) & 0x0F;
+    const bool skipped = next && next->PC == r->PC + 4;
+    const uint8_t shifted = q->shift_vx ? X : Y;                    // 8XY6/8XYE source
+    const uint16_t from_I = q->increment_i ? r->I - X - 1 : r->I;   // FX55/FX65 start
+    const char *const vf_reset = q->vf_reset ? ", VF = 0" : "";     // 8XY1/8XY2/8XY3
+
+    printf("Address: 0x%04X, Opcode: 0x%04X Description: ", r->PC, r->opcode);
+
+    switch (r->opcode >> 12) {
+        case 0x0:
+            if (r->opcode == 0x00E0) {
+                printf("Clear screen\n");
+            } else if (r->opcode == 0x00EE) {
+                if (next) printf("Return from subroutine to address 0x%04X\n", next->PC);
+                else printf("Return from subroutine\n");
+            } else {
+                printf("Umimplemented Opcode.\n");
+            }
+            break;
+
+        case 0x1:
+            printf("Jumps to address NNN (0x%04X)\n", NNN);
+            break;
+
+        case 0x2:
+            printf("Call subroutine at NNN (0x%04X)\n", NNN);
+            break;
+
+        case 0x3:
+            printf("Check if V%X (0x%02X) == NN (0x%02X), skip next instruction if true%s\n",
+                   X, r->VX, NN, skipped ? "; Skipped" : "");
+            break;
+
+        case 0x4:
+            printf("Check if V%X (0x%02X) != NN (0x%02X), skip next instruction if true%s\n",
+                   X, r->VX, NN, skipped ? "; Skipped" : "");
+            break;
+
+        case 0x5:
+            printf("Check if V%X (0x%02X) == V%X (%s), skip next instruction if true%s\n",
+                   X, r->VX, Y, reg(shadow, Y, 0), skipped ? "; Skipped" : "");
+            break;
+
+        case 0x6:
+            printf("Set register V%X to NN (0x%02X)\n", X, NN);
+            break;
+
+        case 0x7:
+            printf("Set register V%X (%s) += NN (0x%02X). Result: 0x%02X\n", X, reg(shadow, X, 0), NN, r->VX);
+            break;
+
+        case 0x8:
+            switch (N) {
+                case 0x0:
+                    printf("Set register V%X = V%X (0x%02X)\n", X, Y, r->VX);
+                    break;
+                case 0x1:
+                    printf("Set register V%X (%s) |= V%X (%s)%s; Result: 0x%02X\n",
+                           X, reg(shadow, X, 0), Y, reg(shadow, Y, 1), vf_reset, r->VX);
+                    break;
+                case 0x2:
+                    printf("Set register V%X (%s) &= V%X (%s)%s; Result: 0x%02X\n",
+                           X, reg(shadow, X, 0), Y, reg(shadow, Y, 1), vf_reset, r->VX);
+                    break;
+                case 0x3:
+                    printf("Set register V%X (%s) ^= V%X (%s)%s; Result: 0x%02X\n",
+                           X, reg(shadow, X, 0), Y, reg(shadow, Y, 1), vf_reset, r->VX);
+                    break;
+                case 0x4:
+                    printf("Set register V%X (%s) += V%X (%s), VF = 1 if carry; Result: 0x%02X, VF = %X\n",
+                           X, reg(shadow, X, 0), Y, reg(shadow, Y, 1), r->VX, r->VF);
+                    break;
+                case 0x5:
+                    printf("Set register V%X (%s) -= V%X (%s), VF = 1 if no borrow; Result: 0x%02X, VF = %X\n",
+                           X, reg(shadow, X, 0), Y, reg(shadow, Y, 1), r->VX, r->VF);
+                    break;
+                case 0x6:
+                    printf("Set register V%X = V%X (%s) >> 1, VF = shifted off bit (%X); Result: 0x%02X\n",
+                           X, shifted, reg(shadow, shifted, 0), r->VF, r->VX);
+                    break;
+                case 0x7:
+                    printf("Set register V%X = V%X (%s) - V%X (%s), VF = 1 if no borrow; Result: 0x%02X, VF = %X\n",
+                           X, Y, reg(shadow, Y, 0), X, reg(shadow, X, 1), r->VX, r->VF);
+                    break;
+                case 0xE:
+                    printf("Set register V%X = V%X (%s) << 1, VF = shifted off bit (%X); Result: 0x%02X\n",
+                           X, shifted, reg(shadow, shifted, 0), r->VF, r->VX);
+                    break;
+                default:
+                    printf("Umimplemented Opcode.\n");
+                    break;
+            }
+            break;
+
+        case 0x9:
+            printf("Check if V%X (0x%02X) != V%X (%s), skip next instruction if true%s\n",
+                   X, r->VX, Y, reg(shadow, Y, 0), skipped ? "; Skipped" : "");
+            break;
+
+        case 0xA:
+            printf("Set I to NNN (0x%04X)\n", NNN);
+            break;
+
+        case 0xB:
+            if (q->jump_vx) printf("Set PC to V%X (%s) + NNN (0x%04X)", X, reg(shadow, X, 0), NNN);
+            else printf("Set PC to V0 (%s) + NNN (0x%04X)", reg(shadow, 0, 0), NNN);
+            if (next) printf("; Result PC = 0x%04X", next->PC);
+            printf("\n");
+            break;
+
+        case 0xC:
+            printf("Set V%X = rand() & NN (0x%02X); Result: 0x%02X\n", X, NN, r->VX);
+            break;
+
+        case 0xD:
+            printf("Draw N (%u) height sprite at coords V%X (0x%02X), V%X (%s) "
+                   "from memory location I (0x%04X). Set VF = 1 if any pixels are turned off; VF = %X\n",
+                   N, X, r->VX, Y, reg(shadow, Y, 0), r->I, r->VF);
+            break;
+
+        case 0xE:
+            if (NN == 0x9E) {
+                printf("Skip next instruction if key in V%X (0x%02X) is pressed%s\n",
+                       X, r->VX, skipped ? "; Skipped" : "");
+            } else if (NN == 0xA1) {
+                printf("Skip next instruction if key in V%X (0x%02X) is not pressed%s\n",
+                       X, r->VX, skipped ? "; Skipped" : "");
+            } else {
+                printf("Umimplemented Opcode.\n");
+            }
+            break;
+
+        default:
+            switch (NN) {
+                case 0x0A:
+                    if (next && next->PC == r->PC) printf("Await until a key is pressed; Store key in V%X; Waiting\n", X);
+                    else printf("Await until a key is pressed; Store key in V%X; Key: %X\n", X, r->VX);
+                    break;
+                case 0x1E:
+                    printf("I (0x%04X) += V%X (0x%02X); Result (I): 0x%04X\n",
+                           (uint16_t)(r->I - r->VX), X, r->VX, r->I);
+                    break;
+                case 0x07:
+                    printf("Set V%X = delay timer value (0x%02X)\n", X, r->VX);
+                    break;
+                case 0x15:
+                    printf("Set delay timer value = V%X (0x%02X)\n", X, r->VX);
+                    break;
+                case 0x18:
+                    printf("Set sound timer value = V%X (0x%02X)\n", X, r->VX);
+                    break;
+                case 0x29:
+                    printf("Set I to sprite location in memory for character in V%X (0x%02X). Result(VX*5) = (0x%02X)\n",
+                           X, r->VX, r->I);
+                    break;
+                case 0x33:
+                    printf("Store BCD representation of V%X (0x%02X) at memory from I (0x%04X)\n", X, r->VX, r->I);
+                    break;
+                case 0x55:
+                    printf("Register dump V0-V%X (0x%02X) inclusive at memory from I (0x%04X)%s\n",
+                           X, r->VX, from_I, q->increment_i ? "; I moved past them" : "");
+                    break;
+                case 0x65:
+                    printf("Register load V0-V%X inclusive at memory from I (0x%04X); Result V%X = 0x%02X%s\n",
+                           X, from_I, X, r->VX, q->increment_i ? "; I moved past them" : "");
+                    break;
+                default:
+                    printf("Umimplemented Opcode.\n");
+                    break;
+            }
+            break;
+    }
+
+    // What the record shows about the registers after it; FX65 also loaded V0..VX-1
+    if ((r->opcode & 0xF0FF) == 0xF065) shadow->known &= ~((1u << X) - 1);
+    shadow->V[X] = r->VX;
+    shadow->V[0xF] = r->VF;
+    shadow->known |= 1u << X | 1u << 0xF;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <trace file>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    FILE *f = fopen(argv[1], "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Trace file %s is invalid or does not exist\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+    chip8_trace_header_t header;
+    if (fread(&header, sizeof header, 1, f) != 1 || header.magic != CHIP8_TRACE_MAGIC ||
+        header.version != CHIP8_TRACE_VERSION || header.record_size != sizeof(chip8_trace_record_t) ||
+        header.quirks >= CHIP8_QUIRK_PROFILES) {
+        fprintf(stderr, "%s is not a version %d CHIP8 trace\n", argv[1], CHIP8_TRACE_VERSION);
+        exit(EXIT_FAILURE);
+    }
+
+    // Each record is described once the one after it is read
+    const chip8_quirk_flags_t *const q = &chip8_quirk_flags[header.quirks];
+    shadow_t shadow = {0};
+    chip8_trace_record_t record, next;
+    uint64_t records = 0;
+    if (fread(&record, sizeof record, 1, f) == 1) {
+        records++;
+        while (fread(&next, sizeof next, 1, f) == 1) {
+            describe(&shadow, q, &record, &next);
+            record = next;
+            records++;
+        }
+        describe(&shadow, q, &record, NULL);
+    }
+    fclose(f);
+    fprintf(stderr, "%llu instructions\n", (unsigned long long)records);
+    exit(EXIT_SUCCESS);
+}